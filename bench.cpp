@@ -0,0 +1,630 @@
+#include <cstdio>
+#include <filesystem>
+#include <print>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "d3.hpp"
+#include <gmath/gmath.hpp>
+#include <stb_image/stb_image.h>
+
+// headless benchmark: renders canonical scenes along fixed camera paths and prints
+// per stage timings as json (default) or csv, e.g.
+// d3_bench --scene all --frames 600 --res ../res --format csv
+// --mode deferred renders through the g buffer instead of shading in the span loop,
+// --mode prepass does a depth only pass first, --shading gouraud|phong lights the
+// scenes with one directional and one point light, --no-occlusion draws the occluded
+// scene without testing against the occluders. --present sync|async copies every frame
+// out like the gl upload would, on the render thread or on a d3::Presenter thread.
+// --incremental only redraws and copies the regions that changed since the last frame.
+// the hierarchy scene chains --cubes cubes to each other through obj_set_parent.
+// the skinned scene bends a tube of --cubes * 80 vertices along a chain of 4 bones.
+// --fps n paces the frames with a d3::Frame_Scheduler, the default 0 runs uncapped; the
+// pacing stats (interval percentiles, jitter, missed deadlines) are reported either way.
+// --input script replays a d3::Input_Script (e.g. res/bench_input.txt) on an input thread
+// in real time, the mouse turns and w/s dolly the camera along its path, and reports how
+// long the newest event waited for its frame
+//
+// --golden dir renders every camera key of the scenes once and compares against
+// dir/<scene>_<key>.ppm instead, writing <scene>_<key>_out.ppm and _diff.ppm to --out
+// (default next to the references) on mismatch. exits with 1 if any image differs, --update-golden rewrites them.
+// the animated scenes then also run a few frames with a fixed camera, redrawn in full
+// and incrementally, and those have to match each other exactly. ctest runs this on
+// res/golden at 320x240 once per instruction set, see CMakeLists.txt
+
+struct Bench_Options {
+    std::string scene = "all";
+    std::string format = "json";
+    std::string res = "res";
+    int frames = 300;
+    int fps = 0;
+    int width = 1200;
+    int height = 900;
+    int cubes = 200;
+    d3::Render_Mode mode = d3::RENDER_FORWARD;
+    d3::Shading shading = d3::SHADING_NONE;
+    std::string golden;
+    // where mismatching golden frames go, the golden dir if empty
+    std::string out;
+    bool update_golden = false;
+    bool occlusion_culling = true;
+    bool incremental = false;
+    // none, sync or async, see run
+    std::string present = "none";
+    std::string input;
+    // per channel
+    int tolerance = 2;
+    size_t max_mismatched = 0;
+};
+
+// frames of the fixed camera sequence run_sequence checks for the animated scenes
+const int sequence_frames = 8;
+
+struct Camera_Key {
+    gmath::Vec3 position;
+    gmath::Vec3 angles;
+};
+
+struct Scene {
+    const char* name;
+    // returns the object update animates, scenes without update return the last one pushed
+    size_t (*build)(d3::Renderer& renderer, const Bench_Options& options);
+    std::vector<Camera_Key> path;
+    // moves obj_id (from build) and whatever hangs off it before frame of frames, golden
+    // runs pass the key
+    void (*update)(d3::Renderer& renderer, size_t obj_id, int frame, int frames) = nullptr;
+};
+
+void load_textures(d3::Renderer& renderer, const Bench_Options& options) {
+    for (const char* file : {"johanndr.jpg", "puto.jpg"}) {
+	d3::Texture t;
+	std::string path = options.res + "/" + file;
+	if (!t.load_from_file(path.c_str())) {
+	    std::println(stderr, "ERROR: could not load {}", path);
+	    exit(1);
+	}
+	renderer.textures.push_back(t);
+    }
+}
+
+size_t load_obj(d3::Renderer& renderer, const Bench_Options& options, const char* file, d3::Transform t, int tex_id) {
+    size_t id;
+    std::string path = options.res + "/" + file;
+    if (!renderer.loadOBJ(path.c_str(), id, t, tex_id)) {
+	std::println(stderr, "ERROR: could not load {}", path);
+	exit(1);
+    }
+    return id;
+}
+
+// square in the xy plane facing -z, same layout as push_surface in main.cpp
+d3::Mesh make_plane(float size, int tex_id) {
+    d3::Mesh mesh;
+    mesh.vertices = {
+	{-size / 2.f,  size / 2.f, 0.f, 1.f},
+	{ size / 2.f,  size / 2.f, 0.f, 1.f},
+	{-size / 2.f, -size / 2.f, 0.f, 1.f},
+	{ size / 2.f, -size / 2.f, 0.f, 1.f},
+    };
+    mesh.uvs.assign(d3::cube_uvs, d3::cube_uvs + d3::cube_uvs_size);
+    mesh.normals = {{0, 0, -1}};
+    mesh.faces = {
+	{{{0, 0, 0}, {1, 1, 0}, {2, 2, 0}}, tex_id},
+	{{{2, 2, 0}, {1, 1, 0}, {3, 3, 0}}, tex_id},
+    };
+    return mesh;
+}
+
+size_t build_teapot_3(d3::Renderer& renderer, const Bench_Options& options) {
+    return load_obj(renderer, options, "utah_teapot_3.obj", {{0, 0, 0}, {0}}, 1);
+}
+
+size_t build_teapot_16(d3::Renderer& renderer, const Bench_Options& options) {
+    return load_obj(renderer, options, "utah_teapot_16.obj", {{0, 0, 0}, {0}}, 1);
+}
+
+// teapot_16 run through simplify_mesh down to the face count of teapot_3, left of it,
+// so the golden shows both at the same budget
+size_t build_simplified(d3::Renderer& renderer, const Bench_Options& options) {
+    size_t coarse = load_obj(renderer, options, "utah_teapot_3.obj", {{2.5f, 0, 0}, {0}}, 1);
+    size_t fine = load_obj(renderer, options, "utah_teapot_16.obj", {{0, 0, 0}, {0}}, 1);
+    renderer.obj_set_visible(fine, false);
+    d3::Mesh simplified = d3::simplify_mesh(renderer.get_mesh(fine), renderer.ranges[coarse].count);
+    return renderer.push_mesh(simplified, {{-2.5f, 0, 0}, {0}});
+}
+
+size_t build_cubes(d3::Renderer& renderer, const Bench_Options& options) {
+    int side = std::max(1, (int)std::ceil(std::sqrt((float)options.cubes)));
+    size_t last = 0;
+    for (int i = 0; i < options.cubes; ++i) {
+	float x = (i % side - side / 2.f) * 1.5f;
+	float y = (i / side - side / 2.f) * 1.5f;
+	d3::Transform t = {{x, y, 4.f}, {i * 0.1f, i * 0.2f, 0.f}};
+	last = renderer.push_cube(1.f, t, i % 2);
+    }
+    return last;
+}
+
+// stacked screen filling planes, mostly overdraw
+size_t build_planes(d3::Renderer& renderer, const Bench_Options& options) {
+    size_t last = 0;
+    for (int i = 0; i < 8; ++i) {
+	last = renderer.push_mesh(make_plane(6.f, i % 2), {{0, 0, 1.f + i * 0.5f}, {0}});
+    }
+    return last;
+}
+
+// a wall in front of a grid of teapot instances, most of them are hidden behind it
+size_t build_occluded(d3::Renderer& renderer, const Bench_Options& options) {
+    size_t teapot = load_obj(renderer, options, "utah_teapot_3.obj", {{0, 0, 0}, {0}}, 1);
+    renderer.obj_set_visible(teapot, false);
+    for (int y = 0; y < 5; ++y) {
+	for (int x = 0; x < 7; ++x) {
+	    renderer.push_instance(teapot, {{(x - 3) * 4.f, (y - 2) * 3.f, 10.f}, {0, x * 0.5f, 0}}, (x + y) % 2);
+	}
+    }
+    size_t wall = renderer.push_mesh(make_plane(12.f, 0), {{0, 0, 2.f}, {0}});
+    renderer.obj_set_occluder(wall, true);
+    return wall;
+}
+
+// static teapot and cubes with one cube circling in front, the camera stays put
+size_t build_moving(d3::Renderer& renderer, const Bench_Options& options) {
+    load_obj(renderer, options, "utah_teapot_3.obj", {{0, 0, 0}, {0}}, 1);
+    for (int i = 0; i < 20; ++i) {
+	renderer.push_cube(1.f, {{(i % 5 - 2) * 2.f, (i / 5 - 1.5f) * 2.f, 6.f}, {i * 0.3f, i * 0.5f, 0}}, i % 2);
+    }
+    return renderer.push_cube(.6f, {{0, 0, 0}, {0}}, 0);
+}
+
+void update_moving(d3::Renderer& renderer, size_t cube, int frame, int frames) {
+    float t = (float)frame / frames * 2.f * gmath::PI;
+    renderer.obj_set_transform(cube, {{std::cos(t) * 3.f, std::sin(t) * 1.5f, -1.f}, {t, t * .7f, 0}});
+}
+
+// a root with 8 arms of --cubes / 8 chained cubes, each relative to the one before.
+// the root and the arm bases turn, so the whole hierarchy moves every frame
+size_t build_hierarchy(d3::Renderer& renderer, const Bench_Options& options) {
+    size_t root = renderer.push_cube(1.f, {{0, 0, 4.f}, {0}}, 0);
+    int links = std::max(1, options.cubes / 8);
+    for (int arm = 0; arm < 8; ++arm) {
+	float angle = arm * gmath::PI / 4.f;
+	size_t parent = root;
+	for (int i = 0; i < links; ++i) {
+	    d3::Transform t = i == 0 ? d3::Transform{{std::cos(angle), 0, std::sin(angle)}, {0, -angle, 0}} : d3::Transform{{.6f, 0, 0}, {0, 0, .1f}};
+	    size_t link = renderer.push_cube(.4f, t, i % 2);
+	    renderer.obj_set_parent(link, parent);
+	    parent = link;
+	}
+    }
+    return root;
+}
+
+void update_hierarchy(d3::Renderer& renderer, size_t root, int frame, int frames) {
+    float t = (float)frame / frames * 2.f * gmath::PI;
+    renderer.obj_set_transform(root, {{0, 0, 4.f}, {0, t, 0}});
+    for (size_t obj_id = root + 1; obj_id < renderer.objects.size(); ++obj_id) {
+	if (renderer.objects[obj_id].parent != root) continue;
+	d3::Transform arm = renderer.transforms[obj_id];
+	arm.angles.z = std::sin(t * 2.f + obj_id) * .4f;
+	renderer.obj_set_transform(obj_id, arm);
+    }
+}
+
+constexpr int tube_bones = 4;
+constexpr float tube_bone_length = 1.5f;
+
+// a tube along +x split into tube_bones bones, each vertex blends the two closest
+size_t build_skinned(d3::Renderer& renderer, const Bench_Options& options) {
+    const int around = 16;
+    const int rings = std::max(2, options.cubes * 5);
+    const float length = tube_bones * tube_bone_length;
+    const float radius = .4f;
+
+    d3::Mesh mesh;
+    // one normal per vertex, so the normals bend with it
+    std::vector<d3::Bone_Weights> weights;
+    for (int r = 0; r < rings; ++r) {
+	float x = length * r / (rings - 1);
+	// bone i covers [i, i + 1) * tube_bone_length, blended around the joints
+	float f = std::clamp(x / tube_bone_length - .5f, 0.f, tube_bones - 1.f);
+	int bone = std::min((int)f, tube_bones - 2);
+	float blend = f - bone;
+	for (int a = 0; a < around; ++a) {
+	    float angle = a * 2.f * gmath::PI / around;
+	    mesh.vertices.push_back({x - length / 2.f, std::cos(angle) * radius, std::sin(angle) * radius, 1.f});
+	    mesh.uvs.push_back({x / length, (float)a / around});
+	    mesh.normals.push_back({0, std::cos(angle), std::sin(angle)});
+	    d3::Bone_Weights w;
+	    w.bones[0] = (uint16_t)bone;
+	    w.bones[1] = (uint16_t)(bone + 1);
+	    w.weights[0] = 1.f - blend;
+	    w.weights[1] = blend;
+	    weights.push_back(w);
+	}
+    }
+    for (int r = 0; r + 1 < rings; ++r) {
+	for (int a = 0; a < around; ++a) {
+	    size_t a1 = (a + 1) % around;
+	    size_t v00 = r * around + a, v01 = r * around + a1;
+	    size_t v10 = v00 + around, v11 = v01 + around;
+	    int tex_id = (r / 8) % 2;
+	    mesh.faces.push_back({{{v00, v00, v00}, {v01, v01, v01}, {v10, v10, v10}}, tex_id});
+	    mesh.faces.push_back({{{v01, v01, v01}, {v11, v11, v11}, {v10, v10, v10}}, tex_id});
+	}
+    }
+    size_t tube = renderer.push_mesh(mesh, {{0, 0, 2.f}, {0}});
+    renderer.obj_set_skin(tube, weights.data(), tube_bones);
+    return tube;
+}
+
+// every joint bends around z, bone i is placed by the one before it
+void update_skinned(d3::Renderer& renderer, size_t tube, int frame, int frames) {
+    float t = (float)frame / frames * 2.f * gmath::PI;
+    const float start = -tube_bones * tube_bone_length / 2.f;
+    d3::Affine bones[tube_bones];
+    d3::Affine posed = d3::Transform{{start, 0, 0}, {0, t * .5f, 0}}.get_model();
+    for (int i = 0; i < tube_bones; ++i) {
+	if (i > 0) posed = posed * d3::Transform{{tube_bone_length, 0, 0}, {0, 0, std::sin(t + i) * .6f}}.get_model();
+	// bind pose: bone i starts at start + i * tube_bone_length without rotation
+	bones[i] = posed * d3::Transform{{-(start + i * tube_bone_length), 0, 0}, {0}}.get_model();
+    }
+    renderer.obj_set_bones(tube, bones, tube_bones);
+}
+
+d3::Transform camera_at(const std::vector<Camera_Key>& path, int frame, int frames) {
+    float t = frames > 1 ? (float)frame / (frames - 1) * (path.size() - 1) : 0.f;
+    size_t key = std::min((size_t)t, path.size() - 2);
+    float f = t - key;
+    const Camera_Key& a = path[key];
+    const Camera_Key& b = path[key + 1];
+    return {
+	{gmath::lerpf(a.position.x, b.position.x, f), gmath::lerpf(a.position.y, b.position.y, f), gmath::lerpf(a.position.z, b.position.z, f)},
+	{gmath::lerpf(a.angles.x, b.angles.x, f), gmath::lerpf(a.angles.y, b.angles.y, f), gmath::lerpf(a.angles.z, b.angles.z, f)},
+    };
+}
+
+// what the --input replay delivered: events applied, and per frame that got any, how long
+// the newest one waited in the queue
+struct Input_Report {
+    size_t events = 0;
+    uint64_t dropped = 0;
+    std::vector<int64_t> latency_ns;
+};
+
+void report(const Scene& scene, const d3::Renderer& renderer, const d3::Frame_Scheduler& scheduler, Input_Report& input, const Bench_Options& options, double seconds) {
+    const d3::Profiler& profiler = renderer.profiler;
+    double fps = options.frames / seconds;
+    auto ms = [&](int stage, float percent) {
+	return profiler.percentile_ns((d3::Profile_Stage)stage, percent) / 1e6;
+    };
+
+    if (options.format == "csv") {
+	for (int stage = 0; stage <= d3::STAGE_COUNT; ++stage) {
+	    const char* name = stage == d3::STAGE_COUNT ? "frame" : d3::stage_names[stage];
+	    std::println("{},{},{},{},{:.4f},{:.4f},{:.4f},{:.2f}", scene.name, options.width, options.height, name,
+			 ms(stage, 50.f), ms(stage, 95.f), ms(stage, 99.f), fps);
+	}
+	return;
+    }
+
+    std::print("{{\"scene\":\"{}\",\"isa\":\"{}\",\"frames\":{},\"width\":{},\"height\":{},\"fps\":{:.2f},\"stages\":{{",
+	       scene.name, d3::isa_names[renderer.kernels->isa], options.frames, options.width, options.height, fps);
+    for (int stage = 0; stage <= d3::STAGE_COUNT; ++stage) {
+	const char* name = stage == d3::STAGE_COUNT ? "frame" : d3::stage_names[stage];
+	std::print("{}\"{}\":{{\"p50_ms\":{:.4f},\"p95_ms\":{:.4f},\"p99_ms\":{:.4f}}}", stage == 0 ? "" : ",",
+		   name, ms(stage, 50.f), ms(stage, 95.f), ms(stage, 99.f));
+    }
+    d3::Pacing_Stats pacing = scheduler.stats();
+    std::print("}},\"pacing\":{{\"target_ms\":{:.4f},\"mean_ms\":{:.4f},\"jitter_ms\":{:.4f},\"p50_ms\":{:.4f},\"p95_ms\":{:.4f},\"p99_ms\":{:.4f},\"max_ms\":{:.4f},\"missed\":{}",
+	       pacing.target_ms, pacing.mean_ms, pacing.jitter_ms, pacing.p50_ms, pacing.p95_ms, pacing.p99_ms, pacing.max_ms, pacing.missed);
+    if (!options.input.empty()) {
+	std::vector<int64_t>& latency = input.latency_ns;
+	std::sort(latency.begin(), latency.end());
+	auto latency_ms = [&](float percent) {
+	    return latency.empty() ? 0.0 : latency[std::min(latency.size() - 1, (size_t)(percent / 100.f * latency.size()))] / 1e6;
+	};
+	std::print("}},\"input\":{{\"events\":{},\"dropped\":{},\"latency_p50_ms\":{:.4f},\"latency_p99_ms\":{:.4f},\"latency_max_ms\":{:.4f}",
+		   input.events, input.dropped, latency_ms(50.f), latency_ms(99.f), latency.empty() ? 0.0 : latency.back() / 1e6);
+    }
+    const d3::Render_Stats& stats = renderer.stats;
+    std::println("}},\"last_frame\":{{\"objects_occluded\":{},\"triangles_submitted\":{},\"triangles_meshlet_culled\":{},\"triangles_rasterized\":{},\"fragments_tested\":{},\"fragments_passed\":{},\"texels_fetched\":{}}}}}",
+		 stats.objects_occluded, stats.triangles_submitted, stats.triangles_meshlet_culled, stats.triangles_rasterized, stats.fragments_tested, stats.fragments_passed, stats.texels_fetched);
+}
+
+// returns what scene.build returned
+size_t init_scene(d3::Renderer& renderer, const Scene& scene, const Bench_Options& options) {
+    renderer.log_level = d3::LOG_ERROR;
+    renderer.render_mode = options.mode;
+    renderer.shading = options.shading;
+    renderer.occlusion_culling = options.occlusion_culling;
+    renderer.incremental = options.incremental;
+    if (options.shading != d3::SHADING_NONE) {
+	renderer.lights.push_back({d3::LIGHT_DIRECTIONAL, {-.4f, -1.f, .6f}, {1.f, .95f, .85f}, .8f});
+	renderer.lights.push_back({d3::LIGHT_POINT, {0.f, 2.f, 2.f}, {.4f, .6f, 1.f}, 1.f, 12.f});
+    }
+    renderer.far_clip = 100.f;
+    renderer.init_framebuffer(options.width, options.height);
+    load_textures(renderer, options);
+    return scene.build(renderer, options);
+}
+
+// transform first, the incremental mode only clears what changed
+void render_frame(d3::Renderer& renderer, d3::Transform camera) {
+    renderer.set_cam_transform(camera);
+    renderer.transform_vertices();
+    renderer.clear_pixels(d3::GRAY);
+    renderer.draw_triangles();
+}
+
+// <name>_out.ppm and <name>_diff.ppm into options.out
+void write_mismatch(const Bench_Options& options, const std::string& name, const d3::Texture& result, const d3::Texture& diff) {
+    const std::string& dir = options.out.empty() ? options.golden : options.out;
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    std::string base = dir + "/" + name;
+    if (!result.write_ppm((base + "_out.ppm").c_str())) {
+	std::println(stderr, "ERROR: could not write {}_out.ppm", base);
+    }
+    if (diff.pixels) diff.write_ppm((base + "_diff.ppm").c_str());
+}
+
+// returns false if any key of the scene does not match its reference image
+bool run_golden(const Scene& scene, const Bench_Options& options) {
+    d3::Renderer renderer;
+    size_t animated = init_scene(renderer, scene, options);
+
+    bool ok = true;
+    for (size_t key = 0; key < scene.path.size(); ++key) {
+	if (scene.update) scene.update(renderer, animated, key, scene.path.size());
+	render_frame(renderer, {scene.path[key].position, scene.path[key].angles});
+
+	std::string name = std::string(scene.name) + "_" + std::to_string(key);
+	std::string reference_path = options.golden + "/" + name + ".ppm";
+
+	if (options.update_golden) {
+	    if (!renderer.tex.write_ppm(reference_path.c_str())) {
+		std::println(stderr, "ERROR: could not write {}", reference_path);
+		ok = false;
+	    }
+	    continue;
+	}
+
+	d3::Texture reference;
+	if (!reference.load_from_file(reference_path.c_str())) {
+	    std::println(stderr, "ERROR: could not load reference {}", reference_path);
+	    ok = false;
+	    continue;
+	}
+
+	d3::Texture diff;
+	size_t mismatched = d3::compare_images(renderer.tex, reference, options.tolerance, diff);
+	bool passed = mismatched <= options.max_mismatched;
+	std::println("{{\"scene\":\"{}\",\"key\":{},\"mismatched_pixels\":{},\"passed\":{}}}",
+		     scene.name, key, mismatched, passed ? "true" : "false");
+
+	if (!passed) {
+	    write_mismatch(options, name, renderer.tex, diff);
+	    ok = false;
+	}
+	delete[] diff.pixels;
+	stbi_image_free(reference.pixels);
+    }
+    return ok;
+}
+
+// the golden keys all move the camera, which redraws everything. this steps the animation
+// with the camera held on the first key instead and checks every partial redraw against a
+// full one of the same frame. fails if a frame differs or, in the modes that can redraw
+// only part of it, redraws the whole target
+bool run_sequence(const Scene& scene, const Bench_Options& options) {
+    Bench_Options full_options = options;
+    full_options.incremental = false;
+    Bench_Options partial_options = options;
+    partial_options.incremental = true;
+
+    d3::Renderer full;
+    d3::Renderer partial;
+    size_t full_animated = init_scene(full, scene, full_options);
+    size_t partial_animated = init_scene(partial, scene, partial_options);
+    d3::Transform camera = {scene.path[0].position, scene.path[0].angles};
+
+    bool ok = true;
+    for (int frame = 0; frame < sequence_frames; ++frame) {
+	scene.update(full, full_animated, frame, sequence_frames * 4);
+	scene.update(partial, partial_animated, frame, sequence_frames * 4);
+	render_frame(full, camera);
+	render_frame(partial, camera);
+
+	size_t redrawn = 0;
+	for (const d3::RectangleI& rect : partial.draw_rects) redrawn += (size_t)rect.width * rect.height;
+	size_t area = (size_t)partial.tex.width * partial.tex.height;
+
+	d3::Texture diff;
+	size_t mismatched = d3::compare_images(partial.tex, full.tex, 0, diff);
+	// the first frame has nothing to reuse, the other modes always redraw everything
+	bool reuses = frame > 0 && (options.mode == d3::RENDER_FORWARD || options.mode == d3::RENDER_PREPASS);
+	bool passed = mismatched == 0 && (!reuses || redrawn < area);
+	std::println("{{\"scene\":\"{}\",\"frame\":{},\"redrawn_pixels\":{},\"mismatched_pixels\":{},\"passed\":{}}}",
+		     scene.name, frame, redrawn, mismatched, passed ? "true" : "false");
+
+	if (!passed) {
+	    write_mismatch(options, std::string(scene.name) + "_frame_" + std::to_string(frame), partial.tex, diff);
+	    ok = false;
+	}
+	delete[] diff.pixels;
+    }
+    return ok;
+}
+
+void run(const Scene& scene, const Bench_Options& options) {
+    d3::Renderer renderer;
+    size_t animated = init_scene(renderer, scene, options);
+
+    // stand in for glTexSubImage2D, there is no gl context headless
+    std::vector<uint32_t> upload((size_t)options.width * options.height);
+    auto upload_frame = [&](const d3::Texture& frame, const std::vector<d3::RectangleI>& dirty) {
+	if (dirty.empty()) {
+	    std::memcpy(upload.data(), frame.pixels, upload.size() * sizeof(uint32_t));
+	    return;
+	}
+	for (const d3::RectangleI& rect : dirty) {
+	    for (int y = rect.y; y < rect.y + rect.height; ++y) {
+		size_t offset = rect.x + (size_t)y * frame.width;
+		std::memcpy(upload.data() + offset, frame.pixels + offset, rect.width * sizeof(uint32_t));
+	    }
+	}
+    };
+    d3::Presenter presenter;
+    if (options.present == "async") {
+	presenter.present = upload_frame;
+	presenter.start(renderer.tex);
+    }
+
+    d3::Frame_Scheduler scheduler;
+    scheduler.set_target_fps(options.fps);
+
+    d3::Input_Script script;
+    d3::Input_Thread input;
+    d3::Input_State input_state = {};
+    Input_Report input_report;
+    float dolly = 0.f;
+    if (!options.input.empty()) {
+	if (!script.load_from_file(options.input.c_str())) {
+	    std::println(stderr, "ERROR: could not load input script {}", options.input);
+	    presenter.stop(renderer.tex);
+	    return;
+	}
+	input_state.mouse_x = options.width / 2;
+	input_state.mouse_y = options.height / 2;
+	int64_t start_ns = d3::steady_now_ns();
+	input.sample = [&script, start_ns](d3::Input_Thread& thread, int64_t now_ns) {
+	    script.feed(thread.queue, start_ns, now_ns - start_ns);
+	};
+	input.start();
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; ++frame) {
+	renderer.profiler.begin_frame();
+	if (scene.update) scene.update(renderer, animated, frame, options.frames);
+	d3::Transform camera = camera_at(scene.path, frame, options.frames);
+	if (input.running()) {
+	    size_t events = input.poll(input_state);
+	    if (events) input_report.latency_ns.push_back(d3::steady_now_ns() - input_state.time_ns);
+	    input_report.events += events;
+	    dolly += (input_state.down('W') - input_state.down('S')) * 0.05f;
+	    camera.position.z += dolly;
+	    camera.angles.y += (input_state.mouse_x - options.width / 2) * 0.001f;
+	    camera.angles.x += (input_state.mouse_y - options.height / 2) * 0.001f;
+	}
+	render_frame(renderer, camera);
+	{
+	    D3_PROFILE_ZONE(renderer.profiler, d3::STAGE_PRESENT);
+	    if (presenter.running()) renderer.buffer_age = presenter.submit(renderer.tex, renderer.dirty_rects);
+	    else if (options.present == "sync") upload_frame(renderer.tex, renderer.dirty_rects);
+	}
+	renderer.profiler.end_frame();
+	scheduler.wait();
+    }
+    presenter.stop(renderer.tex);
+    input.stop();
+    input_report.dropped = input.dropped;
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+
+    report(scene, renderer, scheduler, input_report, options, seconds.count());
+}
+
+int main(int argc, char** argv) {
+    Bench_Options options;
+
+    for (int i = 1; i < argc; ++i) {
+	std::string arg = argv[i];
+	bool has_value = i + 1 < argc;
+	if (arg == "--scene" && has_value) options.scene = argv[++i];
+	else if (arg == "--format" && has_value) options.format = argv[++i];
+	else if (arg == "--res" && has_value) options.res = argv[++i];
+	else if (arg == "--frames" && has_value) options.frames = std::atoi(argv[++i]);
+	else if (arg == "--fps" && has_value) options.fps = std::atoi(argv[++i]);
+	else if (arg == "--width" && has_value) options.width = std::atoi(argv[++i]);
+	else if (arg == "--height" && has_value) options.height = std::atoi(argv[++i]);
+	else if (arg == "--cubes" && has_value) options.cubes = std::atoi(argv[++i]);
+	else if (arg == "--mode" && has_value) {
+	    std::string mode = argv[++i];
+	    if (mode == "forward") options.mode = d3::RENDER_FORWARD;
+	    else if (mode == "deferred") options.mode = d3::RENDER_DEFERRED;
+	    else if (mode == "prepass") options.mode = d3::RENDER_PREPASS;
+	    else if (mode == "overdraw") options.mode = d3::RENDER_OVERDRAW;
+	    else {
+		std::println(stderr, "unknown mode {}", mode);
+		return 1;
+	    }
+	}
+	else if (arg == "--shading" && has_value) {
+	    std::string shading = argv[++i];
+	    if (shading == "none") options.shading = d3::SHADING_NONE;
+	    else if (shading == "gouraud") options.shading = d3::SHADING_GOURAUD;
+	    else if (shading == "phong") options.shading = d3::SHADING_PHONG;
+	    else {
+		std::println(stderr, "unknown shading {}", shading);
+		return 1;
+	    }
+	}
+	else if (arg == "--no-occlusion") options.occlusion_culling = false;
+	else if (arg == "--incremental") options.incremental = true;
+	else if (arg == "--present" && has_value) {
+	    options.present = argv[++i];
+	    if (options.present != "none" && options.present != "sync" && options.present != "async") {
+		std::println(stderr, "unknown present {}", options.present);
+		return 1;
+	    }
+	}
+	else if (arg == "--input" && has_value) options.input = argv[++i];
+	else if (arg == "--golden" && has_value) options.golden = argv[++i];
+	else if (arg == "--update-golden") options.update_golden = true;
+	else if (arg == "--out" && has_value) options.out = argv[++i];
+	else if (arg == "--tolerance" && has_value) options.tolerance = std::atoi(argv[++i]);
+	else if (arg == "--max-mismatched" && has_value) options.max_mismatched = std::atoll(argv[++i]);
+	else {
+	    std::println(stderr, "usage: {} [--scene all|teapot_3|teapot_16|simplified|cubes|planes|occluded|moving|hierarchy|skinned] [--frames n] [--fps n] "
+			 "[--width w] [--height h] [--cubes n] [--mode forward|deferred|prepass|overdraw] [--shading none|gouraud|phong] [--no-occlusion] [--incremental] [--present none|sync|async] [--input script] [--res dir] [--format json|csv] "
+			 "[--golden dir [--update-golden] [--out dir] [--tolerance n] [--max-mismatched pixels]]", argv[0]);
+	    return 1;
+	}
+    }
+
+    // camera starts at -z looking towards +z, the paths dolly in while panning sideways
+    const std::vector<Scene> scenes = {
+	{"teapot_3", build_teapot_3, {{{0, 1, -8}, {0}}, {{-2, 1, -5}, {0, 0.3f, 0}}, {{2, 0.5f, -3}, {0, -0.3f, 0}}}},
+	{"teapot_16", build_teapot_16, {{{0, 1, -8}, {0}}, {{-2, 1, -5}, {0, 0.3f, 0}}, {{2, 0.5f, -3}, {0, -0.3f, 0}}}},
+	{"simplified", build_simplified, {{{0, 1, -8}, {0}}, {{0, 2, -5}, {0.3f, 0, 0}}}},
+	{"cubes", build_cubes, {{{0, 0, -20}, {0}}, {{-4, 2, -12}, {0, 0.2f, 0}}, {{4, -2, -6}, {0, -0.2f, 0}}}},
+	{"planes", build_planes, {{{0, 0, -4}, {0}}, {{0.5f, 0, -2}, {0, 0.1f, 0}}}},
+	{"occluded", build_occluded, {{{0, 0, -6}, {0}}, {{-3, 1, -4}, {0, 0.2f, 0}}, {{3, -1, -2}, {0, -0.2f, 0}}}},
+	{"moving", build_moving, {{{0, 0, -8}, {0}}, {{0, 0, -8}, {0}}, {{0, 0, -8}, {0}}}, update_moving},
+	{"hierarchy", build_hierarchy, {{{0, 2, -8}, {0}}, {{-3, 1, -6}, {0, 0.3f, 0}}, {{3, 0, -4}, {0, -0.3f, 0}}}, update_hierarchy},
+	{"skinned", build_skinned, {{{0, 1, -6}, {0}}, {{-2, 1, -4}, {0, 0.3f, 0}}, {{2, 0, -3}, {0, -0.3f, 0}}}, update_skinned},
+    };
+
+    bool golden = !options.golden.empty();
+    if (options.format == "csv" && !golden) {
+	std::println("scene,width,height,stage,p50_ms,p95_ms,p99_ms,fps");
+    }
+
+    bool found = false;
+    bool ok = true;
+    for (const Scene& scene : scenes) {
+	if (options.scene != "all" && options.scene != scene.name) continue;
+	found = true;
+	if (golden) {
+	    ok = run_golden(scene, options) && ok;
+	    if (scene.update && !options.update_golden) ok = run_sequence(scene, options) && ok;
+	}
+	else run(scene, options);
+    }
+    if (!found) {
+	std::println(stderr, "ERROR: unknown scene {}", options.scene);
+	return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,3543 @@
+#define GMATH_IMPLEMENTATION
+#include <gmath/gmath.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image/stb_image.h>
+#include "d3.hpp"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace d3 {
+
+#ifndef D3_HEADLESS
+// wgl extension, needs a current context to load. loaded by init_gl
+typedef BOOL (WINAPI *wglSwapIntervalEXT_t)(int);
+wglSwapIntervalEXT_t wglSwapIntervalEXT = nullptr;
+
+// gl 4.4 / ARB_buffer_storage, glad is only generated up to 3.3. loaded by init_pbos
+typedef void (APIENTRY *glBufferStorage_t)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+glBufferStorage_t glBufferStorage = nullptr;
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+GLuint vao;
+
+
+constexpr const char* fragment_shader = 
+R"(#version 330 core
+in vec2 uv;
+uniform sampler2D screenTex;
+out vec4 fragColor;
+void main() {
+    vec2 uv_inv = {uv.x, -uv.y};
+    fragColor = texture(screenTex, uv_inv);
+}
+)";
+
+constexpr const char* vertex_shader = 
+R"(#version 330 core
+out vec2 uv;
+void main() {
+    vec2 pos;
+    if (gl_VertexID == 0) pos = vec2(-1.0, -1.0);
+    if (gl_VertexID == 1) pos = vec2( 3.0, -1.0);
+    if (gl_VertexID == 2) pos = vec2(-1.0,  3.0);
+    gl_Position = vec4(pos, 0.0, 1.0);
+    uv = pos * 0.5 + 0.5;
+}
+)";
+
+
+
+
+
+GLuint compile_shader(GLenum type, const char* src) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &src, nullptr);
+    glCompileShader(shader);
+
+
+
+    GLint ok;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+	char log[1024];
+	glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+	MessageBoxA(0, log, "Shader Compile Error", MB_OK);
+	glDeleteShader(shader);
+	return 0;
+    }
+    return shader;
+}
+
+GLuint create_program(const char* vs, const char* fs) {
+    GLuint v = compile_shader(GL_VERTEX_SHADER, vs);
+    GLuint f = compile_shader(GL_FRAGMENT_SHADER, fs);
+    GLuint prog = glCreateProgram();
+    glAttachShader(prog, v);
+    glAttachShader(prog, f);
+    glLinkProgram(prog);
+
+    GLint ok;
+    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    if (!ok) {
+	char log[1024];
+	glGetProgramInfoLog(prog, sizeof(log), nullptr, log);
+	MessageBoxA(0, log, "Program Link Error", MB_OK);
+	glDeleteProgram(prog);
+	return 0;
+    }
+
+    glDeleteShader(v);
+    glDeleteShader(f);
+    return prog;
+}
+
+
+
+
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    switch (uMsg) {
+
+	case WM_DESTROY:
+	    PostQuitMessage(0);
+	    return 0;
+	break;
+
+	case WM_CLOSE:
+	    DestroyWindow(hwnd);
+	    return 0;
+	break;
+
+    }
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+}
+#endif // D3_HEADLESS
+
+    size_t compare_images(const Texture& result, const Texture& reference, int tolerance, Texture& diff) {
+	assert(result.pixels && reference.pixels);
+	if (result.width != reference.width || result.height != reference.height) {
+	    return (size_t)std::max(result.width * result.height, reference.width * reference.height);
+	}
+
+	diff.from_color(result.width, result.height, 0);
+	size_t mismatched = 0;
+
+	for (int i = 0; i < result.width * result.height; ++i) {
+	    const uint8_t* a = (const uint8_t*)&result.pixels[i];
+	    const uint8_t* b = (const uint8_t*)&reference.pixels[i];
+	    int max_dif = 0;
+	    for (int channel = 0; channel < 3; ++channel) {
+		max_dif = std::max(max_dif, std::abs(a[channel] - b[channel]));
+	    }
+
+	    Color out;
+	    if (max_dif > tolerance) {
+		out = {(uint8_t)std::max(128, max_dif), 0, 0, 255};
+		mismatched++;
+	    }
+	    else {
+		out = {(uint8_t)(b[0] / 4), (uint8_t)(b[1] / 4), (uint8_t)(b[2] / 4), 255};
+	    }
+	    diff.pixels[i] = out.to_int();
+	}
+	return mismatched;
+    }
+
+    Color lerp_color(Color start, Color end, float t) {
+	if (t < 0.f) t = 0.f;
+	else if (t > 1.f) t = 1.f;
+
+	float inv_t = 1.f - t;
+	// TODO: blend alpha too?
+	Color res = {
+			(uint8_t)(start.r * inv_t + end.r * t), 
+			(uint8_t)(start.g * inv_t + end.g * t),
+			(uint8_t)(start.b * inv_t + end.b * t),
+			255
+	};
+	return res;
+    }
+
+    Transform lerp_transform(const Transform& a, const Transform& b, float t) {
+	using gmath::lerpf;
+	return {
+	    {lerpf(a.position.x, b.position.x, t), lerpf(a.position.y, b.position.y, t), lerpf(a.position.z, b.position.z, t)},
+	    {lerpf(a.angles.x, b.angles.x, t), lerpf(a.angles.y, b.angles.y, t), lerpf(a.angles.z, b.angles.z, t)},
+	    slerp(a.rotation, b.rotation, t),
+	};
+    }
+
+    Quat slerp(const Quat& a, const Quat& b, float t) {
+	float cos_angle = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	// q and -q are the same rotation, take the one closer to a
+	float sign = cos_angle < 0.f ? -1.f : 1.f;
+	cos_angle *= sign;
+
+	float wa = 1.f - t;
+	float wb = t;
+	// nearly the same rotation, sin(angle) would divide by almost 0
+	if (cos_angle < 0.9995f) {
+	    float angle = std::acos(cos_angle);
+	    float sin_angle = std::sin(angle);
+	    wa = std::sin((1.f - t) * angle) / sin_angle;
+	    wb = std::sin(t * angle) / sin_angle;
+	}
+	wb *= sign;
+	Quat q = {wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z, wa * a.w + wb * b.w};
+	q.normalize();
+	return q;
+    }
+
+    Affine Affine::from_mat4(const gmath::Mat4& m) {
+	Affine a;
+	for (int col = 0; col < 4; ++col) {
+	    gmath::Vec4 basis = {col == 0 ? 1.f : 0.f, col == 1 ? 1.f : 0.f, col == 2 ? 1.f : 0.f, col == 3 ? 1.f : 0.f};
+	    basis.multiply(m);
+	    a.cols[col] = {basis.x, basis.y, basis.z};
+	}
+	return a;
+    }
+
+    void Affine::get_columns(float out[16]) const {
+	for (int col = 0; col < 4; ++col) {
+	    out[col * 4 + 0] = cols[col].x;
+	    out[col * 4 + 1] = cols[col].y;
+	    out[col * 4 + 2] = cols[col].z;
+	    out[col * 4 + 3] = col == 3 ? 1.f : 0.f;
+	}
+    }
+
+    void Affine::get_columns(const gmath::Mat4& m, float out[16]) const {
+	for (int col = 0; col < 4; ++col) {
+	    gmath::Vec4 c = {cols[col].x, cols[col].y, cols[col].z, col == 3 ? 1.f : 0.f};
+	    c.multiply(m);
+	    out[col * 4 + 0] = c.x;
+	    out[col * 4 + 1] = c.y;
+	    out[col * 4 + 2] = c.z;
+	    out[col * 4 + 3] = c.w;
+	}
+    }
+
+    Affine Transform::get_model() const {
+	Affine model = Affine::from_mat4(gmath::Mat4::get_model(position, angles));
+	if (rotation.is_identity()) return model;
+	for (int col = 0; col < 3; ++col) {
+	    model.cols[col] = rotation.rotate(model.cols[col]);
+	}
+	return model;
+    }
+
+    Affine Transform::get_view() const {
+	Affine view = Affine::from_mat4(gmath::Mat4::get_model(position * -1.f, angles * -1.f));
+	if (rotation.is_identity()) return view;
+	Quat inverse = rotation.conjugate();
+	for (int col = 0; col < 4; ++col) {
+	    view.cols[col] = inverse.rotate(view.cols[col]);
+	}
+	return view;
+    }
+
+    // symmetric 4x4 error quadric: xx, xy, xz, xd, yy, yz, yd, zz, zd, dd
+    struct Quadric {
+	double q[10] = {0};
+
+	void add_plane(double a, double b, double c, double d, double weight) {
+	    q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+	    q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+	    q[7] += weight * c * c; q[8] += weight * c * d;
+	    q[9] += weight * d * d;
+	}
+
+	void add(const Quadric& other) {
+	    for (int i = 0; i < 10; ++i) q[i] += other.q[i];
+	}
+
+	double error(double x, double y, double z) const {
+	    return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+		 + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+		 + q[7] * z * z + 2 * q[8] * z
+		 + q[9];
+	}
+    };
+
+    struct Collapse {
+	double cost;
+	uint32_t from;
+	uint32_t to;
+	uint32_t from_version;
+	uint32_t to_version;
+
+	bool operator>(const Collapse& other) const {
+	    return cost > other.cost;
+	}
+    };
+
+    Mesh simplify_mesh(const Mesh& mesh, size_t target_faces) {
+	using namespace gmath;
+
+	// weld equal positions, patch borders are often stored twice with different uvs
+	std::vector<uint32_t> weld(mesh.vertices.size());
+	{
+	    std::map<std::array<float, 3>, uint32_t> first;
+	    for (uint32_t vi = 0; vi < mesh.vertices.size(); ++vi) {
+		const Vec4& v = mesh.vertices[vi];
+		weld[vi] = first.try_emplace({v.x, v.y, v.z}, vi).first->second;
+	    }
+	}
+
+	std::vector<Face> faces = mesh.faces;
+	std::vector<bool> face_alive(faces.size(), true);
+	std::vector<std::vector<uint32_t>> vertex_faces(mesh.vertices.size());
+	std::vector<Quadric> quadrics(mesh.vertices.size());
+	std::vector<bool> vertex_alive(mesh.vertices.size(), false);
+	std::vector<uint32_t> versions(mesh.vertices.size(), 0);
+	size_t live_faces = 0;
+
+	auto position = [&](size_t vi) {
+	    const Vec4& v = mesh.vertices[vi];
+	    return Vec3{v.x, v.y, v.z};
+	};
+	auto face_normal = [](Vec3 a, Vec3 b, Vec3 c) {
+	    return Vec3::cross(b - a, c - a);
+	};
+
+	for (uint32_t fi = 0; fi < faces.size(); ++fi) {
+	    Face& face = faces[fi];
+	    for (IndexRecord& rec : face.vs) rec.v_index = weld[rec.v_index];
+
+	    size_t v0 = face.vs[0].v_index, v1 = face.vs[1].v_index, v2 = face.vs[2].v_index;
+	    if (v0 == v1 || v1 == v2 || v0 == v2) {
+		face_alive[fi] = false;
+		continue;
+	    }
+
+	    Vec3 n = face_normal(position(v0), position(v1), position(v2));
+	    float area = n.length();
+	    if (area > 0.f) {
+		n.multiply(1.f / area);
+		Vec3 p0 = position(v0);
+		double d = -(n.x * p0.x + n.y * p0.y + n.z * p0.z);
+		for (const IndexRecord& rec : face.vs) quadrics[rec.v_index].add_plane(n.x, n.y, n.z, d, area);
+	    }
+
+	    for (const IndexRecord& rec : face.vs) {
+		vertex_faces[rec.v_index].push_back(fi);
+		vertex_alive[rec.v_index] = true;
+	    }
+	    live_faces++;
+	}
+
+	auto corner = [&](const Face& face, uint32_t vi) {
+	    for (int k = 0; k < 3; ++k) if (face.vs[k].v_index == vi) return k;
+	    return -1;
+	};
+
+	auto is_boundary = [&](uint32_t vi) {
+	    std::map<size_t, int> edge_faces;
+	    for (uint32_t fi : vertex_faces[vi]) {
+		for (const IndexRecord& rec : faces[fi].vs) {
+		    if (rec.v_index != vi) edge_faces[rec.v_index]++;
+		}
+	    }
+	    for (auto& [v, count] : edge_faces) if (count == 1) return true;
+	    return false;
+	};
+
+	// uv / normal index of `from` -> index of `to`, taken from the faces sharing the edge
+	struct Wedge_Map {
+	    std::vector<std::pair<size_t, size_t>> pairs;
+	    bool add(size_t from, size_t to) {
+		for (auto& [f, t] : pairs) if (f == from) return t == to;
+		pairs.push_back({from, to});
+		return true;
+	    }
+	    size_t find(size_t from) const {
+		for (auto& [f, t] : pairs) if (f == from) return t;
+		return SIZE_MAX;
+	    }
+	};
+
+	auto can_collapse = [&](uint32_t from, uint32_t to, Wedge_Map& uv_map, Wedge_Map& n_map) {
+	    uv_map.pairs.clear();
+	    n_map.pairs.clear();
+
+	    std::vector<uint32_t> from_neighbours;
+	    int shared = 0;
+	    for (uint32_t fi : vertex_faces[from]) {
+		const Face& face = faces[fi];
+		int k_to = corner(face, to);
+		for (const IndexRecord& rec : face.vs) {
+		    if (rec.v_index != from && rec.v_index != to) from_neighbours.push_back(rec.v_index);
+		}
+		if (k_to < 0) continue;
+
+		const IndexRecord& rec_from = face.vs[corner(face, from)];
+		const IndexRecord& rec_to = face.vs[k_to];
+		if (!uv_map.add(rec_from.uv_index, rec_to.uv_index)) return false;
+		if (!n_map.add(rec_from.n_index, rec_to.n_index)) return false;
+		shared++;
+	    }
+	    if (shared == 0 || shared > 2) return false;
+	    // boundary vertices may only slide along the boundary
+	    if (shared == 2 && is_boundary(from)) return false;
+
+	    // link condition, the edge's opposite vertices have to be the only common neighbours
+	    std::sort(from_neighbours.begin(), from_neighbours.end());
+	    from_neighbours.erase(std::unique(from_neighbours.begin(), from_neighbours.end()), from_neighbours.end());
+	    std::vector<uint32_t> to_neighbours;
+	    for (uint32_t fi : vertex_faces[to]) {
+		for (const IndexRecord& rec : faces[fi].vs) {
+		    if (rec.v_index != from && rec.v_index != to) to_neighbours.push_back(rec.v_index);
+		}
+	    }
+	    std::sort(to_neighbours.begin(), to_neighbours.end());
+	    to_neighbours.erase(std::unique(to_neighbours.begin(), to_neighbours.end()), to_neighbours.end());
+	    std::vector<uint32_t> common;
+	    std::set_intersection(from_neighbours.begin(), from_neighbours.end(),
+				  to_neighbours.begin(), to_neighbours.end(), std::back_inserter(common));
+	    if (common.size() != (size_t)shared) return false;
+
+	    for (uint32_t fi : vertex_faces[from]) {
+		const Face& face = faces[fi];
+		if (corner(face, to) >= 0) continue;
+
+		// every wedge of `from` has to continue on `to`
+		const IndexRecord& rec_from = face.vs[corner(face, from)];
+		if (uv_map.find(rec_from.uv_index) == SIZE_MAX) return false;
+		if (n_map.find(rec_from.n_index) == SIZE_MAX) return false;
+
+		// no flipped or degenerate faces
+		Vec3 p[3];
+		for (int k = 0; k < 3; ++k) p[k] = position(face.vs[k].v_index);
+		Vec3 before = face_normal(p[0], p[1], p[2]);
+		p[corner(face, from)] = position(to);
+		Vec3 after = face_normal(p[0], p[1], p[2]);
+		if (after.length() == 0.f || gmath::dot(before, after) <= 0.f) return false;
+	    }
+	    return true;
+	};
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+	auto push_edges = [&](uint32_t vi) {
+	    for (uint32_t fi : vertex_faces[vi]) {
+		for (const IndexRecord& rec : faces[fi].vs) {
+		    uint32_t other = rec.v_index;
+		    if (other == vi) continue;
+		    Quadric q = quadrics[vi];
+		    q.add(quadrics[other]);
+		    Vec3 p = position(other);
+		    heap.push({q.error(p.x, p.y, p.z), vi, other, versions[vi], versions[other]});
+		    p = position(vi);
+		    heap.push({q.error(p.x, p.y, p.z), other, vi, versions[other], versions[vi]});
+		}
+	    }
+	};
+
+	for (uint32_t vi = 0; vi < vertex_faces.size(); ++vi) {
+	    if (vertex_alive[vi]) push_edges(vi);
+	}
+
+	Wedge_Map uv_map;
+	Wedge_Map n_map;
+
+	while (live_faces > target_faces && !heap.empty()) {
+	    Collapse c = heap.top();
+	    heap.pop();
+
+	    if (!vertex_alive[c.from] || !vertex_alive[c.to]) continue;
+	    // one of the quadrics changed since this was pushed
+	    if (c.from_version != versions[c.from] || c.to_version != versions[c.to]) continue;
+	    if (!can_collapse(c.from, c.to, uv_map, n_map)) continue;
+
+	    for (uint32_t fi : vertex_faces[c.from]) {
+		Face& face = faces[fi];
+		if (corner(face, c.to) >= 0) {
+		    face_alive[fi] = false;
+		    live_faces--;
+		    for (const IndexRecord& rec : face.vs) {
+			if (rec.v_index == c.from || rec.v_index == c.to) continue;
+			std::erase(vertex_faces[rec.v_index], fi);
+		    }
+		    continue;
+		}
+		IndexRecord& rec = face.vs[corner(face, c.from)];
+		rec.v_index = c.to;
+		rec.uv_index = uv_map.find(rec.uv_index);
+		rec.n_index = n_map.find(rec.n_index);
+		vertex_faces[c.to].push_back(fi);
+	    }
+
+	    std::erase_if(vertex_faces[c.to], [&](uint32_t fi) { return !face_alive[fi]; });
+	    vertex_faces[c.from].clear();
+	    vertex_alive[c.from] = false;
+
+	    quadrics[c.to].add(quadrics[c.from]);
+	    versions[c.to]++;
+	    push_edges(c.to);
+	}
+
+	Mesh result;
+	std::vector<size_t> v_remap(mesh.vertices.size(), SIZE_MAX);
+	std::vector<size_t> uv_remap(mesh.uvs.size(), SIZE_MAX);
+	std::vector<size_t> n_remap(mesh.normals.size(), SIZE_MAX);
+
+	for (uint32_t fi = 0; fi < faces.size(); ++fi) {
+	    if (!face_alive[fi]) continue;
+	    Face face = faces[fi];
+	    for (IndexRecord& rec : face.vs) {
+		if (v_remap[rec.v_index] == SIZE_MAX) {
+		    v_remap[rec.v_index] = result.vertices.size();
+		    result.vertices.push_back(mesh.vertices[rec.v_index]);
+		}
+		if (uv_remap[rec.uv_index] == SIZE_MAX) {
+		    uv_remap[rec.uv_index] = result.uvs.size();
+		    result.uvs.push_back(mesh.uvs[rec.uv_index]);
+		}
+		if (n_remap[rec.n_index] == SIZE_MAX) {
+		    n_remap[rec.n_index] = result.normals.size();
+		    result.normals.push_back(mesh.normals[rec.n_index]);
+		}
+		rec.v_index = v_remap[rec.v_index];
+		rec.uv_index = uv_remap[rec.uv_index];
+		rec.n_index = n_remap[rec.n_index];
+	    }
+	    result.faces.push_back(face);
+	}
+
+	return result;
+    }
+
+    std::future<Mesh> simplify_mesh_async(Mesh mesh, size_t target_faces) {
+	return std::async(std::launch::async, [mesh = std::move(mesh), target_faces]() {
+	    return simplify_mesh(mesh, target_faces);
+	});
+    }
+
+    std::string Texture::to_str() const {
+	return std::string("\npixels = ") + std::to_string((size_t)pixels) + "\nwidth = " + std::to_string(width)
+	    + "\nheight = " + std::to_string(height) + "\ncomp_per_px = " + std::to_string(comp_per_px);
+    }
+
+    bool Texture::load_from_file(const char* filename) {
+	assert(pixels == nullptr);
+	int n; 
+	pixels = (uint32_t*)stbi_load(filename, &width, &height, &n, comp_per_px);
+	return (pixels != nullptr);
+    }
+
+    void Texture::from_color(int width, int height, int color) {
+	assert(pixels == nullptr);
+	pixels = new uint32_t[width * height];
+	std::memset(pixels, color, sizeof(uint32_t) * width * height);
+	this->width = width;
+	this->height = height;
+    }
+
+    bool Texture::write_ppm(const char* filepath) const {
+	assert(pixels);
+	std::ofstream file(filepath, std::ios::binary);
+	if (!file) return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	for (int i = 0; i < width * height; ++i) {
+	    file.write((const char*)&pixels[i], 3);
+	}
+	return file.good();
+    }
+
+
+    void Render_Stats::print() const {
+	std::println("objects: occluded = {} ({} triangles)", objects_occluded, triangles_occluded);
+	std::println("triangles: submitted = {}, meshlet culled = {} ({} meshlets), backface culled = {}, near rejected = {}, far rejected = {}, rasterized = {}",
+		     triangles_submitted, triangles_meshlet_culled, meshlets_culled, triangles_backface_culled, triangles_near_rejected, triangles_far_rejected, triangles_rasterized);
+	std::println("fragments: tested = {}, passed depth = {}, texels fetched = {}",
+		     fragments_tested, fragments_passed, texels_fetched);
+    }
+
+
+    int64_t Profiler::percentile_ns(Profile_Stage stage, float percent) const {
+	size_t count = recorded_frames();
+	if (count == 0) return 0;
+
+	std::vector<int64_t> values(count);
+	for (size_t i = 0; i < count; ++i) {
+	    const Frame_Profile& frame = frames[i];
+	    values[i] = (stage == STAGE_COUNT ? frame.total_ns() : frame.stage_ns[stage]);
+	}
+	size_t n = std::min(count - 1, (size_t)(percent / 100.f * count));
+	std::nth_element(values.begin(), values.begin() + n, values.end());
+	return values[n];
+    }
+
+    void Profiler::print_report() const {
+	std::println("profile over {} frames, ms:", recorded_frames());
+	std::println("{:>10} {:>8} {:>8} {:>8}", "stage", "p50", "p95", "p99");
+	for (int stage = 0; stage <= STAGE_COUNT; ++stage) {
+	    Profile_Stage s = (Profile_Stage)stage;
+	    std::println("{:>10} {:>8.3f} {:>8.3f} {:>8.3f}", (stage == STAGE_COUNT ? "frame" : stage_names[stage]),
+			 percentile_ns(s, 50.f) / 1e6, percentile_ns(s, 95.f) / 1e6, percentile_ns(s, 99.f) / 1e6);
+	}
+    }
+
+    bool Profiler::write_chrome_trace(const char* filepath) const {
+	std::ofstream file(filepath);
+	if (!file) return false;
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[\n";
+	bool first = true;
+	auto write_event = [&](const char* name, int64_t begin_ns, int64_t end_ns) {
+	    file << (first ? "" : ",\n")
+		 << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+		 << ",\"ts\":" << begin_ns / 1000.0 << ",\"dur\":" << (end_ns - begin_ns) / 1000.0 << "}";
+	    first = false;
+	};
+
+	size_t count = recorded_frames();
+	for (size_t i = frame_count - count; i < frame_count; ++i) {
+	    const Frame_Profile& frame = frames[i % frame_capacity];
+	    write_event("frame", frame.begin_ns, frame.end_ns);
+	    for (const Profile_Zone_Record& zone : frame.zones) {
+		write_event(stage_names[zone.stage], zone.begin_ns, zone.end_ns);
+	    }
+	}
+	file << "\n]}\n";
+	return file.good();
+    }
+
+    void Frame_Scheduler::wait() {
+	if (target_ns > 0 && frame_count > 0) {
+	    std::chrono::nanoseconds target(target_ns);
+	    next += target;
+	    // more than a frame behind: start a new cadence instead of rushing the next frames
+	    if (clock::now() > next + target) next = clock::now();
+	    else wait_until(next);
+	}
+
+	clock::time_point now = clock::now();
+	if (frame_count > 0) {
+	    int64_t interval = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+	    intervals[interval_count % frame_capacity] = interval;
+	    interval_count++;
+	    smoothed_ns = interval_count == 1 ? interval : smoothed_ns + (int64_t)((interval - smoothed_ns) * smoothing);
+	}
+	if (target_ns <= 0 || frame_count == 0) next = now;
+	last = now;
+	frame_count++;
+    }
+
+    void Frame_Scheduler::wait_until(clock::time_point deadline) {
+	// sleep in 1 ms steps while that can't overshoot, a single long sleep
+	// can wake up a whole timer period late
+	while (deadline - clock::now() > std::chrono::nanoseconds(sleep_ns)) {
+	    clock::time_point before = clock::now();
+	    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	    int64_t took = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - before).count();
+	    // up right away, back down slowly
+	    sleep_ns = took > sleep_ns ? took : sleep_ns - (sleep_ns - took) / 64;
+	}
+	while (clock::now() < deadline) {
+	    std::this_thread::yield();
+	}
+    }
+
+    Pacing_Stats Frame_Scheduler::stats() const {
+	Pacing_Stats stats;
+	stats.frames = std::min(interval_count, frame_capacity);
+	stats.target_ms = target_ns / 1e6;
+	if (stats.frames == 0) return stats;
+
+	std::vector<int64_t> values(intervals.begin(), intervals.begin() + stats.frames);
+	double sum = 0;
+	for (int64_t v : values) {
+	    sum += v;
+	    if (target_ns > 0 && v * 2 > target_ns * 3) stats.missed++;
+	}
+	double mean = sum / stats.frames;
+	double variance = 0;
+	for (int64_t v : values) variance += (v - mean) * (v - mean);
+	stats.mean_ms = mean / 1e6;
+	stats.jitter_ms = std::sqrt(variance / stats.frames) / 1e6;
+
+	std::sort(values.begin(), values.end());
+	auto percentile = [&](float percent) {
+	    return values[std::min(stats.frames - 1, (size_t)(percent / 100.f * stats.frames))] / 1e6;
+	};
+	stats.p50_ms = percentile(50.f);
+	stats.p95_ms = percentile(95.f);
+	stats.p99_ms = percentile(99.f);
+	stats.max_ms = values.back() / 1e6;
+	return stats;
+    }
+
+    void Frame_Scheduler::print_report() const {
+	Pacing_Stats s = stats();
+	std::println("pacing over {} frames, target {:.3f} ms: mean {:.3f}, jitter {:.3f}, p50 {:.3f}, p95 {:.3f}, p99 {:.3f}, max {:.3f}, missed {}",
+		     s.frames, s.target_ms, s.mean_ms, s.jitter_ms, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms, s.missed);
+    }
+
+    Presenter::~Presenter() {
+	assert(!running() && "stop the presenter while the target it swaps into is alive");
+    }
+
+    void Presenter::start(Texture& target, int buffer_count) {
+	assert(!running());
+	assert(target.pixels && buffer_count >= 2);
+	width = target.width;
+	height = target.height;
+	stopping = false;
+	owns_buffers = true;
+	for (int i = 1; i < buffer_count; ++i) {
+	    free_buffers.push_back(new uint32_t[(size_t)width * height]());
+	}
+	start_thread();
+    }
+
+    void Presenter::start(Texture& target, const std::vector<uint32_t*>& buffers) {
+	assert(!running());
+	assert(target.pixels && buffers.size() >= 2);
+	width = target.width;
+	height = target.height;
+	stopping = false;
+	owns_buffers = false;
+	own_pixels = target.pixels;
+	target.pixels = buffers[0];
+	free_buffers.assign(buffers.begin() + 1, buffers.end());
+	start_thread();
+    }
+
+    void Presenter::start_thread() {
+	submits = 0;
+	last_submit.clear();
+	thread = std::thread([this]() {
+	    if (thread_begin) thread_begin();
+	    std::unique_lock lock(mutex);
+	    while (true) {
+		cond.wait(lock, [this]() { return !queued.empty() || stopping; });
+		if (queued.empty()) break;
+		Frame frame = std::move(queued.front());
+		queued.pop_front();
+
+		lock.unlock();
+		if (present) present({frame.pixels, width, height}, frame.dirty);
+		lock.lock();
+
+		free_buffers.push_back(frame.pixels);
+		cond.notify_all();
+	    }
+	    lock.unlock();
+	    if (thread_end) thread_end();
+	});
+    }
+
+    int Presenter::submit(Texture& target, const std::vector<RectangleI>& dirty) {
+	assert(running());
+	assert(target.width == width && target.height == height);
+	std::unique_lock lock(mutex);
+	submits++;
+	last_submit[target.pixels] = submits;
+	queued.push_back({target.pixels, dirty});
+	cond.notify_all();
+	cond.wait(lock, [this]() { return !free_buffers.empty(); });
+	target.pixels = free_buffers.front();
+	free_buffers.pop_front();
+
+	// the next frame is submit number submits + 1
+	auto last = last_submit.find(target.pixels);
+	return last == last_submit.end() ? 0 : (int)(submits + 1 - last->second);
+    }
+
+    void Presenter::stop(Texture& target) {
+	if (!running()) return;
+	{
+	    std::lock_guard lock(mutex);
+	    stopping = true;
+	}
+	cond.notify_all();
+	thread.join();
+
+	// everything but target is back in free_buffers
+	assert(queued.empty());
+	if (owns_buffers) {
+	    for (uint32_t* pixels : free_buffers) {
+		assert(pixels != target.pixels);
+		delete[] pixels;
+	    }
+	}
+	else {
+	    target.pixels = own_pixels;
+	    own_pixels = nullptr;
+	}
+	free_buffers.clear();
+    }
+
+    void Worker_Pool::start(size_t count) {
+	assert(threads.empty() && count >= 1);
+	stopping = false;
+	workers = count;
+	for (size_t worker = 1; worker < count; ++worker) {
+	    // run can bump generation before the thread gets going
+	    threads.emplace_back([this, worker, done = generation]() mutable {
+		std::unique_lock lock(mutex);
+		while (true) {
+		    cond.wait(lock, [&]() { return generation != done || stopping; });
+		    if (stopping) break;
+		    done = generation;
+		    lock.unlock();
+		    (*job)(worker, workers);
+		    lock.lock();
+		    if (--pending == 0) cond.notify_all();
+		}
+	    });
+	}
+    }
+
+    void Worker_Pool::stop() {
+	{
+	    std::lock_guard lock(mutex);
+	    stopping = true;
+	}
+	cond.notify_all();
+	for (std::thread& thread : threads) thread.join();
+	threads.clear();
+	workers = 1;
+    }
+
+    void Worker_Pool::run(const std::function<void(size_t worker, size_t workers)>& job) {
+	if (threads.empty()) {
+	    job(0, 1);
+	    return;
+	}
+	{
+	    std::lock_guard lock(mutex);
+	    this->job = &job;
+	    pending = threads.size();
+	    generation++;
+	}
+	cond.notify_all();
+	job(0, workers);
+	std::unique_lock lock(mutex);
+	cond.wait(lock, [this]() { return pending == 0; });
+	this->job = nullptr;
+    }
+
+    void Input_State::apply(const Input_Event& event) {
+	switch (event.type) {
+	    case INPUT_KEY_DOWN:
+		if (event.key < 0 || event.key >= 256) break;
+		keys[event.key] = true;
+		pressed[event.key] = true;
+		break;
+	    case INPUT_KEY_UP:
+		if (event.key < 0 || event.key >= 256) break;
+		keys[event.key] = false;
+		break;
+	    case INPUT_MOUSE_MOVE:
+		mouse_x = event.x;
+		mouse_y = event.y;
+		break;
+	}
+	time_ns = std::max(time_ns, event.time_ns);
+    }
+
+    void Input_Thread::start() {
+	assert(!running() && sample);
+	stopping = false;
+	thread = std::thread([this]() {
+	    while (!stopping) {
+		sample(*this, steady_now_ns());
+		std::this_thread::sleep_for(period);
+	    }
+	});
+    }
+
+    void Input_Thread::stop() {
+	if (!running()) return;
+	stopping = true;
+	thread.join();
+    }
+
+    size_t Input_Thread::poll(Input_State& state) {
+	state.pressed = {};
+	size_t count = 0;
+	Input_Event event;
+	while (queue.pop(event)) {
+	    state.apply(event);
+	    count++;
+	}
+	return count;
+    }
+
+    bool Input_Script::load_from_file(const char* filepath) {
+	std::ifstream file(filepath);
+	if (!file) return false;
+
+	events.clear();
+	next = 0;
+	std::string line;
+	while (std::getline(file, line)) {
+	    if (line.empty() || line[0] == '#') continue;
+	    std::istringstream in(line);
+	    double ms;
+	    std::string type;
+	    if (!(in >> ms >> type)) return false;
+
+	    Input_Event event = {};
+	    event.time_ns = (int64_t)(ms * 1e6);
+	    if (type == "move") {
+		event.type = INPUT_MOUSE_MOVE;
+		if (!(in >> event.x >> event.y)) return false;
+	    }
+	    else if (type == "down" || type == "up") {
+		event.type = type == "down" ? INPUT_KEY_DOWN : INPUT_KEY_UP;
+		std::string key;
+		if (!(in >> key)) return false;
+		if (key.size() == 1 && std::isalnum((unsigned char)key[0])) event.key = std::toupper((unsigned char)key[0]);
+		else event.key = std::atoi(key.c_str());
+	    }
+	    else return false;
+	    events.push_back(event);
+	}
+	std::stable_sort(events.begin(), events.end(), [](const Input_Event& a, const Input_Event& b) { return a.time_ns < b.time_ns; });
+	return true;
+    }
+
+    void Input_Script::feed(Input_Queue& queue, int64_t start_ns, int64_t elapsed_ns) {
+	for (; next < events.size() && events[next].time_ns <= elapsed_ns; ++next) {
+	    Input_Event event = events[next];
+	    event.time_ns += start_ns;
+	    if (!queue.push(event)) break;
+	}
+    }
+
+
+    Isa detect_isa() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	auto cpuid = [](int leaf, int sub, int regs[4]) {
+#if defined(_MSC_VER)
+	    __cpuidex(regs, leaf, sub);
+#else
+	    unsigned a, b, c, d;
+	    __cpuid_count(leaf, sub, a, b, c, d);
+	    regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+	};
+
+	int regs[4];
+	cpuid(0, 0, regs);
+	int max_leaf = regs[0];
+	cpuid(1, 0, regs);
+	bool fma = regs[2] & (1 << 12);
+	bool osxsave = regs[2] & (1 << 27);
+	bool avx = regs[2] & (1 << 28);
+	if (max_leaf < 7 || !osxsave || !avx || !fma) return ISA_SSE2;
+
+	// the os has to save the ymm / zmm registers on context switches too
+#if defined(_MSC_VER)
+	uint64_t xcr0 = _xgetbv(0);
+#else
+	unsigned xcr0_lo, xcr0_hi;
+	__asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	uint64_t xcr0 = ((uint64_t)xcr0_hi << 32) | xcr0_lo;
+#endif
+	if ((xcr0 & 0x6) != 0x6) return ISA_SSE2;
+
+	cpuid(7, 0, regs);
+	unsigned ebx = regs[1];
+	bool avx2 = ebx & (1u << 5);
+	bool avx512 = (ebx & (1u << 16)) && (ebx & (1u << 17)) && (ebx & (1u << 30)) && (ebx & (1u << 31));
+	if (avx512 && (xcr0 & 0xe0) == 0xe0) return ISA_AVX512;
+	if (avx2) return ISA_AVX2;
+#endif
+	return ISA_SSE2;
+    }
+
+    const Kernel_Table& get_kernels(Isa isa) {
+	switch (isa) {
+	    case ISA_AVX512: return kernels_avx512;
+	    case ISA_AVX2: return kernels_avx2;
+	    default: return kernels_sse2;
+	}
+    }
+
+    const Kernel_Table& select_kernels() {
+	static const Kernel_Table& selected = []() -> const Kernel_Table& {
+	    Isa isa = detect_isa();
+	    const char* forced = std::getenv("D3_ISA");
+	    if (!forced) return get_kernels(isa);
+
+	    int requested = 0;
+	    while (requested < ISA_COUNT && std::strcmp(forced, isa_names[requested]) != 0) requested++;
+	    if (requested == ISA_COUNT) {
+		std::println(stderr, "D3_ISA = {} is unknown, using {}", forced, isa_names[isa]);
+	    }
+	    else if (requested > isa) {
+		std::println(stderr, "D3_ISA = {} is not supported by this cpu, using {}", forced, isa_names[isa]);
+	    }
+	    else {
+		isa = (Isa)requested;
+	    }
+	    return get_kernels(isa);
+	}();
+	return selected;
+    }
+
+    Renderer::Renderer() {
+	kernels = &select_kernels();
+
+	Transform cam_transform = {{0, 0, -1}, {0}};
+	camera.id = push_object(cam_transform);
+
+	assert(camera.id == 0);
+    }
+
+    Renderer::~Renderer() {
+#ifndef D3_HEADLESS
+	// the context is gone by now, whoever made it has to call release_pbos first
+	assert(pbos.empty());
+#endif
+	if (tex.pixels) {
+	    delete[] tex.pixels;
+	    tex.pixels = nullptr;
+	}
+    }
+
+    bool Renderer::loadOBJ(const char* filepath, size_t& obj_id, Transform t, int tex_id) {
+	std::ifstream file(filepath);
+	if (file.bad()) return false;
+
+	// OBJ indeces start with 1, so subtracting 1 should always fix that
+	size_t v_index_start = this->vertices_world.size() - 1;
+	size_t uv_index_start = this->uvs.size() - 1;
+	size_t n_index_start = this->normals.size() - 1;
+	IndexRange range;
+	range.start = this->faces.size();
+
+	if (log_level <= LOG_DEBUG) std::println("loading obj:\nv_i_start = {}, uv_i_start = {}, n_i_start = {}, range.start = {}", v_index_start, uv_index_start, n_index_start, range.start);
+
+	std::string line;
+	std::string start;
+	std::vector<gmath::Vec4> verts;
+	std::vector<Face> faces;
+	std::vector<UV> uvs;
+	std::vector<gmath::Vec3> normals;
+
+	Face face;
+	gmath::Vec4 vert;
+	gmath::Vec3 normal;
+	float u, v;
+
+	while(std::getline(file, line)) {
+	    std::istringstream iss(line);
+	    start = "";
+	    iss >> start;
+
+	    if (start.starts_with("vt")) {
+		iss >> u;		    
+		iss >> v;		    
+		uvs.emplace_back(UV{u,v}); 
+	    }
+	    else if (start.starts_with("vn")) {
+		if (log_level <= LOG_DEBUG) std::println("parsing face: {}", line);
+		if (!(iss >> normal.x) ||
+		    !(iss >> normal.y) ||
+		    !(iss >> normal.z)) {
+		    std::println("error on line: {}", line);
+		    std::println("start = {}", start);
+		    std::println("normal = {}", normal.to_str());
+		    continue;
+
+		}
+		//normal.multiply(-1.f);
+		//normal.z *= -1.f;
+		//normal.y *= -1.f;
+		if (log_level <= LOG_DEBUG) std::println("parsed normal = {}", normal.to_str());
+		normals.emplace_back(normal);
+
+	    }
+	    else if (start.starts_with("v")) {
+		if (!(iss >> vert.x) ||
+		    !(iss >> vert.y) ||
+		    !(iss >> vert.z)) {
+		    std::println("error on line: {}", line);
+		    std::println("start = {}", start);
+		    std::println("vertex = {}", vert.to_str());
+		    continue;
+
+		}
+		vert.w = 1.f;
+		verts.emplace_back(vert);
+	    }
+	    else if (start.starts_with("f")) {
+		//std::println("parsing face: {}", line);
+		int cur = 0;
+		char c = line[0];
+		// only works for f 1/2/3 etc, f v_index/uv_index/normal_index
+		// find first two numbers
+		for(int vertex = 0; vertex < 3; ++vertex) {
+		    iss >> face.vs[vertex].v_index;
+		    face.vs[vertex].v_index += v_index_start;
+		    iss >> c;
+		    assert(c == '/');
+		    iss >> face.vs[vertex].uv_index;
+		    face.vs[vertex].uv_index += uv_index_start;
+		    iss >> c;
+		    assert(c == '/');
+		    iss >> face.vs[vertex].n_index;
+		    face.vs[vertex].n_index += n_index_start;
+		}
+		face.tex_index = tex_id;
+		faces.emplace_back(face);
+	    }
+	}
+
+	if (log_level <= LOG_DEBUG) std::println("LoadOBJ: after reading in file:\nvertices read = {}, uvs read = {}\nnormals read = {}, faces read = {}", verts.size(), uvs.size(), normals.size(), faces.size());
+
+	//obj_push_verts(obj_id, verts.data(), verts.size(), v_indeces.data(), v_indeces.size());
+	//obj_push_uvs(obj_id, uvs.data(), uvs.size(), uv_indeces.data());
+
+	push_vertices(verts.data(), verts.size());
+	push_uvs(uvs.data(), uvs.size());
+	push_normals(normals.data(), normals.size());
+	push_faces(faces.data(), faces.size());
+
+	range.count = faces.size();
+	if (log_level <= LOG_DEBUG) std::println("teapot face range:\nstart = {}, count = {}", range.start, range.count);
+	obj_id = push_object(t, range);
+
+	return true;
+    }
+
+    Transform Renderer::get_cam_transform() {
+	return transforms[camera.id] ;
+    }
+
+    void Renderer::set_cam_transform(const Transform& t) {
+	obj_set_transform(camera.id, t);
+    }
+
+    size_t Renderer::push_cube(float side, Transform t, int tex_id) {
+
+	size_t v_start = vertices_world.size();
+	size_t uv_start = uvs.size();
+	size_t n_start = normals.size();
+
+	constexpr size_t v_size = 8;
+	gmath::Vec4 vertices[v_size] = {0}; 
+	vertices[0] = {-side / 2.f,  side / 2.f, -side / 2.f, 1.f};//, .u = 0.f, .v = 0.f, .tex_id = 0};
+	vertices[1] = { side / 2.f,  side / 2.f, -side / 2.f, 1.f};//, .u = 1.f, .v = 0.f, .tex_id = 0};
+	vertices[2] = {-side / 2.f, -side / 2.f, -side / 2.f, 1.f};//, .u = 0.f, .v = 1.f, .tex_id = 0};
+	vertices[3] = { side / 2.f, -side / 2.f, -side / 2.f, 1.f};//, .u = 1.f, .v = 1.f, .tex_id = 0};
+
+	vertices[4] = {-side / 2.f,  side / 2.f,  side / 2.f, 1.f};//, .u = 0.f, .v = 0.f, .tex_id = 0};
+	vertices[5] = { side / 2.f,  side / 2.f,  side / 2.f, 1.f};//, .u = 1.f, .v = 0.f, .tex_id = 0};
+	vertices[6] = {-side / 2.f, -side / 2.f,  side / 2.f, 1.f};//, .u = 0.f, .v = 1.f, .tex_id = 0};
+	vertices[7] = { side / 2.f, -side / 2.f,  side / 2.f, 1.f};//, .u = 1.f, .v = 1.f, .tex_id = 0};
+
+	push_vertices(vertices, v_size);
+	push_uvs(cube_uvs, cube_uvs_size);
+
+	constexpr size_t n_count = 6;
+	constexpr gmath::Vec3 normals[n_count] = {
+	    {0, 0, -1}, {0, 0, 1},
+	    {1, 0, 0}, {-1, 0, 0},
+	    {0, 1, 0}, {0, -1, 0}
+	};
+
+	push_normals(normals, n_count);
+
+
+    // v_is
+    //    4, 0, 6,  6, 0, 2, 
+
+    //    4, 5, 0,  0, 5, 1,
+
+    //    2, 3, 6,  6, 3, 7,
+
+    //    1, 5, 3,  3, 5, 7,
+
+    //    6, 7, 4,  4, 7, 5,
+
+    //    0, 1, 2,  2, 1, 3,
+
+
+//uvs:
+//0.f, 0.f,
+//1.f, 0.f,  
+//0.f, 1.f, 
+//1.f, 1.f
+	constexpr size_t face_count = 6 * 2;
+	Face faces[face_count] = {
+	    // front
+	    {{{0 + v_start, 0 + uv_start, 0 + n_start}, {1 + v_start, 1 + uv_start, 0 + n_start}, {2 + v_start, 2 + uv_start, 0 + n_start}}, tex_id},
+	    {{{2 + v_start, 2 + uv_start, 0 + n_start}, {1 + v_start, 1 + uv_start, 0 + n_start}, {3 + v_start, 3 + uv_start, 0 + n_start}}, tex_id},
+	    // back
+	    {{{6 + v_start, 3 + uv_start, 1 + n_start}, {7 + v_start, 2 + uv_start, 1 + n_start}, {4 + v_start, 1 + uv_start, 1 + n_start}}, tex_id},
+	    {{{4 + v_start, 1 + uv_start, 1 + n_start}, {7 + v_start, 2 + uv_start, 1 + n_start}, {5 + v_start, 0 + uv_start, 1 + n_start}}, tex_id},
+	    // left
+	    {{{4 + v_start, 0 + uv_start, 4 + n_start}, {0 + v_start, 1 + uv_start, 4 + n_start}, {6 + v_start, 2 + uv_start, 4 + n_start}}, tex_id},
+	    {{{6 + v_start, 2 + uv_start, 4 + n_start}, {0 + v_start, 1 + uv_start, 4 + n_start}, {2 + v_start, 3 + uv_start, 4 + n_start}}, tex_id},
+	    // right
+	    {{{1 + v_start, 0 + uv_start, 5 + n_start}, {5 + v_start, 1 + uv_start, 5 + n_start}, {3 + v_start, 2 + uv_start, 5 + n_start}}, tex_id},
+	    {{{3 + v_start, 2 + uv_start, 5 + n_start}, {5 + v_start, 1 + uv_start, 5 + n_start}, {7 + v_start, 3 + uv_start, 5 + n_start}}, tex_id},
+	    // top
+	    {{{4 + v_start, 0 + uv_start, 3 + n_start}, {5 + v_start, 1 + uv_start, 3 + n_start}, {0 + v_start, 2 + uv_start, 3 + n_start}}, tex_id},
+	    {{{0 + v_start, 2 + uv_start, 3 + n_start}, {5 + v_start, 1 + uv_start, 3 + n_start}, {1 + v_start, 3 + uv_start, 3 + n_start}}, tex_id},
+	    // bot
+	    {{{2 + v_start, 0 + uv_start, 2 + n_start}, {3 + v_start, 1 + uv_start, 2 + n_start}, {6 + v_start, 2 + uv_start, 2 + n_start}}, tex_id},
+	    {{{6 + v_start, 2 + uv_start, 2 + n_start}, {3 + v_start, 1 + uv_start, 2 + n_start}, {7 + v_start, 3 + uv_start, 2 + n_start}}, tex_id},
+	};
+
+	IndexRange range;
+	range.start = this->faces.size();
+	range.count = face_count;
+
+	push_faces(faces, face_count);
+
+
+	size_t id = push_object(t, range);
+
+	return id;
+
+    }
+
+    size_t Renderer::push_object(Transform t, IndexRange range) {
+	assert(ranges.size() == objects.size());
+	assert(transforms.size() == objects.size());
+	assert(vertex_ranges.size() == objects.size());
+
+	size_t id = objects.size();
+
+	objects.push_back({id});
+	hierarchy_changed = true;
+	transforms.push_back(t);
+	// model_dirty, filled in by update_models
+	models.emplace_back();
+	local_models.emplace_back();
+	ranges.push_back(range);
+	vertex_ranges.push_back(get_vertex_range(range));
+	normal_ranges.push_back(get_normal_range(range));
+	meshlet_ranges.push_back(build_meshlets(range));
+	bounds.push_back(get_bounds(vertex_ranges.back()));
+
+	return id;
+    }
+
+    Bounds Renderer::get_bounds(IndexRange v_range) {
+	if (v_range.count == 0) return {};
+
+	gmath::Vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+	gmath::Vec3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (size_t vi = v_range.start; vi < v_range.start + v_range.count; ++vi) {
+	    const gmath::Vec4& v = vertices_world[vi];
+	    min = {std::min(min.x, v.x), std::min(min.y, v.y), std::min(min.z, v.z)};
+	    max = {std::max(max.x, v.x), std::max(max.y, v.y), std::max(max.z, v.z)};
+	}
+
+	Bounds b;
+	b.center = {(min.x + max.x) / 2.f, (min.y + max.y) / 2.f, (min.z + max.z) / 2.f};
+	b.extents = {(max.x - min.x) / 2.f, (max.y - min.y) / 2.f, (max.z - min.z) / 2.f};
+	for (size_t vi = v_range.start; vi < v_range.start + v_range.count; ++vi) {
+	    const gmath::Vec4& v = vertices_world[vi];
+	    gmath::Vec3 d = {v.x - b.center.x, v.y - b.center.y, v.z - b.center.z};
+	    b.radius = std::max(b.radius, d.length());
+	}
+	return b;
+    }
+
+    IndexRange Renderer::get_vertex_range(IndexRange range) {
+	if (range.count == 0 || range.start + range.count > faces.size()) return {0};
+
+	size_t v_min = SIZE_MAX;
+	size_t v_max = 0;
+	for (size_t fi = range.start; fi < range.start + range.count; ++fi) {
+	    for (const IndexRecord& rec : faces[fi].vs) {
+		v_min = std::min(v_min, rec.v_index);
+		v_max = std::max(v_max, rec.v_index);
+	    }
+	}
+	return {v_min, v_max - v_min + 1};
+    }
+
+    IndexRange Renderer::get_normal_range(IndexRange range) {
+	if (range.count == 0 || range.start + range.count > faces.size()) return {0};
+
+	size_t n_min = SIZE_MAX;
+	size_t n_max = 0;
+	for (size_t fi = range.start; fi < range.start + range.count; ++fi) {
+	    for (const IndexRecord& rec : faces[fi].vs) {
+		n_min = std::min(n_min, rec.n_index);
+		n_max = std::max(n_max, rec.n_index);
+	    }
+	}
+	if (n_max >= normals.size()) return {0};
+	return {n_min, n_max - n_min + 1};
+    }
+
+    IndexRange Renderer::build_meshlets(IndexRange range) {
+	using namespace gmath;
+	IndexRange result = {meshlets.size(), 0};
+	if (range.count == 0 || range.start + range.count > faces.size()) return result;
+
+	assert(face_corners.size() >= (range.start + range.count) * 3);
+
+	// outward normals are -(a - b) x (c - a), the faces cull_faces keeps have a
+	// normal pointing towards the camera. degenerate faces get a zero normal
+	std::vector<Vec3> face_normals(range.count);
+	std::vector<Vec3> centers(range.count);
+	for (size_t i = 0; i < range.count; ++i) {
+	    const Face& face = faces[range.start + i];
+	    const Vec4& a = vertices_world[face.vs[0].v_index];
+	    const Vec4& b = vertices_world[face.vs[1].v_index];
+	    const Vec4& c = vertices_world[face.vs[2].v_index];
+	    centers[i] = {(a.x + b.x + c.x) / 3.f, (a.y + b.y + c.y) / 3.f, (a.z + b.z + c.z) / 3.f};
+	    Vec3 n = Vec3::cross(Vec3(a.x, a.y, a.z) - Vec3(b.x, b.y, b.z), Vec3(c.x, c.y, c.z) - Vec3(a.x, a.y, a.z));
+	    float length = n.length();
+	    face_normals[i] = length > 0.f ? Vec3(-n.x / length, -n.y / length, -n.z / length) : Vec3(0, 0, 0);
+	}
+
+	// faces sharing a position are neighbors, equal positions are welded since uv
+	// seams store them twice
+	std::vector<std::vector<uint32_t>> vertex_faces;
+	std::vector<std::array<uint32_t, 3>> face_vertices(range.count);
+	{
+	    std::map<std::array<float, 3>, uint32_t> welded;
+	    for (size_t i = 0; i < range.count; ++i) {
+		for (int corner = 0; corner < 3; ++corner) {
+		    const Vec4& v = vertices_world[faces[range.start + i].vs[corner].v_index];
+		    auto [it, added] = welded.insert({{v.x, v.y, v.z}, (uint32_t)vertex_faces.size()});
+		    if (added) vertex_faces.emplace_back();
+		    vertex_faces[it->second].push_back((uint32_t)i);
+		    face_vertices[i][corner] = it->second;
+		}
+	    }
+	}
+
+	// greedy growth over the neighbors: start at the first free face, then keep adding the
+	// neighbor whose normal is closest to the meshlet's average normal, with the distance
+	// to the seed as penalty so the meshlet stays round. a neighbor further than
+	// meshlet_max_cone_angle from the average is never taken, the meshlet ends early instead
+	const float min_cos = std::cos(meshlet_max_cone_angle);
+	std::vector<uint8_t> taken(range.count, 0);
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> sizes;
+	order.reserve(range.count);
+	std::vector<uint32_t> candidates;
+	size_t seed = 0;
+	while (order.size() < range.count) {
+	    while (taken[seed]) ++seed;
+	    size_t first = order.size();
+	    Vec3 sum = {0, 0, 0};
+	    // the seed and its ring of neighbors set the scale of the distance penalty
+	    float scale = 0.f;
+	    candidates.clear();
+	    uint32_t next = (uint32_t)seed;
+	    while (true) {
+		taken[next] = 1;
+		order.push_back(next);
+		sum = {sum.x + face_normals[next].x, sum.y + face_normals[next].y, sum.z + face_normals[next].z};
+		if (order.size() - first == meshlet_max_faces) break;
+		for (uint32_t vertex : face_vertices[next]) {
+		    for (uint32_t neighbor : vertex_faces[vertex]) {
+			if (taken[neighbor]) continue;
+			candidates.push_back(neighbor);
+			Vec3 d = centers[neighbor] - centers[seed];
+			if (order.size() - first == 1) scale = std::max(scale, d.length());
+		    }
+		}
+
+		float sum_length = sum.length();
+		Vec3 axis = sum_length > 0.f ? Vec3(sum.x / sum_length, sum.y / sum_length, sum.z / sum_length) : Vec3(0, 0, 0);
+		float best_score = -FLT_MAX;
+		size_t best = SIZE_MAX;
+		for (size_t ci = 0; ci < candidates.size(); ++ci) {
+		    uint32_t face = candidates[ci];
+		    if (taken[face]) {
+			candidates[ci--] = candidates.back();
+			candidates.pop_back();
+			continue;
+		    }
+		    const Vec3& n = face_normals[face];
+		    bool degenerate = n.x == 0.f && n.y == 0.f && n.z == 0.f;
+		    float alignment = degenerate || sum_length == 0.f ? 1.f : gmath::dot(n, axis);
+		    if (alignment < min_cos) continue;
+		    Vec3 d = centers[face] - centers[seed];
+		    float score = alignment - d.length() / std::max(scale * meshlet_spread, FLT_MIN);
+		    if (score > best_score) {
+			best_score = score;
+			best = ci;
+		    }
+		}
+		if (best == SIZE_MAX) break;
+		next = candidates[best];
+	    }
+	    sizes.push_back((uint32_t)(order.size() - first));
+	}
+
+	// the meshlets become consecutive runs of faces
+	std::vector<Face> sorted(range.count);
+	for (size_t i = 0; i < range.count; ++i) {
+	    sorted[i] = faces[range.start + order[i]];
+	}
+	for (size_t i = 0; i < range.count; ++i) {
+	    faces[range.start + i] = sorted[i];
+	    for (int corner = 0; corner < 3; ++corner) {
+		face_corners[(range.start + i) * 3 + corner] = (uint32_t)sorted[i].vs[corner].v_index;
+	    }
+	}
+
+	size_t start = range.start;
+	for (uint32_t size : sizes) {
+	    Meshlet meshlet;
+	    meshlet.face_start = (uint32_t)start;
+	    meshlet.face_count = size;
+	    start += size;
+	    assert(start <= end);
+
+	    // sphere around the center of the bounding box of the corners
+	    Vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+	    Vec3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	    for (size_t fi = meshlet.face_start; fi < meshlet.face_start + meshlet.face_count; ++fi) {
+		for (const IndexRecord& rec : faces[fi].vs) {
+		    const Vec4& v = vertices_world[rec.v_index];
+		    min = {std::min(min.x, v.x), std::min(min.y, v.y), std::min(min.z, v.z)};
+		    max = {std::max(max.x, v.x), std::max(max.y, v.y), std::max(max.z, v.z)};
+		}
+	    }
+	    Bounds& b = meshlet.bounds;
+	    b.center = {(min.x + max.x) / 2.f, (min.y + max.y) / 2.f, (min.z + max.z) / 2.f};
+	    b.extents = {(max.x - min.x) / 2.f, (max.y - min.y) / 2.f, (max.z - min.z) / 2.f};
+
+	    Vec3 sum = {0, 0, 0};
+	    int normal_count = 0;
+	    for (size_t fi = meshlet.face_start; fi < meshlet.face_start + meshlet.face_count; ++fi) {
+		for (const IndexRecord& rec : faces[fi].vs) {
+		    const Vec4& v = vertices_world[rec.v_index];
+		    Vec3 d = {v.x - b.center.x, v.y - b.center.y, v.z - b.center.z};
+		    b.radius = std::max(b.radius, d.length());
+		}
+		// degenerate faces never cover a pixel, they don't constrain the cone
+		const Vec3& n = face_normals[order[fi - range.start]];
+		if (n.x == 0.f && n.y == 0.f && n.z == 0.f) continue;
+		sum = {sum.x + n.x, sum.y + n.y, sum.z + n.z};
+		normal_count++;
+	    }
+
+	    float sum_length = sum.length();
+	    if (normal_count > 0 && sum_length > 1e-6f) {
+		meshlet.cone_axis = {sum.x / sum_length, sum.y / sum_length, sum.z / sum_length};
+		float min_dot = 1.f;
+		for (size_t fi = meshlet.face_start; fi < meshlet.face_start + meshlet.face_count; ++fi) {
+		    const Vec3& n = face_normals[order[fi - range.start]];
+		    if (n.x == 0.f && n.y == 0.f && n.z == 0.f) continue;
+		    min_dot = std::min(min_dot, gmath::dot(n, meshlet.cone_axis));
+		}
+		meshlet.cone_cos = min_dot;
+		meshlet.cone_sin = std::sqrt(std::max(0.f, 1.f - min_dot * min_dot));
+	    }
+	    meshlets.push_back(meshlet);
+	}
+	result.count = meshlets.size() - result.start;
+	return result;
+    }
+
+    size_t Renderer::push_instance(size_t mesh_id, Transform t, int tex_id) {
+	assert(mesh_id < objects.size());
+	assert(mesh_id != camera.id);
+
+	size_t id = instances.size();
+	instances.push_back({mesh_id, t, tex_id});
+	return id;
+    }
+
+    void Renderer::instance_set_transform(size_t instance_id, const Transform& t) {
+	assert(instance_id < instances.size());
+	Instance& instance = instances[instance_id];
+	if (std::memcmp(&instance.transform, &t, sizeof(Transform)) == 0) return;
+	instance.transform = t;
+	instance.model_dirty = true;
+    }
+
+    size_t Renderer::push_lod_group(const size_t* mesh_ids, const float* min_sizes, size_t count, Transform t, int tex_id) {
+	assert(mesh_ids && count > 0);
+	assert(count == 1 || min_sizes);
+
+	LodGroup group;
+	for (size_t i = 0; i < count; ++i) {
+	    group.meshes.push_back(mesh_ids[i]);
+	    obj_set_visible(mesh_ids[i], false);
+	    if (i + 1 < count) group.min_sizes.push_back(min_sizes[i]);
+	}
+	group.instance_id = push_instance(mesh_ids[0], t, tex_id);
+
+	size_t id = lod_groups.size();
+	lod_groups.push_back(group);
+	return id;
+    }
+
+    Mesh Renderer::get_mesh(size_t obj_id) {
+	assert(obj_id < objects.size());
+	const IndexRange& range = ranges[obj_id];
+	const IndexRange& v_range = vertex_ranges[obj_id];
+
+	Mesh mesh;
+	if (range.count == 0) return mesh;
+
+	size_t uv_min = SIZE_MAX, uv_max = 0;
+	size_t n_min = SIZE_MAX, n_max = 0;
+	for (size_t fi = range.start; fi < range.start + range.count; ++fi) {
+	    for (const IndexRecord& rec : faces[fi].vs) {
+		uv_min = std::min(uv_min, rec.uv_index);
+		uv_max = std::max(uv_max, rec.uv_index);
+		n_min = std::min(n_min, rec.n_index);
+		n_max = std::max(n_max, rec.n_index);
+	    }
+	}
+
+	mesh.vertices.assign(vertices_world.begin() + v_range.start, vertices_world.begin() + v_range.start + v_range.count);
+	mesh.uvs.assign(uvs.begin() + uv_min, uvs.begin() + uv_max + 1);
+	mesh.normals.assign(normals.begin() + n_min, normals.begin() + n_max + 1);
+	mesh.faces.assign(faces.begin() + range.start, faces.begin() + range.start + range.count);
+	for (Face& face : mesh.faces) {
+	    for (IndexRecord& rec : face.vs) {
+		rec.v_index -= v_range.start;
+		rec.uv_index -= uv_min;
+		rec.n_index -= n_min;
+	    }
+	}
+	return mesh;
+    }
+
+    size_t Renderer::push_mesh(const Mesh& mesh, Transform t) {
+	size_t v_start = vertices_world.size();
+	size_t uv_start = uvs.size();
+	size_t n_start = normals.size();
+
+	IndexRange range;
+	range.start = faces.size();
+	range.count = mesh.faces.size();
+
+	if (!mesh.vertices.empty()) push_vertices(mesh.vertices.data(), mesh.vertices.size());
+	if (!mesh.uvs.empty()) push_uvs(mesh.uvs.data(), mesh.uvs.size());
+	if (!mesh.normals.empty()) push_normals(mesh.normals.data(), mesh.normals.size());
+	for (Face face : mesh.faces) {
+	    for (IndexRecord& rec : face.vs) {
+		rec.v_index += v_start;
+		rec.uv_index += uv_start;
+		rec.n_index += n_start;
+	    }
+	    push_faces(&face, 1);
+	}
+
+	return push_object(t, range);
+    }
+
+    size_t Renderer::build_lod_group(size_t obj_id, const size_t* face_counts, const float* min_sizes, size_t count, Transform t, int tex_id) {
+	assert(face_counts && min_sizes);
+
+	Mesh mesh = get_mesh(obj_id);
+	std::vector<std::future<Mesh>> jobs;
+	for (size_t i = 0; i < count; ++i) {
+	    jobs.push_back(simplify_mesh_async(mesh, face_counts[i]));
+	}
+
+	std::vector<size_t> mesh_ids = {obj_id};
+	for (size_t i = 0; i < count; ++i) {
+	    Mesh simplified = jobs[i].get();
+	    if (log_level <= LOG_DEBUG) std::println("simplify_mesh: faces {} -> {}, target = {}", mesh.faces.size(), simplified.faces.size(), face_counts[i]);
+	    mesh_ids.push_back(push_mesh(simplified));
+	}
+	return push_lod_group(mesh_ids.data(), min_sizes, mesh_ids.size(), t, tex_id);
+    }
+
+    void Renderer::lod_group_set_transform(size_t group_id, const Transform& t) {
+	assert(group_id < lod_groups.size());
+	instance_set_transform(lod_groups[group_id].instance_id, t);
+    }
+
+    float Renderer::projected_size(size_t obj_id, const Affine& model) {
+	using namespace gmath;
+	assert(obj_id < bounds.size());
+
+	const Bounds& b = bounds[obj_id];
+	Vec3 center = model.point(b.center);
+
+	const Vec3& cam_pos = transforms[camera.id].position;
+	Vec3 to_center = {center.x - cam_pos.x, center.y - cam_pos.y, center.z - cam_pos.z};
+	float dist = to_center.length();
+	if (dist <= b.radius) return FLT_MAX;
+
+	return b.radius * tex.height / (std::tan(fov / 2.f) * dist);
+    }
+
+    void Renderer::select_lods() {
+	for (LodGroup& group : lod_groups) {
+	    Instance& instance = instances[group.instance_id];
+	    float size = projected_size(group.meshes[0], instance.model);
+
+	    while (group.level + 1 < group.meshes.size() &&
+		   size < group.min_sizes[group.level] * (1.f - lod_hysteresis)) {
+		group.level++;
+	    }
+	    while (group.level > 0 &&
+		   size > group.min_sizes[group.level - 1] * (1.f + lod_hysteresis)) {
+		group.level--;
+	    }
+	    instance.mesh_id = group.meshes[group.level];
+	}
+    }
+
+    void Renderer::obj_set_visible(size_t obj_id, bool visible) {
+	assert(obj_id < objects.size());
+	objects[obj_id].visible = visible;
+    }
+
+    void Renderer::obj_set_occluder(size_t obj_id, bool occluder) {
+	assert(obj_id < objects.size());
+	objects[obj_id].occluder = occluder;
+    }
+
+    void Renderer::push_vertices(const gmath::Vec4* verts, size_t count) {
+	assert(verts);
+	for (int i = 0; i < count; ++i) {
+	    vertices_world.push_back(verts[i]);
+	}
+    }
+
+    void Renderer::push_uvs(const UV* uvs, size_t count) {
+	assert(uvs);
+	for (int i = 0; i < count; ++i) {
+	    this->uvs.push_back(uvs[i]);
+	}
+    }
+
+    void Renderer::push_normals(const gmath::Vec3* normals, size_t count) {
+	assert(normals);
+	for (int i = 0; i < count; ++i) {
+	    this->normals.push_back(normals[i]);
+	}
+    }
+
+    void Renderer::push_faces(const Face* faces, size_t count) {
+	assert(faces);
+	for (int i = 0; i < count; ++i) {
+	    this->faces.push_back(faces[i]);
+	    for (const IndexRecord& rec : faces[i].vs) {
+		assert(rec.v_index <= UINT32_MAX / 4);
+		face_corners.push_back((uint32_t)rec.v_index);
+	    }
+	}
+    }
+
+    void Renderer::obj_set_transform(size_t obj_id, const Transform& t) {
+	assert(obj_id < objects.size());
+	assert(obj_id < transforms.size());
+	assert(objects.size() == transforms.size());
+
+	if (std::memcmp(&transforms[obj_id], &t, sizeof(Transform)) == 0) return;
+	transforms[obj_id] = t; 
+	objects[obj_id].model_dirty = true;
+    }
+
+    void Renderer::obj_set_parent(size_t obj_id, size_t parent_id) {
+	assert(obj_id < objects.size() && obj_id != camera.id);
+	assert(parent_id == no_parent || (parent_id < objects.size() && parent_id != camera.id));
+	// no cycles: obj_id can't be above its new parent
+	for (size_t p = parent_id; p != no_parent; p = objects[p].parent) {
+	    assert(p != obj_id);
+	    if (p == obj_id) return;
+	}
+	if (objects[obj_id].parent == parent_id) return;
+	objects[obj_id].parent = parent_id;
+	objects[obj_id].model_dirty = true;
+	hierarchy_changed = true;
+    }
+
+    void Renderer::obj_set_skin(size_t obj_id, const Bone_Weights* weights, size_t bone_count, const Bone_Weights* normal_weights) {
+	using namespace gmath;
+	assert(obj_id < objects.size() && obj_id != camera.id);
+	assert(weights && bone_count > 0 && bone_count <= (size_t)UINT16_MAX + 1);
+
+	const IndexRange& range = vertex_ranges[obj_id];
+	const IndexRange& n_range = normal_ranges[obj_id];
+	Object& object = objects[obj_id];
+	if (object.skin == no_skin) {
+	    object.skin = skins.size();
+	    skins.push_back({obj_id});
+	    // vertices_world and normals only hold the bind pose until the first skin_vertices
+	    Skin& skin = skins.back();
+	    skin.bind_vertices.assign(vertices_world.begin() + range.start, vertices_world.begin() + range.start + range.count);
+	    for (size_t ni = n_range.start; ni < n_range.start + n_range.count; ++ni) {
+		skin.bind_normals.push_back({normals[ni].x, normals[ni].y, normals[ni].z, 0.f});
+	    }
+	    skin.skinned_normals.resize(n_range.count);
+	}
+	Skin& skin = skins[object.skin];
+	assert(skin.bind_vertices.size() == range.count);
+	assert(skin.bind_normals.size() == n_range.count);
+
+	// kernel layout with the weights normalized, a vertex without weights follows the first bone
+	auto store = [bone_count](const Bone_Weights& w, uint16_t* bones, float* out) {
+	    float sum = 0.f;
+	    for (int k = 0; k < 4; ++k) sum += std::max(w.weights[k], 0.f);
+	    for (int k = 0; k < 4; ++k) {
+		assert(w.bones[k] < bone_count);
+		bones[k] = w.bones[k] < bone_count ? w.bones[k] : 0;
+		out[k] = sum > 0.f ? std::max(w.weights[k], 0.f) / sum : 0.f;
+	    }
+	    if (sum <= 0.f) out[0] = 1.f;
+	};
+
+	skin.bones.resize(range.count * 4);
+	skin.weights.resize(range.count * 4);
+	for (size_t vi = 0; vi < range.count; ++vi) {
+	    store(weights[vi], &skin.bones[vi * 4], &skin.weights[vi * 4]);
+	}
+
+	skin.normal_bones.assign(n_range.count * 4, 0);
+	skin.normal_weights.assign(n_range.count * 4, 0.f);
+	std::vector<uint8_t> stored(n_range.count, 0);
+	const IndexRange& f_range = ranges[obj_id];
+	for (size_t fi = f_range.start; fi < f_range.start + f_range.count && n_range.count; ++fi) {
+	    for (const IndexRecord& rec : faces[fi].vs) {
+		if (rec.n_index < n_range.start || rec.n_index >= n_range.start + n_range.count) continue;
+		size_t ni = rec.n_index - n_range.start;
+		if (stored[ni]) continue;
+		stored[ni] = 1;
+		const Bone_Weights& w = normal_weights ? normal_weights[ni] : weights[rec.v_index - range.start];
+		store(w, &skin.normal_bones[ni * 4], &skin.normal_weights[ni * 4]);
+	    }
+	}
+	// normals no face uses
+	for (size_t ni = 0; ni < n_range.count; ++ni) {
+	    if (!stored[ni]) store(normal_weights ? normal_weights[ni] : Bone_Weights{}, &skin.normal_bones[ni * 4], &skin.normal_weights[ni * 4]);
+	}
+
+	skin.palette.resize(bone_count * 16);
+	for (size_t bone = 0; bone < bone_count; ++bone) {
+	    Affine().get_columns(&skin.palette[bone * 16]);
+	}
+	skin.dirty = true;
+    }
+
+    void Renderer::obj_set_bones(size_t obj_id, const Affine* bones, size_t count) {
+	assert(obj_id < objects.size() && objects[obj_id].skin != no_skin);
+	assert(bones);
+	Skin& skin = skins[objects[obj_id].skin];
+	assert(count * 16 == skin.palette.size());
+	if (count * 16 != skin.palette.size()) return;
+
+	float cols[16];
+	for (size_t bone = 0; bone < count; ++bone) {
+	    bones[bone].get_columns(cols);
+	    float* slot = &skin.palette[bone * 16];
+	    if (std::memcmp(slot, cols, sizeof(cols)) == 0) continue;
+	    std::memcpy(slot, cols, sizeof(cols));
+	    skin.dirty = true;
+	}
+    }
+
+#ifndef D3_HEADLESS
+    void Renderer::init_texture() {
+	assert(tex.pixels && tex.width && tex.height);
+
+	glGenTextures(1, &gl_tex);
+	glBindTexture(GL_TEXTURE_2D, gl_tex);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glTexImage2D(GL_TEXTURE_2D, 0,
+		     GL_RGBA8, tex.width, tex.height, 0,
+		     GL_RGBA, GL_UNSIGNED_BYTE,
+		     tex.pixels);
+    }
+
+    void Renderer::init_gl(HDC hdc) {
+
+	PIXELFORMATDESCRIPTOR pfd = {};
+	pfd.nSize = sizeof(pfd);
+	pfd.nVersion = 1;
+	pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
+	pfd.iPixelType = PFD_TYPE_RGBA;
+	pfd.cColorBits = 32;
+
+	int pf = ChoosePixelFormat(hdc, &pfd);
+	SetPixelFormat(hdc, pf, &pfd);
+
+	gl_ctx = wglCreateContext(hdc);
+
+	wglMakeCurrent(hdc, gl_ctx);
+
+	if(!gladLoadGL()) {
+	    std::println("{}", glGetError());	
+	}
+
+	glEnable(GL_TEXTURE_2D);
+
+	glViewport(0, 0, tex.width, tex.height); 
+
+	program = create_program(vertex_shader, fragment_shader);
+	glUseProgram(program);
+
+	GLint loc = glGetUniformLocation(program, "screenTex");
+	glUniform1i(loc, 0); // Texture Unit 0
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	init_texture();
+
+	// vsync an;
+	wglSwapIntervalEXT = (wglSwapIntervalEXT_t)wglGetProcAddress("wglSwapIntervalEXT");
+	if (wglSwapIntervalEXT) wglSwapIntervalEXT(1);
+    }
+#endif // D3_HEADLESS
+
+    void Renderer::init_framebuffer(int width, int height) {
+	assert(tex.pixels == nullptr);
+	tex.from_color(width, height, BLACK.to_int());
+	init_z();
+    }
+
+    void Renderer::init_z() {
+	assert(tex.pixels);
+	z_buffer.clear();
+	z_buffer.reserve(tex.width * tex.height);
+	z_buffer.resize(tex.width * tex.height);
+	kernels->fill_f32(z_buffer.data(), z_buffer.size(), far_clip * 2.f);
+    }
+
+    void Renderer::reset_z() {
+	if (!incremental) {
+	    kernels->fill_f32(z_buffer.data(), z_buffer.size(), far_clip * 2.f);
+	    return;
+	}
+	for (const RectangleI& rect : draw_rects) {
+	    for (int y = rect.y; y < rect.y + rect.height; ++y) {
+		kernels->fill_f32(z_buffer.data() + rect.x + (size_t)y * tex.width, rect.width, far_clip * 2.f);
+	    }
+	}
+    }
+
+#ifndef D3_HEADLESS
+    void Renderer::draw_tex(HDC hdc) {
+	draw_tex(hdc, tex.pixels);
+    }
+
+    void Renderer::draw_tex(HDC hdc, const uint32_t* pixels, const std::vector<RectangleI>& dirty) {
+	glClearColor(0,0,0,1);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, gl_tex);
+
+	// with an unpack buffer bound the source is an offset into it, the copy happens on the gpu
+	auto pbo = std::find(pbo_pixels.begin(), pbo_pixels.end(), pixels);
+	const uint32_t* source = pixels;
+	if (pbo != pbo_pixels.end()) {
+	    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[pbo - pbo_pixels.begin()]);
+	    source = nullptr;
+	}
+
+	if (dirty.empty()) {
+	    glTexSubImage2D(GL_TEXTURE_2D, 0, 0,0, tex.width, tex.height,
+			    GL_RGBA, GL_UNSIGNED_BYTE, source);
+	}
+	else {
+	    // the texture still has the last frame, only the regions that changed since go up
+	    glPixelStorei(GL_UNPACK_ROW_LENGTH, tex.width);
+	    for (const RectangleI& rect : dirty) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height,
+				GL_RGBA, GL_UNSIGNED_BYTE, source + rect.x + (size_t)rect.y * tex.width);
+	    }
+	    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	}
+	if (pbo != pbo_pixels.end()) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	if (pbo != pbo_pixels.end()) {
+	    // the buffer goes back to the rasterizer after this, so the gpu has to be done reading it
+	    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	    SwapBuffers(hdc);
+	    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+	    glDeleteSync(fence);
+	    return;
+	}
+
+	SwapBuffers(hdc);
+    }
+
+    bool Renderer::init_pbos(int count) {
+	assert(pbos.empty());
+	if (!glBufferStorage) glBufferStorage = (glBufferStorage_t)wglGetProcAddress("glBufferStorage");
+	if (!glBufferStorage) return false;
+
+	GLsizeiptr size = (GLsizeiptr)tex.width * tex.height * sizeof(uint32_t);
+	// coherent: writes of the rasterizer are seen by the gpu without flushing
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	pbos.resize(count);
+	glGenBuffers(count, pbos.data());
+	for (GLuint pbo : pbos) {
+	    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+	    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+	    if (!mapped) break;
+	    pbo_pixels.push_back((uint32_t*)mapped);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (pbo_pixels.size() != pbos.size()) {
+	    if (log_level <= LOG_ERROR) std::println("ERROR: could not map pixel buffer objects, uploading from client memory");
+	    glDeleteBuffers(count, pbos.data());
+	    pbos.clear();
+	    pbo_pixels.clear();
+	    return false;
+	}
+	return true;
+    }
+
+    void Renderer::release_pbos() {
+	for (GLuint pbo : pbos) {
+	    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!pbos.empty()) glDeleteBuffers((GLsizei)pbos.size(), pbos.data());
+	pbos.clear();
+	pbo_pixels.clear();
+    }
+#endif // D3_HEADLESS
+
+    void Renderer::transform_vertices() {
+	using namespace gmath;
+	if (vertices_viewport.capacity() < vertices_world.size()) {
+	    if (log_level <= LOG_DEBUG) std::println("viewport verts reserve, old size = {}, new size = {}", vertices_viewport.size(), vertices_world.size());
+	    vertices_viewport.reserve(vertices_world.size());
+	}
+	assert(vertices_viewport.capacity() >= vertices_world.size());
+
+	if (vertices_viewport.size() < vertices_world.size())   vertices_viewport.resize(vertices_world.size());
+	assert(vertices_viewport.size() >= vertices_world.size());
+
+	if (shading != SHADING_NONE) {
+	    if (vertices_lit.size() < vertices_world.size()) vertices_lit.resize(vertices_world.size());
+	    if (normals_lit.size() < normals.size()) normals_lit.resize(normals.size());
+	    update_lights();
+	}
+
+	D3_PROFILE_ZONE(profiler, STAGE_TRANSFORM);
+
+	// bounds have to fit the pose before the lods, occlusion and dirty rects look at them
+	skin_vertices();
+	update_models();
+	projection = Mat4::projection((float)tex.width / tex.height, fov, near_clip, far_clip);
+	view.get_columns(projection, view_projection);
+
+	occlusion.empty = true;
+	if (occlusion_culling) build_occlusion();
+
+	if (incremental) {
+	    // the instances have to be on the lod they get drawn with
+	    select_lods();
+	    update_dirty();
+	}
+	else {
+	    dirty_history.clear();
+	    dirty_rects = draw_rects = {{0, 0, tex.width, tex.height}};
+	}
+
+	// skip cam_id = 0;
+	for (size_t obj_id = camera.id + 1; obj_id < objects.size(); ++obj_id) {
+	    Object& object = objects[obj_id];
+	    if (!object.visible) continue;
+	    object.occluded = !object.occluder && object_occluded(obj_id, models[obj_id]);
+	    // occluders were transformed by build_occlusion
+	    if (object.occluded || (object.occluder && occlusion_culling)) continue;
+	    transform_object(obj_id, models[obj_id]);
+	}
+    }
+
+    void Renderer::skin_vertices() {
+	using namespace gmath;
+	struct Skin_Job {
+	    Skin* skin;
+	    size_t begin;
+	    size_t count;
+	    bool normals;
+	};
+	std::vector<Skin_Job> jobs;
+	size_t chunk = std::max(skin_chunk, (size_t)1);
+	for (Skin& skin : skins) {
+	    skin.posed = skin.dirty;
+	    if (!skin.dirty) continue;
+	    for (bool n : {false, true}) {
+		size_t count = n ? skin.bind_normals.size() : skin.bind_vertices.size();
+		for (size_t begin = 0; begin < count; begin += chunk) {
+		    jobs.push_back({&skin, begin, std::min(chunk, count - begin), n});
+		}
+	    }
+	}
+	if (jobs.empty()) return;
+
+	// the ranges don't overlap and only the workers touch vertices_world and normals meanwhile
+	std::function<void(size_t, size_t)> run = [this, &jobs](size_t worker, size_t workers) {
+	    for (size_t j = worker; j < jobs.size(); j += workers) {
+		const Skin_Job& job = jobs[j];
+		Skin& skin = *job.skin;
+		if (!job.normals) {
+		    size_t vi = vertex_ranges[skin.obj_id].start + job.begin;
+		    kernels->skin_vec4(&skin.bind_vertices[job.begin].x, &skin.bones[job.begin * 4], &skin.weights[job.begin * 4],
+				       skin.palette.data(), &vertices_world[vi].x, job.count);
+		    continue;
+		}
+		// the blend of rotations isn't one, so the normals need normalizing again
+		Vec4* out = skin.skinned_normals.data() + job.begin;
+		kernels->skin_vec4(&skin.bind_normals[job.begin].x, &skin.normal_bones[job.begin * 4], &skin.normal_weights[job.begin * 4],
+				   skin.palette.data(), &out->x, job.count);
+		size_t ni = normal_ranges[skin.obj_id].start + job.begin;
+		for (size_t i = 0; i < job.count; ++i) {
+		    Vec3 n = {out[i].x, out[i].y, out[i].z};
+		    if (n.length() > 0.f) n.normalize();
+		    normals[ni + i] = n;
+		}
+	    }
+	};
+	if (jobs.size() == 1) {
+	    run(0, 1);
+	}
+	else {
+	    size_t threads = skin_threads > 0 ? (size_t)skin_threads : std::max(std::thread::hardware_concurrency(), 1u);
+	    threads = std::min(threads, jobs.size());
+	    if (skin_pool.workers != threads) {
+		skin_pool.stop();
+		skin_pool.start(threads);
+	    }
+	    skin_pool.run(run);
+	}
+
+	for (Skin& skin : skins) {
+	    if (!skin.posed) continue;
+	    bounds[skin.obj_id] = get_bounds(vertex_ranges[skin.obj_id]);
+	    skin.dirty = false;
+	}
+    }
+
+    void Renderer::update_models() {
+	Object& cam = objects[camera.id];
+	if (cam.model_dirty) {
+	    view = transforms[camera.id].get_view();
+	    models[camera.id] = transforms[camera.id].get_model();
+	    cam.model_dirty = false;
+	}
+
+	if (hierarchy_changed) sort_hierarchy();
+	// parents come first, so a parent's model is final before its children look at it
+	model_updated.assign(objects.size(), 0);
+	for (size_t obj_id : hierarchy_order) {
+	    Object& object = objects[obj_id];
+	    bool parent_updated = object.parent != no_parent && model_updated[object.parent];
+	    if (!object.model_dirty && !parent_updated) continue;
+	    if (object.model_dirty) local_models[obj_id] = transforms[obj_id].get_model();
+	    models[obj_id] = object.parent == no_parent ? local_models[obj_id] : models[object.parent] * local_models[obj_id];
+	    object.model_dirty = false;
+	    model_updated[obj_id] = 1;
+	}
+	for (Instance& instance : instances) {
+	    if (!instance.model_dirty) continue;
+	    instance.model = instance.transform.get_model();
+	    instance.model_dirty = false;
+	}
+    }
+
+    void Renderer::sort_hierarchy() {
+	// depth first by walking up, the ids in between get theirs on the way back
+	std::vector<size_t> depths(objects.size(), SIZE_MAX);
+	std::vector<size_t> chain;
+	for (size_t obj_id = camera.id + 1; obj_id < objects.size(); ++obj_id) {
+	    size_t p = obj_id;
+	    while (p != no_parent && depths[p] == SIZE_MAX) {
+		chain.push_back(p);
+		p = objects[p].parent;
+	    }
+	    size_t depth = p == no_parent ? 0 : depths[p] + 1;
+	    for (auto it = chain.rbegin(); it != chain.rend(); ++it) depths[*it] = depth++;
+	    chain.clear();
+	}
+
+	hierarchy_order.clear();
+	for (size_t obj_id = camera.id + 1; obj_id < objects.size(); ++obj_id) hierarchy_order.push_back(obj_id);
+	// stable, so siblings keep their id order and stay close in memory
+	std::stable_sort(hierarchy_order.begin(), hierarchy_order.end(), [&](size_t a, size_t b) { return depths[a] < depths[b]; });
+	hierarchy_changed = false;
+    }
+
+    // cells of occlusion that the triangle covers completely get its farthest depth within
+    // the cell, if that is closer than what they have. a, b, c are viewport positions
+    static void rasterize_occluder(Occlusion_Buffer& occlusion, int width, int height, const gmath::Vec4& a, const gmath::Vec4& b, const gmath::Vec4& c) {
+	// the span rasterizer walks the edges from truncated corners, so a pixel within
+	// margin of an edge might not be drawn and its depth can be off by that much
+	constexpr float margin = 2.f;
+
+	const gmath::Vec4* corners[3] = {&a, &b, &c};
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (std::abs(area) < 1.f) return;
+	float sign = area > 0.f ? 1.f : -1.f;
+
+	// signed distance to edge i (from corner i to i + 1), positive inside, and 1 / z as
+	// a plane over the screen: the barycentric of the opposite corner is distance * length / area
+	float edge_x[3], edge_y[3], edge_0[3];
+	float z_reci_x = 0.f, z_reci_y = 0.f, z_reci_0 = 0.f;
+	for (int i = 0; i < 3; ++i) {
+	    const gmath::Vec4& p = *corners[i];
+	    const gmath::Vec4& q = *corners[(i + 1) % 3];
+	    const gmath::Vec4& opposite = *corners[(i + 2) % 3];
+	    float length = std::sqrt((q.x - p.x) * (q.x - p.x) + (q.y - p.y) * (q.y - p.y));
+	    if (length == 0.f) return;
+	    edge_x[i] = -sign * (q.y - p.y) / length;
+	    edge_y[i] = sign * (q.x - p.x) / length;
+	    edge_0[i] = -(edge_x[i] * p.x + edge_y[i] * p.y);
+	    float weight = length / (std::abs(area) * opposite.z);
+	    z_reci_x += edge_x[i] * weight;
+	    z_reci_y += edge_y[i] * weight;
+	    z_reci_0 += edge_0[i] * weight;
+	}
+
+	int cell = occlusion.cell_size;
+	int min_x = std::max(0, (int)std::floor(std::min({a.x, b.x, c.x}) / cell));
+	int max_x = std::min(occlusion.width - 1, (int)std::floor(std::max({a.x, b.x, c.x}) / cell));
+	int min_y = std::max(0, (int)std::floor(std::min({a.y, b.y, c.y}) / cell));
+	int max_y = std::min(occlusion.height - 1, (int)std::floor(std::max({a.y, b.y, c.y}) / cell));
+
+	for (int cy = min_y; cy <= max_y; ++cy) {
+	    // pixels outside the color target don't need to be covered
+	    float y0 = (float)(cy * cell) - margin;
+	    float y1 = (float)std::min((cy + 1) * cell, height) + margin;
+	    for (int cx = min_x; cx <= max_x; ++cx) {
+		float x0 = (float)(cx * cell) - margin;
+		float x1 = (float)std::min((cx + 1) * cell, width) + margin;
+
+		// distances and 1 / z are linear, so the corners of the cell decide for all of it
+		bool covered = true;
+		float z_reci_min = FLT_MAX;
+		for (float x : {x0, x1}) {
+		    for (float y : {y0, y1}) {
+			for (int i = 0; i < 3; ++i) {
+			    if (edge_x[i] * x + edge_y[i] * y + edge_0[i] < margin) covered = false;
+			}
+			z_reci_min = std::min(z_reci_min, z_reci_x * x + z_reci_y * y + z_reci_0);
+		    }
+		}
+		if (!covered || z_reci_min <= 0.f) continue;
+
+		float& z = occlusion.z[cx + cy * occlusion.width];
+		z = std::min(z, 1.f / z_reci_min);
+	    }
+	}
+    }
+
+    void Renderer::build_occlusion() {
+	int cell = occlusion.cell_size;
+	occlusion.width = (tex.width + cell - 1) / cell;
+	occlusion.height = (tex.height + cell - 1) / cell;
+	occlusion.empty = true;
+
+	for (size_t obj_id = camera.id + 1; obj_id < objects.size(); ++obj_id) {
+	    const Object& object = objects[obj_id];
+	    if (!object.visible || !object.occluder) continue;
+	    transform_object(obj_id, models[obj_id]);
+
+	    const IndexRange& range = ranges[obj_id];
+	    if (range.count == 0 || range.start + range.count > faces.size()) continue;
+	    if (occlusion.empty) {
+		occlusion.z.assign((size_t)occlusion.width * occlusion.height, FLT_MAX);
+		occlusion.empty = false;
+	    }
+
+	    // only faces that get drawn can hide anything
+	    Cull_Counts counts = {};
+	    visible_faces.resize(range.count);
+	    size_t visible = kernels->cull_faces(&vertices_viewport[0].x, face_corners.data() + range.start * 3, range.count, (uint32_t)range.start,
+						 near_clip, far_clip, visible_faces.data(), counts);
+	    for (size_t i = 0; i < visible; ++i) {
+		const uint32_t* corners = &face_corners[visible_faces[i] * 3];
+		rasterize_occluder(occlusion, tex.width, tex.height, vertices_viewport[corners[0]], vertices_viewport[corners[1]], vertices_viewport[corners[2]]);
+	    }
+	}
+	visible_faces.clear();
+    }
+
+    bool Renderer::project_bounds(size_t obj_id, const Affine& model, float rect[4], float& closest) const {
+	using namespace gmath;
+	assert(obj_id < bounds.size());
+
+	const Bounds& b = bounds[obj_id];
+	float mvp[16];
+	(view * model).get_columns(projection, mvp);
+
+	rect[0] = rect[1] = FLT_MAX;
+	rect[2] = rect[3] = -FLT_MAX;
+	closest = FLT_MAX;
+	for (int i = 0; i < 8; ++i) {
+	    Vec4 corner = {
+		b.center.x + (i & 1 ? b.extents.x : -b.extents.x),
+		b.center.y + (i & 2 ? b.extents.y : -b.extents.y),
+		b.center.z + (i & 4 ? b.extents.z : -b.extents.z),
+		1.f,
+	    };
+	    corner = {
+		mvp[0] * corner.x + mvp[4] * corner.y + mvp[8] * corner.z + mvp[12],
+		mvp[1] * corner.x + mvp[5] * corner.y + mvp[9] * corner.z + mvp[13],
+		mvp[2] * corner.x + mvp[6] * corner.y + mvp[10] * corner.z + mvp[14],
+		mvp[3] * corner.x + mvp[7] * corner.y + mvp[11] * corner.z + mvp[15],
+	    };
+	    // the projected rect would be wrong
+	    if (corner.z <= near_clip) return false;
+	    corner.perspective_divide_and_center(tex.width, tex.height);
+	    rect[0] = std::min(rect[0], corner.x);
+	    rect[1] = std::min(rect[1], corner.y);
+	    rect[2] = std::max(rect[2], corner.x);
+	    rect[3] = std::max(rect[3], corner.y);
+	    closest = std::min(closest, corner.z);
+	}
+	return true;
+    }
+
+    RectangleI Renderer::screen_rect(size_t obj_id, const Affine& model) const {
+	float rect[4];
+	float closest;
+	if (!project_bounds(obj_id, model, rect, closest)) return {0, 0, tex.width, tex.height};
+
+	// two pixels past the rect for the edge walking of the rasterizer
+	int x0 = std::max(0, (int)std::floor(rect[0] - 2.f));
+	int y0 = std::max(0, (int)std::floor(rect[1] - 2.f));
+	int x1 = std::min(tex.width, (int)std::ceil(rect[2] + 2.f) + 1);
+	int y1 = std::min(tex.height, (int)std::ceil(rect[3] + 2.f) + 1);
+	if (x0 >= x1 || y0 >= y1) return {0, 0, 0, 0};
+	return {x0, y0, x1 - x0, y1 - y0};
+    }
+
+    bool Renderer::object_occluded(size_t obj_id, const Affine& model) const {
+	if (occlusion.empty) return false;
+
+	float rect[4];
+	float closest;
+	if (!project_bounds(obj_id, model, rect, closest)) return false;
+
+	// a pixel past the rect for the edge walking of the rasterizer
+	int cell = occlusion.cell_size;
+	int cx0 = std::max(0, (int)std::floor((rect[0] - 2.f) / cell));
+	int cx1 = std::min(occlusion.width - 1, (int)std::floor((rect[2] + 2.f) / cell));
+	int cy0 = std::max(0, (int)std::floor((rect[1] - 2.f) / cell));
+	int cy1 = std::min(occlusion.height - 1, (int)std::floor((rect[3] + 2.f) / cell));
+	// off screen is up to the frustum tests
+	if (cx0 > cx1 || cy0 > cy1) return false;
+
+	for (int cy = cy0; cy <= cy1; ++cy) {
+	    for (int cx = cx0; cx <= cx1; ++cx) {
+		// small relative margin for the depth interpolation of the rasterizer
+		if (!(closest > occlusion.z[cx + cy * occlusion.width] * (1.f + 1e-3f))) return false;
+	    }
+	}
+	return true;
+    }
+
+    static bool rects_overlap(const RectangleI& a, const RectangleI& b) {
+	return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    static RectangleI rect_union(const RectangleI& a, const RectangleI& b) {
+	int x0 = std::min(a.x, b.x);
+	int y0 = std::min(a.y, b.y);
+	int x1 = std::max(a.x + a.width, b.x + b.width);
+	int y1 = std::max(a.y + a.height, b.y + b.height);
+	return {x0, y0, x1 - x0, y1 - y0};
+    }
+
+    // clips to width x height, drops empty rects and joins overlapping ones until none overlap,
+    // so no pixel gets drawn twice. past max_rects everything becomes one rect
+    static void merge_rects(std::vector<RectangleI>& rects, int width, int height) {
+	constexpr size_t max_rects = 8;
+	size_t count = 0;
+	for (RectangleI rect : rects) {
+	    int x0 = std::max(0, rect.x);
+	    int y0 = std::max(0, rect.y);
+	    int x1 = std::min(width, rect.x + rect.width);
+	    int y1 = std::min(height, rect.y + rect.height);
+	    if (x0 < x1 && y0 < y1) rects[count++] = {x0, y0, x1 - x0, y1 - y0};
+	}
+	rects.resize(count);
+
+	for (bool merged = true; merged;) {
+	    merged = false;
+	    for (size_t i = 0; i < rects.size() && !merged; ++i) {
+		for (size_t j = i + 1; j < rects.size(); ++j) {
+		    if (!rects_overlap(rects[i], rects[j])) continue;
+		    rects[i] = rect_union(rects[i], rects[j]);
+		    rects.erase(rects.begin() + j);
+		    merged = true;
+		    break;
+		}
+	    }
+	}
+
+	if (rects.size() > max_rects) {
+	    RectangleI all = rects[0];
+	    for (const RectangleI& rect : rects) all = rect_union(all, rect);
+	    rects = {all};
+	}
+    }
+
+    void Renderer::mark_dirty(RectangleI rect) {
+	marked_rects.push_back(rect);
+    }
+
+    void Renderer::update_dirty() {
+	RectangleI all = {0, 0, tex.width, tex.height};
+	std::vector<RectangleI> dirty;
+	dirty.swap(marked_rects);
+
+	// a different camera or projection moves everything
+	bool redraw = std::memcmp(view_projection, last_view_projection, sizeof(view_projection)) != 0;
+	std::memcpy(last_view_projection, view_projection, sizeof(view_projection));
+	redraw = redraw || (render_mode != RENDER_FORWARD && render_mode != RENDER_PREPASS);
+
+	// the old and the new rect of everything that moved, appeared or disappeared
+	// the model and not the transform: a child moves with its parent
+	auto track = [&](Draw_State& state, bool drawn, size_t mesh_id, const Affine& model, int tex_id) {
+	    Draw_State now = {drawn, mesh_id, model, tex_id};
+	    if (drawn) now.rect = screen_rect(mesh_id, model);
+	    size_t skin = objects[mesh_id].skin;
+	    bool posed = skin != no_skin && skins[skin].posed;
+	    bool changed = drawn != state.drawn ||
+		(drawn && (posed || mesh_id != state.mesh_id || tex_id != state.tex_id || std::memcmp(&model, &state.model, sizeof(Affine)) != 0));
+	    if (changed && !redraw) {
+		if (state.drawn) dirty.push_back(state.rect);
+		if (drawn) dirty.push_back(now.rect);
+	    }
+	    state = now;
+	};
+
+	object_states.resize(objects.size());
+	for (size_t obj_id = camera.id + 1; obj_id < objects.size(); ++obj_id) {
+	    track(object_states[obj_id], objects[obj_id].visible, obj_id, models[obj_id], -1);
+	}
+	instance_states.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); ++i) {
+	    const Instance& instance = instances[i];
+	    track(instance_states[i], true, instance.mesh_id, instance.model, instance.tex_id);
+	}
+
+	if (redraw) dirty = {all};
+	merge_rects(dirty, tex.width, tex.height);
+	dirty_rects = dirty;
+
+	// the color target is missing the changes of every frame since it was drawn
+	constexpr size_t max_history = 4;
+	dirty_history.push_front(dirty_rects);
+	if (dirty_history.size() > max_history) dirty_history.pop_back();
+	if (buffer_age <= 0 || (size_t)buffer_age > dirty_history.size()) {
+	    draw_rects = {all};
+	    return;
+	}
+	draw_rects.clear();
+	for (int age = 0; age < buffer_age; ++age) {
+	    draw_rects.insert(draw_rects.end(), dirty_history[age].begin(), dirty_history[age].end());
+	}
+	merge_rects(draw_rects, tex.width, tex.height);
+    }
+
+    void Renderer::update_lights() {
+	using namespace gmath;
+	light_data.clear();
+	for (const Light& light : lights) {
+	    Light_Data data;
+	    Vec3 v = light.vector;
+	    data.range = 0.f;
+	    if (light.type == LIGHT_DIRECTIONAL) {
+		// the kernels want the direction towards the light
+		v.normalize();
+		v = v * -1.f;
+	    }
+	    else {
+		data.range = std::max(light.range, FLT_MIN);
+	    }
+	    data.vector[0] = v.x;
+	    data.vector[1] = v.y;
+	    data.vector[2] = v.z;
+	    data.color[0] = light.color.x * light.intensity;
+	    data.color[1] = light.color.y * light.intensity;
+	    data.color[2] = light.color.z * light.intensity;
+	    light_data.push_back(data);
+	}
+
+	const Vec3& cam = transforms[camera.id].position;
+	light_setup = {light_data.data(), (int)light_data.size(), {ambient.x, ambient.y, ambient.z}, {cam.x, cam.y, cam.z}, specular, shininess};
+    }
+
+    void Renderer::transform_object(size_t obj_id, const Affine& model) {
+	using namespace gmath;
+	assert(obj_id < vertex_ranges.size());
+	assert(vertices_viewport.size() >= vertices_world.size());
+
+	if (model_views.size() < objects.size()) model_views.resize(objects.size());
+	const Affine& model_view = model_views[obj_id] = view * model;
+	// the kernel takes plain floats
+	float cols[16];
+	model_view.get_columns(projection, cols);
+
+	const IndexRange& range = vertex_ranges[obj_id];
+	if (range.count == 0) return;
+	static_assert(sizeof(Vec4) == 4 * sizeof(float), "transform_vec4 reads Vec4 as 4 floats");
+	kernels->transform_vec4(&vertices_world[range.start].x, &vertices_viewport[range.start].x, range.count, cols);
+	for (size_t vi = range.start; vi < range.start + range.count; ++vi) {
+	    vertices_viewport[vi].perspective_divide_and_center(tex.width, tex.height);
+	}
+
+	if (shading == SHADING_NONE) return;
+	assert(vertices_lit.size() >= vertices_world.size());
+	assert(normals_lit.size() >= normals.size());
+
+	// world space copies for the lighting, once per object and not per face corner.
+	// the model matrix has no scale, so its upper 3x3 also works for the normals
+	float model_cols[16];
+	model.get_columns(model_cols);
+	kernels->transform_vec4(&vertices_world[range.start].x, &vertices_lit[range.start].x, range.count, model_cols);
+
+	const IndexRange& n_range = normal_ranges[obj_id];
+	for (size_t ni = n_range.start; ni < n_range.start + n_range.count; ++ni) {
+	    const Vec3& n = normals[ni];
+	    normals_lit[ni] = {
+		n.x * model_cols[0] + n.y * model_cols[4] + n.z * model_cols[8],
+		n.x * model_cols[1] + n.y * model_cols[5] + n.z * model_cols[9],
+		n.x * model_cols[2] + n.y * model_cols[6] + n.z * model_cols[10],
+	    };
+	}
+    }
+
+    void Renderer::draw_triangles_wireframe(Color wire_col) {
+	using namespace gmath;
+
+	// camera always at id = 0, so other objects start at 1
+	size_t obj_id = 1;
+
+	for (int i = 0; i < faces.size(); i++) {
+
+	    if (i >= (ranges[obj_id].start + ranges[obj_id].count) ) {
+		obj_id++;
+	    }
+
+	    assert(obj_id < objects.size());
+	    assert(obj_id < transforms.size());
+
+	    const Face& face = faces[i];
+
+	    const Vec4& a = vertices_viewport[face.vs[0].v_index];
+	    const Vec4& b = vertices_viewport[face.vs[1].v_index];
+	    const Vec4& c = vertices_viewport[face.vs[2].v_index];
+
+	    // near clip
+	    if (a.z <= near_clip || b.z <= near_clip || c.z <= near_clip) {
+		continue;
+	    }
+	    // far clip
+	    if (a.w >= far_clip || b.w >= far_clip || c.w >= far_clip) {
+		continue;
+	    }
+
+	    draw_line_color(a.x, a.y, b.x, b.y, wire_col);
+	    draw_line_color(a.x, a.y, c.x, c.y, wire_col);
+	    draw_line_color(c.x, c.y, b.x, b.y, wire_col);
+	}
+    }
+
+    void Renderer::draw_triangles() {
+	stats = {};
+	{
+	    D3_PROFILE_ZONE(profiler, STAGE_CLEAR);
+	    reset_z();
+	    if (render_mode == RENDER_OVERDRAW) {
+		overdraw.assign(tex.width * tex.height, 0);
+	    }
+	    if (render_mode == RENDER_DEFERRED) {
+		g_buffer.resize(z_buffer.size());
+		kernels->fill_u32((uint32_t*)g_buffer.tex_id.data(), g_buffer.tex_id.size(), (uint32_t)-1);
+	    }
+	}
+
+	// before drawing, both prepass passes have to see the same lods
+	select_lods();
+	build_draw_list();
+
+	if (render_mode == RENDER_PREPASS) {
+	    depth_mode = DEPTH_ONLY;
+	    draw_scene();
+	    depth_mode = DEPTH_EQUAL;
+	    draw_scene();
+	    depth_mode = DEPTH_LESS_WRITE;
+	}
+	else {
+	    draw_scene();
+	}
+
+	if (render_mode == RENDER_OVERDRAW) draw_overdraw();
+	if (render_mode == RENDER_DEFERRED) resolve_g_buffer();
+    }
+
+    void Renderer::build_draw_list() {
+	draw_items.clear();
+	draw_faces.clear();
+	mesh_items.assign(objects.size(), no_draw_item);
+	saved_viewport.clear();
+	saved_lit.clear();
+	saved_normals_lit.clear();
+
+	auto reaches_draw_rect = [&](const RectangleI& rect) {
+	    for (const RectangleI& draw_rect : draw_rects) {
+		if (rects_overlap(rect, draw_rect)) return true;
+	    }
+	    return false;
+	};
+
+	// camera always at id = 0, so other objects start at 1. transform_vertices placed them
+	for (size_t obj_id = camera.id + 1; obj_id < objects.size(); ++obj_id) {
+	    if (!objects[obj_id].visible) continue;
+	    RectangleI rect = {0, 0, INT_MAX, INT_MAX};
+	    if (incremental && obj_id < object_states.size()) {
+		rect = object_states[obj_id].rect;
+		if (!reaches_draw_rect(rect)) continue;
+	    }
+	    if (objects[obj_id].occluded) {
+		D3_STAT_ADD(stats, objects_occluded, 1);
+		D3_STAT_ADD(stats, triangles_occluded, ranges[obj_id].count);
+		continue;
+	    }
+	    add_draw_item(obj_id, -1, rect);
+	}
+
+	for (size_t i = 0; i < instances.size(); ++i) {
+	    const Instance& instance = instances[i];
+	    RectangleI rect = {0, 0, INT_MAX, INT_MAX};
+	    if (incremental && i < instance_states.size()) {
+		rect = instance_states[i].rect;
+		if (!reaches_draw_rect(rect)) continue;
+	    }
+	    {
+		D3_PROFILE_ZONE(profiler, STAGE_TRANSFORM);
+		if (object_occluded(instance.mesh_id, instance.model)) {
+		    D3_STAT_ADD(stats, objects_occluded, 1);
+		    D3_STAT_ADD(stats, triangles_occluded, ranges[instance.mesh_id].count);
+		    continue;
+		}
+		// instances of the same mesh share its slots
+		free_mesh_slots(instance.mesh_id);
+		mesh_items[instance.mesh_id] = no_draw_item;
+		transform_object(instance.mesh_id, instance.model);
+	    }
+	    add_draw_item(instance.mesh_id, instance.tex_id, rect);
+	}
+    }
+
+    void Renderer::add_draw_item(size_t obj_id, int tex_id, RectangleI rect) {
+	cull_faces(obj_id);
+	if (visible_faces.empty()) return;
+
+	Draw_Item item;
+	item.mesh_id = obj_id;
+	item.tex_id = tex_id;
+	item.rect = rect;
+	item.faces = {draw_faces.size(), visible_faces.size()};
+	draw_faces.insert(draw_faces.end(), visible_faces.begin(), visible_faces.end());
+	mesh_items[obj_id] = draw_items.size();
+	draw_items.push_back(item);
+    }
+
+    void Renderer::free_mesh_slots(size_t mesh_id) {
+	size_t current = mesh_items[mesh_id];
+	if (current == no_draw_item || draw_items[current].saved) return;
+
+	Draw_Item& item = draw_items[current];
+	const IndexRange& range = vertex_ranges[mesh_id];
+	item.saved = true;
+	item.saved_vertices = saved_viewport.size();
+	saved_viewport.insert(saved_viewport.end(), vertices_viewport.begin() + range.start, vertices_viewport.begin() + range.start + range.count);
+	if (shading == SHADING_NONE) return;
+
+	const IndexRange& n_range = normal_ranges[mesh_id];
+	item.saved_normals = saved_normals_lit.size();
+	saved_lit.insert(saved_lit.end(), vertices_lit.begin() + range.start, vertices_lit.begin() + range.start + range.count);
+	saved_normals_lit.insert(saved_normals_lit.end(), normals_lit.begin() + n_range.start, normals_lit.begin() + n_range.start + n_range.count);
+    }
+
+    void Renderer::load_draw_item(size_t item_id) {
+	const Draw_Item& item = draw_items[item_id];
+	if (mesh_items[item.mesh_id] == item_id) return;
+	assert(item.saved);
+
+	free_mesh_slots(item.mesh_id);
+	mesh_items[item.mesh_id] = item_id;
+	const IndexRange& range = vertex_ranges[item.mesh_id];
+	std::copy_n(saved_viewport.begin() + item.saved_vertices, range.count, vertices_viewport.begin() + range.start);
+	if (shading == SHADING_NONE) return;
+
+	const IndexRange& n_range = normal_ranges[item.mesh_id];
+	std::copy_n(saved_lit.begin() + item.saved_vertices, range.count, vertices_lit.begin() + range.start);
+	std::copy_n(saved_normals_lit.begin() + item.saved_normals, n_range.count, normals_lit.begin() + n_range.start);
+    }
+
+    void Renderer::draw_scene() {
+	for (size_t i = 0; i < draw_items.size(); ++i) {
+	    const Draw_Item& item = draw_items[i];
+	    load_draw_item(i);
+	    const uint32_t* face_ids = draw_faces.data() + item.faces.start;
+	    if (!incremental) {
+		raster_faces(face_ids, item.faces.count, item.tex_id);
+		continue;
+	    }
+	    // the draw rects don't overlap, so item by item draws the same as rect by rect
+	    for (const RectangleI& rect : draw_rects) {
+		if (!rects_overlap(item.rect, rect)) continue;
+		scissor = rect;
+		raster_faces(face_ids, item.faces.count, item.tex_id);
+	    }
+	}
+	scissor = {0, 0, INT_MAX, INT_MAX};
+    }
+
+    void Renderer::draw_overdraw() {
+	constexpr Color heat[] = {BLUE, GREEN, {255, 255, 0, 255}, RED};
+	constexpr int max_count = 8;
+	constexpr int steps = sizeof(heat) / sizeof(heat[0]) - 1;
+
+	for (size_t i = 0; i < overdraw.size(); ++i) {
+	    int count = overdraw[i];
+	    if (count == 0) {
+		tex.pixels[i] = BLACK.to_int();
+		continue;
+	    }
+	    float t = (float)(std::min(count, max_count) - 1) / (max_count - 1) * steps;
+	    int step = std::min((int)t, steps - 1);
+	    tex.pixels[i] = lerp_color(heat[step], heat[step + 1], t - step).to_int();
+	}
+    }
+
+    void Renderer::resolve_g_buffer() {
+	D3_PROFILE_ZONE(profiler, STAGE_RESOLVE);
+	assert(g_buffer.tex_id.size() == (size_t)tex.width * tex.height);
+
+	// runs of pixels with the same texture go through the sampling kernel at once
+	const int32_t* ids = g_buffer.tex_id.data();
+	size_t count = g_buffer.tex_id.size();
+	uint64_t fetched = 0;
+	for (size_t i = 0; i < count;) {
+	    int32_t tex_id = ids[i];
+	    size_t end = i + 1;
+	    while (end < count && ids[end] == tex_id) end++;
+
+	    if (tex_id >= 0) {
+		const Texture& t = textures[tex_id];
+		kernels->sample_tex({t.pixels, t.width, t.height}, &g_buffer.u[i], &g_buffer.v[i], tex.pixels + i, end - i);
+		fetched += end - i;
+	    }
+	    i = end;
+	}
+	D3_STAT_ADD(stats, texels_fetched, fetched);
+    }
+
+    void Renderer::cull_faces(size_t obj_id) {
+	D3_PROFILE_ZONE(profiler, STAGE_CULL);
+	assert(obj_id < objects.size());
+	assert(obj_id < ranges.size());
+	assert(face_corners.size() == faces.size() * 3);
+
+	const IndexRange& range = ranges[obj_id];
+	visible_faces.clear();
+
+	D3_STAT_ADD(stats, triangles_submitted, range.count);
+	if (range.count == 0 || range.start + range.count > faces.size()) return;
+
+	static_assert(sizeof(gmath::Vec4) == 4 * sizeof(float), "cull_faces reads Vec4 as 4 floats");
+	Cull_Counts counts = {};
+	visible_faces.resize(range.count);
+	size_t visible = 0;
+	// the meshlet bounds and cones are from the bind pose
+	bool test_meshlets = meshlet_culling && objects[obj_id].skin == no_skin;
+	const IndexRange& meshlet_range = meshlet_ranges[obj_id];
+	for (size_t mi = meshlet_range.start; mi < meshlet_range.start + meshlet_range.count; ++mi) {
+	    const Meshlet& meshlet = meshlets[mi];
+	    if (test_meshlets && !meshlet_visible(meshlet, model_views[obj_id])) {
+		D3_STAT_ADD(stats, meshlets_culled, 1);
+		D3_STAT_ADD(stats, triangles_meshlet_culled, meshlet.face_count);
+		continue;
+	    }
+	    visible += kernels->cull_faces(&vertices_viewport[0].x, face_corners.data() + meshlet.face_start * 3, meshlet.face_count, meshlet.face_start,
+					   near_clip, far_clip, visible_faces.data() + visible, counts);
+	}
+	visible_faces.resize(visible);
+
+	D3_STAT_ADD(stats, triangles_backface_culled, counts.backface);
+	D3_STAT_ADD(stats, triangles_near_rejected, counts.near);
+	D3_STAT_ADD(stats, triangles_far_rejected, counts.far);
+	D3_STAT_ADD(stats, triangles_rasterized, visible);
+    }
+
+    bool Renderer::meshlet_visible(const Meshlet& meshlet, const Affine& model_view) const {
+	using namespace gmath;
+	const Bounds& b = meshlet.bounds;
+	// camera at the origin looking along +z from here on
+	Vec3 center = model_view.point(b.center);
+
+	// the per face tests reject a face with any corner in front of near or behind far
+	if (center.z + b.radius <= near_clip || center.z - b.radius >= far_clip) return false;
+
+	// side planes through the origin, a bit wider than the projection so rounding
+	// can't drop a meshlet that still touches the edge of the screen
+	float tan_y = std::tan(fov / 2.f) * 1.05f;
+	float tan_x = tan_y * tex.width / tex.height;
+	if ((std::abs(center.x) - center.z * tan_x) > b.radius * std::sqrt(1.f + tan_x * tan_x)) return false;
+	if ((std::abs(center.y) - center.z * tan_y) > b.radius * std::sqrt(1.f + tan_y * tan_y)) return false;
+
+	if (meshlet.cone_cos <= 0.f) return true;
+
+	// a face is culled if its normal points away from the camera. with phi the angle between
+	// cone axis and the direction to the center, every normal is at most phi + half angle away
+	// from that direction and every corner at most radius away from the center
+	float dist = std::sqrt(center.x * center.x + center.y * center.y + center.z * center.z);
+	if (dist <= b.radius) return true;
+	Vec3 axis = model_view.vector(meshlet.cone_axis);
+	float cos_phi = (axis.x * center.x + axis.y * center.y + axis.z * center.z) / dist;
+	float sin_phi = std::sqrt(std::max(0.f, 1.f - cos_phi * cos_phi));
+	float cos_max = cos_phi * meshlet.cone_cos - sin_phi * meshlet.cone_sin;
+	// small margin for edge on faces, the screen space test decides those
+	return cos_max * dist <= b.radius + 1e-3f * dist;
+    }
+
+    void Renderer::raster_faces(const uint32_t* face_ids, size_t count, int tex_id) {
+	using namespace gmath;
+	D3_PROFILE_ZONE(profiler, STAGE_RASTER);
+	Color debug_col = PURPLE;
+
+	for (size_t fi = 0; fi < count; ++fi) {
+	    const Face& face = faces[face_ids[fi]];
+
+	    int face_tex_id = tex_id < 0 ? face.tex_index : tex_id;
+
+	    if (face_tex_id < 0) {
+		const Vec4& a = vertices_viewport[face.vs[0].v_index];
+		const Vec4& b = vertices_viewport[face.vs[1].v_index];
+		const Vec4& c = vertices_viewport[face.vs[2].v_index];
+		fill_triangle_color({a.x, a.y, a.z}, {b.x, b.y, b.z}, {c.x, c.y, c.z}, debug_col);
+	    } 
+	    else {
+		fill_triangle_tex(face, face_tex_id);
+	    }
+	}
+    }
+
+    void Renderer::clear_pixels(Color c) {
+	D3_PROFILE_ZONE(profiler, STAGE_CLEAR);
+	if (!incremental) {
+	    clear_pixels(tex.pixels, tex.width, tex.height, c);
+	    return;
+	}
+	for (const RectangleI& rect : draw_rects) {
+	    for (int y = rect.y; y < rect.y + rect.height; ++y) {
+		kernels->fill_u32(tex.pixels + rect.x + (size_t)y * tex.width, rect.width, c.to_int());
+	    }
+	}
+    }
+
+    void Renderer::clear_pixels(uint32_t* pixels, int width, int height, Color c) {
+	assert(pixels && "clear_pixels: pixels = nullptr");
+	kernels->fill_u32(pixels, (size_t)width * height, c.to_int());
+    }
+
+    void Renderer::draw_rec(RectangleI rec, Color col) {
+	draw_rec(tex.pixels, tex.width, tex.height, rec, col);
+    }
+
+    void Renderer::draw_rec(uint32_t* pixels, int width, int height, RectangleI rec, Color col) {
+	assert(pixels && "draw_rec: pixels = nullptr");
+	if (rec.x >= width) return;
+	if (rec.y >= height) return;
+
+	if (rec.x < 0) {
+	    rec.width += rec.x; 
+	    rec.x = 0;
+	}
+	if (rec.y < 0) {
+	    rec.height += rec.y; 
+	    rec.y = 0;
+	}
+	if (rec.x + rec.width >= width) rec.width = width - 1 - rec.x;
+	if (rec.y + rec.height >= height) rec.height = height - 1 - rec.y;
+
+	uint32_t c = col.to_int();
+
+	for(int y = rec.y; y < rec.y + rec.height; ++y) {
+	    for(int x = rec.x; x < rec.x + rec.width; ++x) {
+		uint64_t index = x + y * width;
+		if (index >= width * height) {
+		    std::println("draw_rec: index = {}, x = {}, y = {} ", index, x, y);
+		}
+		assert(index < width * height && "draw rec");
+		pixels[index] = c;
+	    }
+	}
+    }
+
+    void Renderer::line_next_pixel(Line_Data& line, int width, int height) {
+
+	line.went_down = false;
+
+	if (line.x1 == line.x2 && line.y1 == line.y2) {
+	    line.done = true;
+	    return;
+	}
+
+	line.err2 = line.err << 1;
+
+	if (line.err2 > line.dy) {
+	    line.err += line.dy;
+	    line.x1 += line.sx;
+	    //line.xf += line.sx;
+	}
+
+	if (line.err2 < line.dx) {
+	    line.err += line.dx;
+	    line.y1 += line.sy;
+	    //line.yf += line.sy;
+	    line.went_down = true;
+	}
+
+	//line.pixel_x = line.x1;//line.xf;
+	//line.pixel_y = line.y1;//line.yf;
+    }
+
+    void Renderer::draw_line_color(Line_Data& line, Color color) {
+	draw_line_color(tex.pixels, tex.width, tex.height, line, color);
+    }
+
+    void Renderer::draw_line_color(int x1, int y1, int x2, int y2, Color color) {
+	Line_Data line;
+	line.set_initial(x1, y1, x2, y2);
+	draw_line_color(tex.pixels, tex.width, tex.height, line, color);
+    }
+
+    void Renderer::draw_line_color(uint32_t* pixels, int width, int height, Line_Data& line, Color color) {
+	assert(pixels);
+
+	//std::println("line : x1 = {}, y1 = {}, x2 = {}, y2 = {}", line.x1, line.y1, line.x2, line.y2);
+	//std::println("width = {}, height = {}", width, height);
+
+	if (line.dx == 0) {
+	    draw_line_vert(line.x1, line.y1, line.y2, color);
+	}
+
+	if (line.dy == 0) {
+	    draw_line_hor_col(line.x1, line.y1, line.x2, color);
+	}
+
+	while (!line.done) {
+	    if (line.x1 >= 0 && line.x1 < width && line.y1 >= 0 && line.y1 < height) {
+		size_t index = line.x1 + line.y1 * width;
+		pixels[index] = color.to_int();
+		//std::println("accepted pixel = {} {}", line.pixel_x, line.pixel_y);
+	    }
+
+	    line_next_pixel(line, width, height);
+	}
+    }
+
+    void Renderer::draw_line_vert(int x1, int y1, int y2, Color color) {
+	draw_line_vert(tex.pixels, tex.width, tex.height, x1, y1, y2, color.to_int());
+    }
+
+    void Renderer::draw_line_vert(uint32_t* pixels, int width, int height, 
+	    int x1, int y1, int y2, uint32_t col) {
+
+	if (x1 < 0 || x1 >= width) return;
+	assert(pixels);
+
+	int dy = std::abs(y2 - y1);
+	int sy = (y1 < y2) ? 1 : -1;
+
+	for (int i = 0; i < dy; ++i) {
+
+	    if (y1 < height && y1 >= 0.f)
+		pixels[x1 + y1 * width] = col;
+
+	    y1 += sy;
+	}
+    }
+
+    void Renderer::draw_line_vert(int x1, int y1, int x2, float u1, float v1, float u2, float v2, const Texture& tex) {
+	draw_line_vert(tex.pixels, tex.width, tex.height, x1, y1, x2, u1, v1, u2, v2, tex);
+    }
+
+    void Renderer::draw_line_vert(uint32_t* pixels, int width, int height, 
+	    int x1, int y1, int y2, float u1, float v1, float u2, float v2,  const Texture& tex) {
+	if (y1 >= height || y1 < 0.f) return;
+	assert(pixels);
+
+	int dy = std::abs(y2 - y1);
+	int sy = (y1 < y2) ? 1 : -1;
+
+	float u_step = dy == 0 ? 0 : (u2 - u1) / dy;
+	float v_step = dy == 0 ? 0 : (v2 - v1) / dy;
+
+	for (int i = 0; i < dy; ++i) {
+
+	    if (y1 < width && y1 >= 0.f)
+		pixels[x1 + y1 * width] = tex.get_color(u1, v1);
+
+	    y1 += sy;
+
+	    u1 += u_step;
+	    v1 += v_step;
+	}
+    }
+
+    void Renderer::draw_line_hor_tex(int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, int tex_id, bool second) {
+	assert(tex_id < textures.size());
+	if (render_mode == RENDER_DEFERRED) {
+	    draw_line_hor_g_buffer(x1, y1, x2, z1, z2, u1, v1, u2, v2, tex_id);
+	    return;
+	}
+	draw_line_hor_tex(tex.pixels, tex.width, tex.height, x1, y1, x2, z1, z2, u1, v1, u2, v2, textures[tex_id], second);
+    }
+
+    bool Renderer::setup_span_tex(uint32_t* pixels, int width, int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, Span_Tex& span,
+	    const float* a1, const float* a2, Span_Light* light) {
+	int dx = std::abs(x2 - x1);
+	int sx = (x1 < x2) ? 1 : -1;
+
+	float z1_reci = 1.f / z1;
+	float z2_reci = 1.f / z2;
+	u1 *= z1_reci;
+	v1 *= z1_reci;
+	u2 *= z2_reci;
+	v2 *= z2_reci;
+
+	float u_step = dx == 0 ? 0 : (u2 - u1) / dx;
+	float v_step = dx == 0 ? 0 : (v2 - v1) / dx;
+	float z_reci_step = dx == 0 ? 0 : (z2_reci - z1_reci) / dx;
+
+	if (y1 < scissor.y || y1 >= scissor.y + scissor.height) return false;
+
+	// pixel i of the span is x1 + i * sx, keep the i that land inside the row
+	int i_begin = sx > 0 ? std::max(0, -x1) : std::max(0, x1 - width + 1);
+	int i_end = sx > 0 ? std::min(dx, width - x1) : std::min(dx, x1 + 1);
+	if (i_begin >= i_end) return false;
+
+	// the kernel walks left to right, so right to left spans start from their last pixel
+	int first = sx > 0 ? i_begin : i_end - 1;
+	int left = x1 + first * sx;
+	// the scissor only moves begin and count, so the pixels it keeps match a full redraw
+	span.begin = std::max(0, scissor.x - left);
+	span.count = std::min(i_end - i_begin, scissor.x + scissor.width - left);
+	if (span.begin >= span.count) return false;
+	span.pixels = pixels + left + (size_t)y1 * width;
+	span.z_buffer = z_buffer.data() + (span.pixels - pixels);
+	span.z_reci = z1_reci + first * z_reci_step;
+	span.z_reci_step = z_reci_step * sx;
+	span.u = u1 + first * u_step;
+	span.u_step = u_step * sx;
+	span.v = v1 + first * v_step;
+	span.v_step = v_step * sx;
+
+	if (light) {
+	    for (int k = 0; k < 6; ++k) {
+		float start = a1[k] * z1_reci;
+		float step = dx == 0 ? 0 : (a2[k] * z2_reci - start) / dx;
+		light->varyings[k] = start + first * step;
+		light->steps[k] = step * sx;
+	    }
+	}
+	return true;
+    }
+
+    void Renderer::draw_line_hor_tex_lit(int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, const float a1[6], const float a2[6], int tex_id) {
+	assert(tex_id < textures.size());
+	assert(depth_mode != DEPTH_ONLY);
+	if (y1 >= tex.height || y1 < 0.f) return;
+
+	Span_Tex span;
+	Span_Light light;
+	if (!setup_span_tex(tex.pixels, tex.width, x1, y1, x2, z1, z2, u1, v1, u2, v2, span, a1, a2, &light)) return;
+	const Texture& texture = textures[tex_id];
+	span.tex = {texture.pixels, texture.width, texture.height};
+	span.color = RED.to_int();
+	span.depth_equal = depth_mode == DEPTH_EQUAL;
+	light.setup = &light_setup;
+
+	uint64_t passed = shading == SHADING_PHONG ? kernels->span_tex_phong(span, light) : kernels->span_tex_gouraud(span, light);
+
+	D3_STAT_ADD(stats, fragments_tested, span.count - span.begin);
+	D3_STAT_ADD(stats, fragments_passed, passed);
+	D3_STAT_ADD(stats, texels_fetched, passed);
+    }
+
+    void Renderer::draw_line_hor_tex(uint32_t* pixels, int width, int height, 
+	    int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, const Texture& tex, bool second) {
+
+	assert(pixels);
+	if (y1 >= height || y1 < 0.f) return;
+
+	Span_Tex span;
+	if (!setup_span_tex(pixels, width, x1, y1, x2, z1, z2, u1, v1, u2, v2, span)) return;
+	span.tex = second ? Texture_View{nullptr, 0, 0} : Texture_View{tex.pixels, tex.width, tex.height};
+	span.color = RED.to_int();
+	span.depth_equal = depth_mode == DEPTH_EQUAL;
+
+	uint64_t tested = span.count - span.begin;
+	uint64_t passed = 0;
+	if (depth_mode == DEPTH_ONLY) {
+	    passed = kernels->span_depth(span);
+	    D3_STAT_ADD(stats, fragments_tested, tested);
+	    D3_STAT_ADD(stats, fragments_passed, passed);
+	    return;
+	}
+	passed = kernels->span_tex(span);
+
+	if (render_mode == RENDER_OVERDRAW) {
+	    uint16_t* overdraw_counts = overdraw.data() + (span.pixels - pixels);
+	    for (int i = span.begin; i < span.count; ++i) overdraw_counts[i]++;
+	}
+
+	D3_STAT_ADD(stats, fragments_tested, tested);
+	D3_STAT_ADD(stats, fragments_passed, passed);
+	D3_STAT_ADD(stats, texels_fetched, second ? 0 : passed);
+    }
+
+    void Renderer::draw_line_hor_g_buffer(int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, int tex_id) {
+	assert(g_buffer.tex_id.size() == z_buffer.size());
+	if (y1 >= tex.height || y1 < 0.f) return;
+
+	Span_Tex span;
+	if (!setup_span_tex(tex.pixels, tex.width, x1, y1, x2, z1, z2, u1, v1, u2, v2, span)) return;
+
+	size_t offset = span.pixels - tex.pixels;
+	Span_G_Buffer out = {g_buffer.u.data() + offset, g_buffer.v.data() + offset, g_buffer.tex_id.data() + offset, tex_id};
+	uint64_t passed = kernels->span_g_buffer(span, out);
+
+	D3_STAT_ADD(stats, fragments_tested, span.count - span.begin);
+	D3_STAT_ADD(stats, fragments_passed, passed);
+    }
+
+    void Renderer::draw_line_hor_col_z(int x1, int y1, int x2, float z1, float z2, Color col) {
+	draw_line_hor_col_z(tex.pixels, tex.width, tex.height, x1, y1, x2, z1, z2, col.to_int());
+    }
+
+    void Renderer::draw_line_hor_col_z(uint32_t* pixels, int width, int height, int x1, int y1, int x2, float z1, float z2, uint32_t col) {
+
+	if (y1 >= height || y1 < 0.f) return;
+	if (y1 < scissor.y || y1 >= scissor.y + scissor.height) return;
+	assert(pixels);
+	int x_min = std::max(0, scissor.x);
+	int x_max = std::min(width, scissor.x + scissor.width);
+
+	int dx = std::abs(x2 - x1);
+	int sx = (x1 < x2) ? 1 : -1;
+
+
+	float z_step = dx == 0 ? 0 : (z2 - z1) / dx;
+
+	uint16_t* overdraw_counts = render_mode == RENDER_OVERDRAW ? overdraw.data() : nullptr;
+	// the color is final, so a textured fragment behind it must not be resolved over it
+	int32_t* g_buffer_ids = render_mode == RENDER_DEFERRED ? g_buffer.tex_id.data() : nullptr;
+	uint64_t tested = 0;
+	uint64_t passed = 0;
+
+	for (int i = 0; i < dx; ++i) {
+
+	    if (x1 < x_max && x1 >= x_min) {
+		size_t index = x1 + y1 * width;
+		tested++;
+		if (overdraw_counts) overdraw_counts[index]++;
+		if (depth_mode == DEPTH_EQUAL ? z1 <= z_buffer[index] : z1 < z_buffer[index]) {
+		    if (depth_mode != DEPTH_ONLY) pixels[index] = col;
+		    // see Span_Tex::depth_equal
+		    z_buffer[index] = depth_mode == DEPTH_EQUAL ? std::nextafter(z1, 0.f) : z1;
+		    if (g_buffer_ids) g_buffer_ids[index] = -1;
+		    passed++;
+		}
+	    }
+
+	    x1 += sx;
+	    z1 += z_step;
+	}
+
+	D3_STAT_ADD(stats, fragments_tested, tested);
+	D3_STAT_ADD(stats, fragments_passed, passed);
+    }
+
+    void Renderer::draw_line_hor_col(int x1, int y1, int x2, Color col) {
+	draw_line_hor_col(tex.pixels, tex.width, tex.height, x1, y1, x2, col.to_int());
+    }
+
+    void Renderer::draw_line_hor_col(uint32_t* pixels, int width, int height, int x1, int y1, int x2, uint32_t col) {
+
+	if (y1 >= height || y1 < 0.f) return;
+	assert(pixels);
+
+	int dx = std::abs(x2 - x1);
+	int sx = (x1 < x2) ? 1 : -1;
+
+
+	for (int i = 0; i < dx; ++i) {
+
+	    if (x1 < width && x1 >= 0.f) {
+		size_t index = x1 + y1 * width;
+		pixels[index] = col;
+	    }
+
+	    x1 += sx;
+	}
+    }
+
+    void Renderer::draw_line_blend(int x1, int y1, int x2, int y2, Color start, Color end) {
+	draw_line_blend(tex.pixels, tex.width, tex.height, x1, y1, x2, y2, start, end);
+    }
+
+    void Renderer::draw_line_blend(uint32_t* pixels, int width, int height, 
+	    int x1, int y1, int x2, int y2, Color start, Color end) {
+
+	assert(pixels);
+
+
+	int dx = std::abs(x2 - x1);
+	int sx = (x1 < x2) ? 1 : -1;
+
+	int dy = -std::abs(y2 - y1);
+	int sy = (y1 < y2) ? 1 : -1;
+
+	int err = dx + dy;
+	int e2;
+	gmath::Vec3 v = {(float)x2 - x1, (float)y2 - y1, 0};
+	float length = v.length();
+	float t = 0.f;
+
+	while (true) {
+	    if ((uint32_t)(x1 + y1 * width) < width * height) {
+		int color = lerp_color(start, end, t).to_int();
+		pixels[x1 + y1 * width] = color;
+	    }
+
+	    if (x1 == x2 && y1 == y2)
+		break;
+
+	    e2 = err << 1;
+
+	    if (e2 > dy) {
+		err += dy;
+		x1 += sx;
+	    }
+
+	    if (e2 < dx) {
+		err += dx;
+		y1 += sy;
+	    }
+	    v.x = x2 - x1;
+	    v.y = y2 - y1;
+	    t = (length - v.length()) / length;
+	    //std::println("p1 : {} {} , p2 : {} {}, index = {}", x1, y1, x2, y2, index);
+	}
+    }
+
+    void Renderer::fill_triangle_tex(const Face& face) {
+	fill_triangle_tex(face, face.tex_index);
+    }
+
+    void Renderer::fill_triangle_tex(const Face& face, int tex_id) {
+	assert(tex.pixels);
+
+	int indices_sorted[3] = {0, 1, 2};
+
+	const gmath::Vec4& a = vertices_viewport[face.vs[0].v_index];
+	const gmath::Vec4& b = vertices_viewport[face.vs[1].v_index];
+	const gmath::Vec4& c = vertices_viewport[face.vs[2].v_index];
+
+	sort_y(a, b, c, indices_sorted);
+	// set start point lowest vertex (cursed)
+	gmath::Vec4 p1 = vertices_viewport[face.vs[indices_sorted[0]].v_index];
+	gmath::Vec4 p2 = p1;
+
+	float p1_u = uvs[face.vs[indices_sorted[0]].uv_index].u;
+	float p1_v = uvs[face.vs[indices_sorted[0]].uv_index].v;
+	float target1_u = uvs[face.vs[indices_sorted[1]].uv_index].u;
+	float target1_v = uvs[face.vs[indices_sorted[1]].uv_index].v;
+
+	float p2_u = uvs[face.vs[indices_sorted[0]].uv_index].u;
+	float p2_v = uvs[face.vs[indices_sorted[0]].uv_index].v;
+	float target2_u = uvs[face.vs[indices_sorted[2]].uv_index].u;
+	float target2_v = uvs[face.vs[indices_sorted[2]].uv_index].v;
+
+	// choose target (end points of lines) based on lowest vertex by sorted index
+	gmath::Vec4 target1 = vertices_viewport[face.vs[indices_sorted[1]].v_index];
+	gmath::Vec4 target2 = vertices_viewport[face.vs[indices_sorted[2]].v_index];
+
+
+	Line_Data line1;
+	Line_Data line2;
+
+	line1.set_initial(p1.x, p1.y, target1.x, target1.y);
+	line2.set_initial(p2.x, p2.y, target2.x, target2.y);
+
+	float dist1 = line1.length();
+	float dist2 = line2.length();
+
+	// toggle to show the second triangle in a different way for debugging
+	bool second = false;
+
+	// lighting varyings per sorted corner (see Span_Light), line1 runs from corner
+	// edge1_from to edge1_to, line2 always from 0 to 2
+	bool lit = shading != SHADING_NONE && depth_mode != DEPTH_ONLY &&
+	    (render_mode == RENDER_FORWARD || render_mode == RENDER_PREPASS) &&
+	    face.vs[0].n_index < normals_lit.size() && face.vs[1].n_index < normals_lit.size() && face.vs[2].n_index < normals_lit.size();
+	float corners[3][6];
+	if (lit) {
+	    for (int k = 0; k < 3; ++k) {
+		const IndexRecord& rec = face.vs[indices_sorted[k]];
+		const gmath::Vec3& n = normals_lit[rec.n_index];
+		const gmath::Vec4& p = vertices_lit[rec.v_index];
+		float* corner = corners[k];
+		corner[0] = n.x;
+		corner[1] = n.y;
+		corner[2] = n.z;
+		corner[3] = p.x;
+		corner[4] = p.y;
+		corner[5] = p.z;
+	    }
+	    if (shading == SHADING_GOURAUD) {
+		float in[3][6];
+		memcpy(in, corners, sizeof(in));
+		kernels->light_points(light_setup, &in[0][0], &corners[0][0], 3);
+	    }
+	}
+	int edge1_from = 0;
+	int edge1_to = 1;
+	float a1[6];
+	float a2[6];
+
+	// horizontal line from p1 - target1, draw and skip
+	if (line1.dy == 0) {
+
+
+	    if (lit) draw_line_hor_tex_lit(p1.x, p1.y, target1.x, p1.z, target1.z, p1_u, p1_v, target1_u, target1_v, corners[0], corners[1], tex_id);
+	    else draw_line_hor_tex(p1.x, p1.y, target1.x, p1.z, target1.z, p1_u, p1_v, target1_u, target1_v, tex_id);
+
+	    p1 = vertices_viewport[face.vs[indices_sorted[1]].v_index];
+	    target1 = vertices_viewport[face.vs[indices_sorted[2]].v_index];
+
+	    p1_u = uvs[face.vs[indices_sorted[1]].uv_index].u;
+	    p1_v = uvs[face.vs[indices_sorted[1]].uv_index].v;
+	    target1_u = uvs[face.vs[indices_sorted[2]].uv_index].u;
+	    target1_v = uvs[face.vs[indices_sorted[2]].uv_index].v;
+
+	    line1.set_initial(p1.x, p1.y, target1.x, target1.y);
+	    dist1 = line1.length();
+	    edge1_from = 1;
+	    edge1_to = 2;
+	}
+
+	while (!line2.done) {
+
+	    if (!line1.went_down) {
+		line_next_pixel(line1, tex.width, tex.height);
+
+		if (line1.done) {
+		    //std::println("BEFORE:\np1: {}, {}", line1.x1, line1.y1);
+		    //std::println("target1: {}", target1.to_str());
+		    p1 = vertices_viewport[face.vs[indices_sorted[1]].v_index];
+		    target1 = vertices_viewport[face.vs[indices_sorted[2]].v_index];
+		    //line1.set_initial(p1.x, p1.y, target1.x, target1.y);
+		    line1.set_initial(p1.x, p1.y, target1.x, target1.y);
+		    dist1 = line1.length();
+		    edge1_from = 1;
+		    edge1_to = 2;
+		    //std::println("AFTER:\ndist1 = {}, v.length = {}", dist1, v.length());
+		    //std::println("p1: {}, {}", line1.x1, line1.y1);
+		    //std::println("target1: {}", target1.to_str());
+		    second = false;
+		}
+	    }
+
+	    if (!line2.went_down) {
+		line_next_pixel(line2, tex.width, tex.height);
+	    }
+
+	    if (line1.went_down && line2.went_down) {
+		line1.went_down = false;
+		line2.went_down = false;
+
+
+
+		float z1_recip = 1.f / p1.z;
+		float z2_recip = 1.f / p2.z;
+
+		float zt1_recip = 1.f / target1.z;
+		float zt2_recip = 1.f / target2.z;
+
+		float t = 1.f - line1.length() / dist1;
+		float u1 = gmath::lerpf(p1_u * z1_recip, target1_u * zt1_recip, t);
+		float v1 = gmath::lerpf(p1_v * z1_recip, target1_v * zt1_recip, t);
+		//float u1 = gmath::lerpf(p1.u, target1.u, t);
+		//float v1 = gmath::lerpf(p1.v, target1.v, t);
+		float z1 = gmath::lerpf(p1.z, target1.z, t);
+
+		float zi1 = 1.f / gmath::lerpf(z1_recip, zt1_recip, t);
+		if (lit) {
+		    for (int k = 0; k < 6; ++k) {
+			a1[k] = gmath::lerpf(corners[edge1_from][k] * z1_recip, corners[edge1_to][k] * zt1_recip, t) * zi1;
+		    }
+		}
+
+
+		t = 1.f - line2.length() / dist2;
+		float u2 = gmath::lerpf(p2_u * z2_recip, target2_u * zt2_recip, t);
+		float v2 = gmath::lerpf(p2_v * z2_recip, target2_v * zt2_recip, t);
+		float z2 = gmath::lerpf(p2.z, target2.z, t);
+
+		float zi2 = 1.f / gmath::lerpf(z2_recip, zt2_recip, t);
+
+		if (lit) {
+		    for (int k = 0; k < 6; ++k) {
+			a2[k] = gmath::lerpf(corners[0][k] * z2_recip, corners[2][k] * zt2_recip, t) * zi2;
+		    }
+		    draw_line_hor_tex_lit(line1.x1, line1.y1, line2.x1, zi1, zi2, u1 * zi1, v1 * zi1, u2 * zi2, v2 * zi2, a1, a2, tex_id);
+		}
+		else {
+		    draw_line_hor_tex(line1.x1, line1.y1, line2.x1, zi1, zi2, u1 * zi1, v1 * zi1, u2 * zi2, v2 * zi2, tex_id, second);
+		}
+	    }
+	}
+    }
+
+    void Renderer::fill_triangle_color(gmath::Vec3 a, gmath::Vec3 b, gmath::Vec3 c, Color col) {
+	using namespace gmath;
+	assert(tex.pixels);
+
+	Line_Data line1;
+	Line_Data line2;
+
+	int indices_sorted[3] = {0, 1, 2};
+
+	sort_y(a, b, c, indices_sorted);
+	Vec3* vs[3] = {
+		    (indices_sorted[0] == 0 ? &a : (indices_sorted[0] == 1 ? &b : &c)),
+		    (indices_sorted[1] == 0 ? &a : (indices_sorted[1] == 1 ? &b : &c)),
+		    (indices_sorted[2] == 0 ? &a : (indices_sorted[2] == 1 ? &b : &c)),
+	};
+	// set start point lowest vertex (cursed)
+	Vec3 p1 = *vs[0];
+	Vec3 p2 = p1;
+
+	// choose target (end points of lines) based on lowest vertex by sorted index
+	Vec3 target1 = *vs[1];
+	Vec3 target2 = *vs[2];
+
+	line1.set_initial(p1.x, p1.y, target1.x, target1.y);
+	line2.set_initial(p2.x, p2.y, target2.x, target2.y);
+
+	float dist1 = line1.length();
+	float dist2 = line2.length();
+
+	// horizontal line from p1 - target1, draw and skip
+	if (line1.dy == 0) {
+	    draw_line_hor_col_z(p1.x, p1.y, target1.x, p1.z, target1.z, col);
+	    p1 = target1;
+	    target1 = *vs[2];
+	    line1.set_initial(p1.x, p1.y, target1.x, target1.y);
+	    dist1 = line1.length();
+	}
+
+	while (!line2.done) {
+
+	    if (!line1.went_down) {
+		line_next_pixel(line1, tex.width, tex.height);
+
+		if (line1.done) {
+		    p1 = target1;
+		    target1 = *vs[2];
+		    line1.set_initial(p1.x, p1.y, target1.x, target1.y);
+		    dist1 = line1.length();
+		}
+	    }
+
+	    if (!line2.went_down) {
+		line_next_pixel(line2, tex.width, tex.height);
+	    }
+
+	    if (line1.went_down && line2.went_down) {
+		line1.went_down = false;
+		line2.went_down = false;
+
+		float t = 1.f - line1.length() / dist1;
+		float z1 = gmath::lerpf(p1.z, target1.z, t);
+
+		t = 1.f - line2.length() / dist2;
+		float z2 = gmath::lerpf(p2.z, target2.z, t);
+
+		draw_line_hor_col_z(line1.x1, line1.y1, line2.x1, z1, z2, col);
+	    }
+	}
+    }
+
+
+#ifndef D3_HEADLESS
+    // pushes the keys and the mouse position that changed since the last call
+    // keys and mouse are what the queue has been told, they only change once a push went
+    // through, so an edge that didn't fit is sent again next time instead of getting lost.
+    // mouse_end is pushed() after the last move: no new move is queued before that one was
+    // consumed, the frame gets the newest position instead of one move per sample
+    static void sample_win32_input(HWND hwnd, std::array<bool, 256>& keys, POINT& mouse, size_t& mouse_end, Input_Thread& input, int64_t now_ns) {
+	for (int key = 1; key < 256; ++key) {
+	    bool down = GetAsyncKeyState(key) & 0x8000;
+	    if (down == keys[key]) continue;
+	    if (input.push({down ? INPUT_KEY_DOWN : INPUT_KEY_UP, key, 0, 0, now_ns})) keys[key] = down;
+	}
+	if (input.queue.consumed() < mouse_end) return;
+	POINT pos;
+	if (GetCursorPos(&pos) && ScreenToClient(hwnd, &pos) && (pos.x != mouse.x || pos.y != mouse.y)) {
+	    if (!input.push({INPUT_MOUSE_MOVE, 0, (int)pos.x, (int)pos.y, now_ns})) return;
+	    mouse = pos;
+	    mouse_end = input.queue.pushed();
+	}
+    }
+
+    Window::Window(uint64_t width, uint64_t height, const char* name, bool async_present) :
+    width(width), height(height), name(name) {
+
+	std::println("Renderer objects count in window constructor = {}", renderer.objects.size());
+	renderer.init_framebuffer(width, height);
+
+	HINSTANCE hInstance = GetModuleHandle(nullptr);
+
+	WNDCLASS window_class = {};
+	window_class.lpfnWndProc = WindowProc;
+	window_class.hInstance = hInstance;
+	window_class.lpszClassName = "Window";
+
+	RegisterClass(&window_class);
+
+	RECT r = {0, 0, (long)width, (long)height};
+	AdjustWindowRect(&r, WS_OVERLAPPEDWINDOW, FALSE);
+
+	hwnd = CreateWindowEx(
+				0, 
+				window_class.lpszClassName, 
+				name, 
+				WS_OVERLAPPEDWINDOW, 
+				0, 0, r.right - r.left, r.bottom - r.top, 
+				nullptr, nullptr, hInstance, nullptr);
+
+	if (hwnd == nullptr) {
+		    std::println("ERROR: could not create Window class : {}, name :  {}", window_class.lpszClassName, name);
+		    exit(0);
+	}
+
+	hdc = GetDC(hwnd);
+	if (hdc == nullptr) {
+		    std::println("ERROR: could not obtain device context");
+		    exit(0);
+	} 
+
+	renderer.init_gl(hdc);
+
+	if (async_present) {
+	    // rasterize straight into mapped pixel buffers if the driver has them
+	    bool mapped = renderer.init_pbos(3);
+
+	    // a gl context is current on one thread at a time, from here on it's the present thread
+	    wglMakeCurrent(nullptr, nullptr);
+	    presenter.thread_begin = [this]() { wglMakeCurrent(hdc, renderer.gl_ctx); };
+	    presenter.present = [this](const Texture& frame, const std::vector<RectangleI>& dirty) {
+		apply_swap_interval();
+		renderer.draw_tex(hdc, frame.pixels, dirty);
+	    };
+	    presenter.thread_end = []() { wglMakeCurrent(nullptr, nullptr); };
+	    if (mapped) presenter.start(renderer.tex, renderer.pbo_pixels);
+	    else presenter.start(renderer.tex);
+	}
+
+	show(SW_SHOW);
+
+	input.sample = [this, keys = std::array<bool, 256>{}, mouse = POINT{INT_MIN, INT_MIN}, mouse_end = (size_t)0](Input_Thread& thread, int64_t now_ns) mutable {
+	    sample_win32_input(hwnd, keys, mouse, mouse_end, thread, now_ns);
+	};
+	input.start();
+
+	is_open = true;
+    }
+
+    Window::~Window() {
+	input.stop();
+	presenter.stop(renderer.tex);
+	// the present thread gave the context up when it ended
+	if (!renderer.pbos.empty()) {
+	    wglMakeCurrent(hdc, renderer.gl_ctx);
+	    renderer.release_pbos();
+	}
+	CloseWindow(hwnd);
+	PostQuitMessage(0);
+    }
+
+    void Window::show(int nCmdShow) {
+	ShowWindow(hwnd, nCmdShow);
+    }
+
+    void Window::begin_frame() {
+
+	renderer.profiler.begin_frame();
+	//renderer.clear_pixels(WHITE);
+
+	while (PeekMessage(&msg, nullptr, 0,0, PM_REMOVE)) {
+	    TranslateMessage(&msg);
+	    DispatchMessage(&msg);
+	}
+	input.poll(input_state);
+
+	if (input_state.down(VK_ESCAPE) || msg.message == WM_QUIT) {
+	    is_open = false;
+	}
+    }
+
+    void Window::end_frame() {
+	draw();
+	renderer.profiler.end_frame();
+	scheduler.wait();
+    }
+
+    void Window::draw() {
+	D3_PROFILE_ZONE(renderer.profiler, STAGE_PRESENT);
+	// async: only waits if the present thread is buffer_count - 1 frames behind
+	if (presenter.running()) renderer.buffer_age = presenter.submit(renderer.tex, renderer.dirty_rects);
+	else {
+	    apply_swap_interval();
+	    renderer.draw_tex(hdc, renderer.tex.pixels, renderer.dirty_rects);
+	}
+    }
+
+    void Window::apply_swap_interval() {
+	int interval = swap_interval;
+	if (interval == applied_swap_interval) return;
+	if (wglSwapIntervalEXT) wglSwapIntervalEXT(interval);
+	applied_swap_interval = interval;
+    }
+
+    void Window::set_target_fps(int fps) {
+	scheduler.set_target_fps(fps);
+	swap_interval = fps > 0 ? 1 : 0;
+    }
+#endif // D3_HEADLESS
+
+} // d3
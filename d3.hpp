@@ -3,118 +3,45 @@
 
 #include <cstring>
 #include <fstream>
+#ifndef D3_HEADLESS
 #include <glad/glad.h>
+#endif
 #include <print>
 #include <stdint.h>
 #include <vector>
-#define GMATH_IMPLEMENTATION
 #include <gmath/gmath.hpp>
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image/stb_image.h>
+#ifndef D3_HEADLESS
 #include <windows.h>
 #include <winuser.h>
+#endif
 #include <string>
 #include <assert.h>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <array>
+#include <map>
+#include <queue>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <cctype>
+#include "kernels.hpp"
 
 namespace d3 {
 
-typedef BOOL (WINAPI *wglSwapIntervalEXT_t)(int);
-wglSwapIntervalEXT_t wglSwapIntervalEXT = (wglSwapIntervalEXT_t)wglGetProcAddress("wglSwapIntervalEXT");
-
-GLuint vao;
-
-
-constexpr const char* fragment_shader = 
-R"(#version 330 core
-in vec2 uv;
-uniform sampler2D screenTex;
-out vec4 fragColor;
-void main() {
-    vec2 uv_inv = {uv.x, -uv.y};
-    fragColor = texture(screenTex, uv_inv);
-}
-)";
-
-constexpr const char* vertex_shader = 
-R"(#version 330 core
-out vec2 uv;
-void main() {
-    vec2 pos;
-    if (gl_VertexID == 0) pos = vec2(-1.0, -1.0);
-    if (gl_VertexID == 1) pos = vec2( 3.0, -1.0);
-    if (gl_VertexID == 2) pos = vec2(-1.0,  3.0);
-    gl_Position = vec4(pos, 0.0, 1.0);
-    uv = pos * 0.5 + 0.5;
-}
-)";
-
-
-
-
-
-GLuint compile_shader(GLenum type, const char* src) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-
-
-
-    GLint ok;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
-    if (!ok) {
-	char log[1024];
-	glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
-	MessageBoxA(0, log, "Shader Compile Error", MB_OK);
-	glDeleteShader(shader);
-	return 0;
-    }
-    return shader;
-}
-
-GLuint create_program(const char* vs, const char* fs) {
-    GLuint v = compile_shader(GL_VERTEX_SHADER, vs);
-    GLuint f = compile_shader(GL_FRAGMENT_SHADER, fs);
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, v);
-    glAttachShader(prog, f);
-    glLinkProgram(prog);
-
-    GLint ok;
-    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
-    if (!ok) {
-	char log[1024];
-	glGetProgramInfoLog(prog, sizeof(log), nullptr, log);
-	MessageBoxA(0, log, "Program Link Error", MB_OK);
-	glDeleteProgram(prog);
-	return 0;
-    }
-
-    glDeleteShader(v);
-    glDeleteShader(f);
-    return prog;
-}
-
-
-
-
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    switch (uMsg) {
-
-	case WM_DESTROY:
-	    PostQuitMessage(0);
-	    return 0;
-	break;
-
-	case WM_CLOSE:
-	    DestroyWindow(hwnd);
-	    return 0;
-	break;
-
-    }
-    return DefWindowProc(hwnd, uMsg, wParam, lParam);
-}
+#ifndef D3_HEADLESS
+GLuint compile_shader(GLenum type, const char* src);
+GLuint create_program(const char* vs, const char* fs);
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+#endif // D3_HEADLESS
 
 enum Log_Level {
     LOG_ALL, LOG_INFO, LOG_DEBUG, LOG_ERROR, 
@@ -198,9 +125,104 @@ constexpr d3::Color GRAY = {0x16, 0x16, 0x16, 255};
 	}
     };
 
+    // unit quaternion, w is the real part
+    struct Quat {
+	float x = 0.f;
+	float y = 0.f;
+	float z = 0.f;
+	float w = 1.f;
+
+	// axis has to be normalized
+	static Quat from_axis_angle(gmath::Vec3 axis, float angle) {
+	    float s = std::sin(angle / 2.f);
+	    return {axis.x * s, axis.y * s, axis.z * s, std::cos(angle / 2.f)};
+	}
+
+	// this after o
+	Quat operator*(const Quat& o) const {
+	    return {
+		w * o.x + x * o.w + y * o.z - z * o.y,
+		w * o.y - x * o.z + y * o.w + z * o.x,
+		w * o.z + x * o.y - y * o.x + z * o.w,
+		w * o.w - x * o.x - y * o.y - z * o.z,
+	    };
+	}
+
+	Quat conjugate() const {
+	    return {-x, -y, -z, w};
+	}
+
+	bool is_identity() const {
+	    return x == 0.f && y == 0.f && z == 0.f && w == 1.f;
+	}
+
+	void normalize() {
+	    float length = std::sqrt(x * x + y * y + z * z + w * w);
+	    if (length == 0.f) return;
+	    x /= length;
+	    y /= length;
+	    z /= length;
+	    w /= length;
+	}
+
+	gmath::Vec3 rotate(gmath::Vec3 v) const {
+	    // v + 2w (q x v) + 2 q x (q x v), q the vector part
+	    float tx = 2.f * (y * v.z - z * v.y);
+	    float ty = 2.f * (z * v.x - x * v.z);
+	    float tz = 2.f * (x * v.y - y * v.x);
+	    return {
+		v.x + w * tx + y * tz - z * ty,
+		v.y + w * ty + z * tx - x * tz,
+		v.z + w * tz + x * ty - y * tx,
+	    };
+	}
+    };
+
+    // shortest arc, t in [0, 1]
+    Quat slerp(const Quat& a, const Quat& b, float t);
+
+    // rotation and translation: p -> cols[0] * p.x + cols[1] * p.y + cols[2] * p.z + cols[3].
+    // d3's own so models can be cached and combined without touching the elements of gmath::Mat4
+    struct Affine {
+	gmath::Vec3 cols[4] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, 0}};
+
+	// the images of the basis vectors under m, its last row has to be 0 0 0 1
+	static Affine from_mat4(const gmath::Mat4& m);
+
+	gmath::Vec3 point(gmath::Vec3 p) const {
+	    return {
+		cols[0].x * p.x + cols[1].x * p.y + cols[2].x * p.z + cols[3].x,
+		cols[0].y * p.x + cols[1].y * p.y + cols[2].y * p.z + cols[3].y,
+		cols[0].z * p.x + cols[1].z * p.y + cols[2].z * p.z + cols[3].z,
+	    };
+	}
+
+	gmath::Vec3 vector(gmath::Vec3 v) const {
+	    return {
+		cols[0].x * v.x + cols[1].x * v.y + cols[2].x * v.z,
+		cols[0].y * v.x + cols[1].y * v.y + cols[2].y * v.z,
+		cols[0].z * v.x + cols[1].z * v.y + cols[2].z * v.z,
+	    };
+	}
+
+	// this after o
+	Affine operator*(const Affine& o) const {
+	    return {{vector(o.cols[0]), vector(o.cols[1]), vector(o.cols[2]), point(o.cols[3])}};
+	}
+
+	// the 16 floats column by column, the layout transform_vec4 takes
+	void get_columns(float out[16]) const;
+
+	// same for m * this
+	void get_columns(const gmath::Mat4& m, float out[16]) const;
+    };
+
     struct Transform {
 	gmath::Vec3 position;
 	gmath::Vec3 angles;
+	// turns the object after the euler angles. for the camera it turns the view the other
+	// way, after the translation
+	Quat rotation;
 
 	void move_dir(gmath::Vec3 dir, float speed) {
 	    using namespace gmath;
@@ -208,20 +230,126 @@ constexpr d3::Color GRAY = {0x16, 0x16, 0x16, 255};
 
 	    float a_x = (position.z > 0.f ? -angles.x : angles.x);
 	    dir.multiply(gmath::Mat4::rotation_from_angles({a_x, -angles.y, angles.z}));
+	    dir = rotation.rotate(dir);
 	    //dir.normalize();
 	    dir.multiply(speed);
-	    //position.add(dir);
-	    position.multiply(gmath::Mat4::translation(dir));
+	    position.x += dir.x;
+	    position.y += dir.y;
+	    position.z += dir.z;
 	}
+
+	// translation * rotation * euler angles
+	Affine get_model() const;
+
+	// the camera's view when this is the camera transform
+	Affine get_view() const;
     };
 
+    // position and angles lerped and rotation slerped, for drawing in between two simulation steps
+    Transform lerp_transform(const Transform& a, const Transform& b, float t);
+
     struct IndexRange {
 	size_t start = 0;
 	size_t count = 0;
     };
 
+    constexpr size_t no_parent = SIZE_MAX;
+    constexpr size_t no_skin = SIZE_MAX;
+
     struct Object {
 	size_t id;
+	// its transform is relative to the parent's, see Renderer::obj_set_parent
+	size_t parent = no_parent;
+	// index into Renderer::skins, see Renderer::obj_set_skin
+	size_t skin = no_skin;
+	bool visible = true;
+	// transform or parent changed since Renderer::models was updated
+	bool model_dirty = true;
+	// rasterized into the occlusion buffer before the other objects are tested against it
+	bool occluder = false;
+	// fully behind the occluders this frame, set by transform_vertices
+	bool occluded = false;
+    };
+
+    // draws the faces of the mesh object mesh_id with its own transform,
+    // the mesh data is only stored once in the renderer
+    struct Instance {
+	size_t mesh_id;
+	Transform transform;
+	// < 0 keeps the texture of the faces
+	int tex_id = -1;
+	// transform.get_model(), updated by Renderer::update_models if model_dirty
+	Affine model;
+	bool model_dirty = true;
+    };
+
+    // object space bounding box and the sphere around its center
+    struct Bounds {
+	gmath::Vec3 center;
+	float radius = 0.f;
+	// half the size of the box
+	gmath::Vec3 extents = {0, 0, 0};
+    };
+
+    constexpr uint32_t meshlet_max_faces = 64;
+    // widest angle between a face normal and the average normal of its meshlet while
+    // build_meshlets grows it, in radians
+    constexpr float meshlet_max_cone_angle = gmath::PI / 12.f;
+    // how far from its seed build_meshlets lets a meshlet grow before distance outweighs
+    // a better matching normal, in sizes of the seed's neighborhood
+    constexpr float meshlet_spread = 2.f;
+
+    // up to meshlet_max_faces consecutive faces of an object, culled as a whole against
+    // the frustum and for facing away before any per face work
+    struct Meshlet {
+	uint32_t face_start;
+	uint32_t face_count;
+	// object space
+	Bounds bounds;
+	// every outward face normal is within the cone around cone_axis, cos / sin of its
+	// half angle. cone_cos <= 0 means the faces spread too far for the cone test
+	gmath::Vec3 cone_axis;
+	float cone_cos = -1.f;
+	float cone_sin = 0.f;
+    };
+
+    // influences of one vertex, slots with weight 0 are unused
+    struct Bone_Weights {
+	uint16_t bones[4] = {0, 0, 0, 0};
+	float weights[4] = {0, 0, 0, 0};
+    };
+
+    // bone data of a skinned object. the bind pose is kept here, vertices_world and normals of
+    // the object hold the skinned ones once Renderer::skin_vertices ran
+    struct Skin {
+	size_t obj_id;
+	std::vector<gmath::Vec4> bind_vertices;
+	// 4 per vertex in the layout skin_vec4 wants, the weights are normalized
+	std::vector<uint16_t> bones;
+	std::vector<float> weights;
+	// same for the normals, with w = 0 so the bones only rotate them. skinned_normals is
+	// the kernel output before it's normalized into normals
+	std::vector<gmath::Vec4> bind_normals;
+	std::vector<uint16_t> normal_bones;
+	std::vector<float> normal_weights;
+	std::vector<gmath::Vec4> skinned_normals;
+	// the columns of every bone matrix, 16 floats each, see Renderer::obj_set_bones
+	std::vector<float> palette;
+	// palette changed since the vertices were skinned
+	bool dirty = true;
+	// the vertices were skinned this frame, the object has to be redrawn
+	bool posed = false;
+    };
+
+    // several meshes of the same model, drawn through one instance whose mesh
+    // is picked each frame from the projected size of the most detailed mesh
+    struct LodGroup {
+	// most detailed first
+	std::vector<size_t> meshes;
+	// projected diameter in pixels below which meshes[i + 1] is used, meshes.size() - 1 entries
+	std::vector<float> min_sizes;
+	size_t instance_id;
+	size_t level = 0;
     };
 
 
@@ -232,25 +360,11 @@ constexpr d3::Color GRAY = {0x16, 0x16, 0x16, 255};
 	int height;
 	int comp_per_px = 4;
 
-	std::string to_str() const {
-	    return std::string("\npixels = ") + std::to_string((size_t)pixels) + "\nwidth = " + std::to_string(width)
-		+ "\nheight = " + std::to_string(height) + "\ncomp_per_px = " + std::to_string(comp_per_px);
-	}
+	std::string to_str() const;
 
-	bool load_from_file(const char* filename) {
-	    assert(pixels == nullptr);
-	    int n; 
-	    pixels = (uint32_t*)stbi_load(filename, &width, &height, &n, comp_per_px);
-	    return (pixels != nullptr);
-	}
+	bool load_from_file(const char* filename);
 
-	void from_color(int width, int height, int color) {
-	    assert(pixels == nullptr);
-	    pixels = new uint32_t[width * height];
-	    std::memset(pixels, color, sizeof(uint32_t) * width * height);
-	    this->width = width;
-	    this->height = height;
-	}
+	void from_color(int width, int height, int color);
 
 	uint32_t get_color(float u, float v) const {
 	    assert(!std::isnan(u));
@@ -274,8 +388,15 @@ constexpr d3::Color GRAY = {0x16, 0x16, 0x16, 255};
 	    }
 	    return pixels[index];
 	}
+
+	// binary ppm (P6), alpha is dropped. load_from_file reads it back through stb_image
+	bool write_ppm(const char* filepath) const;
     };
 
+    // counts pixels where any rgb channel differs by more than tolerance. diff gets
+    // allocated with the mismatches in red over a darkened copy of the reference
+    size_t compare_images(const Texture& result, const Texture& reference, int tolerance, Texture& diff);
+
     struct Line_Data {
 	int x1, y1, x2, y2, dx, sx, dy, sy, err, err2;//, pixel_x, pixel_y; 
 	//float xf, yf;
@@ -345,20 +466,7 @@ constexpr d3::Color GRAY = {0x16, 0x16, 0x16, 255};
 	    }
 	}
     }
-    Color lerp_color(Color start, Color end, float t) {
-	if (t < 0.f) t = 0.f;
-	else if (t > 1.f) t = 1.f;
-
-	float inv_t = 1.f - t;
-	// TODO: blend alpha too?
-	Color res = {
-			(uint8_t)(start.r * inv_t + end.r * t), 
-			(uint8_t)(start.g * inv_t + end.g * t),
-			(uint8_t)(start.b * inv_t + end.b * t),
-			255
-	};
-	return res;
-    }
+    Color lerp_color(Color start, Color end, float t);
 
     struct Timer {
 	
@@ -366,10 +474,14 @@ constexpr d3::Color GRAY = {0x16, 0x16, 0x16, 255};
 	std::chrono::milliseconds elapsed_total;
 
 	Timer() {
+#ifndef D3_HEADLESS
 	    timeBeginPeriod(1);
+#endif
 	}
 	~Timer() {
+#ifndef D3_HEADLESS
 	    timeEndPeriod(1);
+#endif
 	}
 
 	void start() {
@@ -389,1141 +501,1009 @@ constexpr d3::Color GRAY = {0x16, 0x16, 0x16, 255};
 
     };
 
-    static inline constexpr bool is_digit(char c) {
-	return (c >= '0' && c <= '9');
-    }
-
+    // fixed timestep accumulator: the simulation advances in steps of step_seconds no matter
+    // how often frames are rendered, drawing lerps the last two states by alpha()
+    struct Fixed_Step {
+	using clock = std::chrono::steady_clock;
 
-    struct Renderer {
-
-	GLuint gl_tex;
-	GLuint program;
-	HGLRC gl_ctx;
-
-	std::vector<gmath::Vec4> vertices_world;
-	std::vector<gmath::Vec4> vertices_viewport;
-	std::vector<UV> uvs;
-	std::vector<gmath::Vec3> normals;
-	std::vector<Texture> textures;
-	std::vector<Transform> transforms;
-	std::vector<Object> objects;
-	std::vector<IndexRange> ranges;
-	std::vector<Face> faces;
+	double step_seconds = 1.0 / 120.0;
+	// steps per advance at most, a long stall drops the time instead of catching up on it
+	int max_steps = 8;
+	double accumulator = 0;
+	clock::time_point last;
+	bool started = false;
 
-	Texture tex;
-
-	std::vector<float> z_buffer;
-
-	float far_clip = 10.f;
-	float near_clip = .4f;
-	float fov = gmath::PI / 2.f;
-
-	Object camera = {0};
-
-	Renderer () {
-	    Transform cam_transform = {{0, 0, -1}, {0}};
-	    camera.id = push_object(cam_transform);
-
-	    assert(camera.id == 0);
+	// adds the real time since the last call, returns how many steps to simulate now
+	int advance() {
+	    clock::time_point now = clock::now();
+	    if (!started) last = now;
+	    started = true;
+	    double seconds = std::chrono::duration<double>(now - last).count();
+	    last = now;
+	    return advance(seconds);
 	}
 
-	~Renderer() {
-	    if (tex.pixels) {
-		delete[] tex.pixels;
-		tex.pixels = nullptr;
-	    }
+	// same with a given frame time, for scripted runs that have to be repeatable
+	int advance(double seconds) {
+	    accumulator += seconds;
+	    int steps = (int)(accumulator / step_seconds);
+	    accumulator -= steps * step_seconds;
+	    return std::min(steps, max_steps);
 	}
 
+	// how far the present is from the last simulated state towards the next one, [0, 1)
+	float alpha() const {
+	    return (float)(accumulator / step_seconds);
+	}
+    };
 
-	bool loadOBJ(const char* filepath, size_t& obj_id, Transform t = {0}, int tex_id = -1) {
-	    std::ifstream file(filepath);
-	    if (file.bad()) return false;
-
-	    // OBJ indeces start with 1, so subtracting 1 should always fix that
-	    size_t v_index_start = this->vertices_world.size() - 1;
-	    size_t uv_index_start = this->uvs.size() - 1;
-	    size_t n_index_start = this->normals.size() - 1;
-	    IndexRange range;
-	    range.start = this->faces.size();
-
-	    std::println("loading obj:\nv_i_start = {}, uv_i_start = {}, n_i_start = {}, range.start = {}", v_index_start, uv_index_start, n_index_start, range.start);
-
-	    std::string line;
-	    std::string start;
-	    std::vector<gmath::Vec4> verts;
-	    std::vector<Face> faces;
-	    std::vector<UV> uvs;
-	    std::vector<gmath::Vec3> normals;
-
-	    Face face;
-	    gmath::Vec4 vert;
-	    gmath::Vec3 normal;
-	    float u, v;
-
-	    while(std::getline(file, line)) {
-		std::istringstream iss(line);
-		start = "";
-		iss >> start;
-
-		if (start.starts_with("vt")) {
-		    iss >> u;		    
-		    iss >> v;		    
-		    uvs.emplace_back(UV{u,v}); 
-		}
-		else if (start.starts_with("vn")) {
-		    std::println("parsing face: {}", line);
-		    if (!(iss >> normal.x) ||
-			!(iss >> normal.y) ||
-			!(iss >> normal.z)) {
-			std::println("error on line: {}", line);
-			std::println("start = {}", start);
-			std::println("normal = {}", normal.to_str());
-			continue;
-
-		    }
-		    //normal.multiply(-1.f);
-		    //normal.z *= -1.f;
-		    //normal.y *= -1.f;
-		    std::println("parsed normal = {}", normal.to_str());
-		    normals.emplace_back(normal);
-
-		}
-		else if (start.starts_with("v")) {
-		    if (!(iss >> vert.x) ||
-			!(iss >> vert.y) ||
-			!(iss >> vert.z)) {
-			std::println("error on line: {}", line);
-			std::println("start = {}", start);
-			std::println("vertex = {}", vert.to_str());
-			continue;
-
-		    }
-		    vert.w = 1.f;
-		    verts.emplace_back(vert);
-		}
-		else if (start.starts_with("f")) {
-		    //std::println("parsing face: {}", line);
-		    int cur = 0;
-		    char c = line[0];
-		    // only works for f 1/2/3 etc, f v_index/uv_index/normal_index
-		    // find first two numbers
-		    for(int vertex = 0; vertex < 3; ++vertex) {
-			iss >> face.vs[vertex].v_index;
-			face.vs[vertex].v_index += v_index_start;
-			iss >> c;
-			assert(c == '/');
-			iss >> face.vs[vertex].uv_index;
-			face.vs[vertex].uv_index += uv_index_start;
-			iss >> c;
-			assert(c == '/');
-			iss >> face.vs[vertex].n_index;
-			face.vs[vertex].n_index += n_index_start;
-		    }
-		    face.tex_index = tex_id;
-		    faces.emplace_back(face);
-		}
-	    }
-
-	    std::println("LoadOBJ: after reading in file:\nvertices read = {}, uvs read = {}\nnormals read = {}, faces read = {}", verts.size(), uvs.size(), normals.size(), faces.size());
-
-	    //obj_push_verts(obj_id, verts.data(), verts.size(), v_indeces.data(), v_indeces.size());
-	    //obj_push_uvs(obj_id, uvs.data(), uvs.size(), uv_indeces.data());
-
-	    push_vertices(verts.data(), verts.size());
-	    push_uvs(uvs.data(), uvs.size());
-	    push_normals(normals.data(), normals.size());
-	    push_faces(faces.data(), faces.size());
-
-	    range.count = faces.size();
-	    std::println("teapot face range:\nstart = {}, count = {}", range.start, range.count);
-	    push_object(t, range);
+    // frame intervals as seen by Frame_Scheduler::wait, in ms
+    struct Pacing_Stats {
+	size_t frames = 0;
+	double target_ms = 0;
+	double mean_ms = 0;
+	// standard deviation of the intervals
+	double jitter_ms = 0;
+	double p50_ms = 0;
+	double p95_ms = 0;
+	double p99_ms = 0;
+	double max_ms = 0;
+	// intervals longer than 1.5 targets, only counted with a target
+	size_t missed = 0;
+    };
 
-	    return true;
+    // paces frames to a target rate with nanosecond deadlines: sleeps while the deadline is
+    // further away than a sleep usually takes, then spins for the rest
+    struct Frame_Scheduler {
+	using clock = std::chrono::steady_clock;
+	static constexpr size_t frame_capacity = 256;
+
+	// 0 runs uncapped, wait only records the interval
+	int64_t target_ns = 0;
+	// weight of the newest interval in smoothed_ns
+	float smoothing = 0.1f;
+	int64_t smoothed_ns = 0;
+	// how long a 1 ms sleep actually takes, follows the slowest sleeps seen lately
+	int64_t sleep_ns = 2'000'000;
+	// deadline of the next frame, frames are paced against this cadence, not against the
+	// end of the last wait, so an early or late frame doesn't shift the following ones
+	clock::time_point next;
+	clock::time_point last;
+	// ring buffer of the last frame_capacity intervals
+	std::vector<int64_t> intervals = std::vector<int64_t>(frame_capacity);
+	size_t interval_count = 0;
+	size_t frame_count = 0;
+
+	Frame_Scheduler() {
+#ifndef D3_HEADLESS
+	    timeBeginPeriod(1);
+#endif
 	}
-
-	Transform get_cam_transform() {
-	    return transforms[camera.id] ;
+	~Frame_Scheduler() {
+#ifndef D3_HEADLESS
+	    timeEndPeriod(1);
+#endif
 	}
 
-	void set_cam_transform(Transform& t) {
-	    transforms[camera.id] = t; 
+	// fps <= 0 is uncapped
+	void set_target_fps(int fps) {
+	    target_ns = fps > 0 ? 1'000'000'000 / fps : 0;
 	}
 
+	// call once per frame after presenting: waits for the frame's deadline and records the
+	// interval since the last call
+	void wait();
 
-	size_t push_cube(float side = 1.f, Transform t = {0}, int tex_id = -1) {
-
-	    size_t v_start = vertices_world.size();
-	    size_t uv_start = uvs.size();
-	    size_t n_start = normals.size();
-
-	    constexpr size_t v_size = 8;
-	    gmath::Vec4 vertices[v_size] = {0}; 
-	    vertices[0] = {-side / 2.f,  side / 2.f, -side / 2.f, 1.f};//, .u = 0.f, .v = 0.f, .tex_id = 0};
-	    vertices[1] = { side / 2.f,  side / 2.f, -side / 2.f, 1.f};//, .u = 1.f, .v = 0.f, .tex_id = 0};
-	    vertices[2] = {-side / 2.f, -side / 2.f, -side / 2.f, 1.f};//, .u = 0.f, .v = 1.f, .tex_id = 0};
-	    vertices[3] = { side / 2.f, -side / 2.f, -side / 2.f, 1.f};//, .u = 1.f, .v = 1.f, .tex_id = 0};
-			        				
-	    vertices[4] = {-side / 2.f,  side / 2.f,  side / 2.f, 1.f};//, .u = 0.f, .v = 0.f, .tex_id = 0};
-	    vertices[5] = { side / 2.f,  side / 2.f,  side / 2.f, 1.f};//, .u = 1.f, .v = 0.f, .tex_id = 0};
-	    vertices[6] = {-side / 2.f, -side / 2.f,  side / 2.f, 1.f};//, .u = 0.f, .v = 1.f, .tex_id = 0};
-	    vertices[7] = { side / 2.f, -side / 2.f,  side / 2.f, 1.f};//, .u = 1.f, .v = 1.f, .tex_id = 0};
-
-	    push_vertices(vertices, v_size);
-	    push_uvs(cube_uvs, cube_uvs_size);
-
-	    constexpr size_t n_count = 6;
-	    constexpr gmath::Vec3 normals[n_count] = {
-		{0, 0, -1}, {0, 0, 1},
-		{1, 0, 0}, {-1, 0, 0},
-		{0, 1, 0}, {0, -1, 0}
-	    };
+	void wait_until(clock::time_point deadline);
 
-	    push_normals(normals, n_count);
+	// smoothed frame time, for animation steps that shouldn't pick up the jitter
+	float delta_seconds() const {
+	    return smoothed_ns * 1e-9f;
+	}
 
+	Pacing_Stats stats() const;
+
+	void print_report() const;
+    };
 
-	// v_is
-	//    4, 0, 6,  6, 0, 2, 
+    enum Render_Mode {
+	RENDER_FORWARD,
+	// fragments rasterized per pixel as a heatmap instead of the shaded image
+	RENDER_OVERDRAW,
+	// rasterization only fills the g buffer, textures are sampled once per pixel afterwards
+	RENDER_DEFERRED,
+	// depth only pass over the scene first, then a second pass shades only the fragments
+	// that are equal to the final depth
+	RENDER_PREPASS,
+    };
 
-	//    4, 5, 0,  0, 5, 1,
+    // how the span functions use the z buffer, draw_triangles switches it for RENDER_PREPASS
+    enum Depth_Mode {
+	DEPTH_LESS_WRITE,
+	DEPTH_ONLY,
+	DEPTH_EQUAL,
+    };
 
-	//    2, 3, 6,  6, 3, 7,
+    enum Light_Type {
+	LIGHT_DIRECTIONAL,
+	LIGHT_POINT,
+    };
 
-	//    1, 5, 3,  3, 5, 7,
+    struct Light {
+	Light_Type type = LIGHT_DIRECTIONAL;
+	// direction the light travels for directional lights, world position for point lights
+	gmath::Vec3 vector = {0, 0, 1};
+	gmath::Vec3 color = {1, 1, 1};
+	float intensity = 1.f;
+	// point lights fade out linearly until range
+	float range = 10.f;
+    };
 
-	//    6, 7, 4,  4, 7, 5,
+    enum Shading {
+	// texels as they are
+	SHADING_NONE,
+	// lit at the triangle corners, the light is interpolated over the triangle
+	SHADING_GOURAUD,
+	// normal and position are interpolated, lit per pixel
+	SHADING_PHONG,
+    };
 
-	//    0, 1, 2,  2, 1, 3,
+    // work done by draw_triangles in the last frame
+    struct Render_Stats {
+	uint64_t objects_occluded = 0;
+	uint64_t triangles_occluded = 0;
+	uint64_t triangles_submitted = 0;
+	uint64_t meshlets_culled = 0;
+	uint64_t triangles_meshlet_culled = 0;
+	uint64_t triangles_backface_culled = 0;
+	uint64_t triangles_near_rejected = 0;
+	uint64_t triangles_far_rejected = 0;
+	uint64_t triangles_rasterized = 0;
+	uint64_t fragments_tested = 0;
+	uint64_t fragments_passed = 0;
+	uint64_t texels_fetched = 0;
+
+	void print() const;
+    };
 
+#ifndef D3_NO_STATS
+#define D3_STAT_ADD(stats, counter, n) ((stats).counter += (n))
+#else
+#define D3_STAT_ADD(stats, counter, n) ((void)0)
+#endif
 
-    //uvs:
-    //0.f, 0.f,
-    //1.f, 0.f,  
-    //0.f, 1.f, 
-    //1.f, 1.f
-	    constexpr size_t face_count = 6 * 2;
-	    Face faces[face_count] = {
-		// front
-		{{{0 + v_start, 0 + uv_start, 0 + n_start}, {1 + v_start, 1 + uv_start, 0 + n_start}, {2 + v_start, 2 + uv_start, 0 + n_start}}, tex_id},
-		{{{2 + v_start, 2 + uv_start, 0 + n_start}, {1 + v_start, 1 + uv_start, 0 + n_start}, {3 + v_start, 3 + uv_start, 0 + n_start}}, tex_id},
-		// back
-		{{{6 + v_start, 3 + uv_start, 1 + n_start}, {7 + v_start, 2 + uv_start, 1 + n_start}, {4 + v_start, 1 + uv_start, 1 + n_start}}, tex_id},
-		{{{4 + v_start, 1 + uv_start, 1 + n_start}, {7 + v_start, 2 + uv_start, 1 + n_start}, {5 + v_start, 0 + uv_start, 1 + n_start}}, tex_id},
-		// left
-		{{{4 + v_start, 0 + uv_start, 4 + n_start}, {0 + v_start, 1 + uv_start, 4 + n_start}, {6 + v_start, 2 + uv_start, 4 + n_start}}, tex_id},
-		{{{6 + v_start, 2 + uv_start, 4 + n_start}, {0 + v_start, 1 + uv_start, 4 + n_start}, {2 + v_start, 3 + uv_start, 4 + n_start}}, tex_id},
-		// right
-		{{{1 + v_start, 0 + uv_start, 5 + n_start}, {5 + v_start, 1 + uv_start, 5 + n_start}, {3 + v_start, 2 + uv_start, 5 + n_start}}, tex_id},
-		{{{3 + v_start, 2 + uv_start, 5 + n_start}, {5 + v_start, 1 + uv_start, 5 + n_start}, {7 + v_start, 3 + uv_start, 5 + n_start}}, tex_id},
-		// top
-		{{{4 + v_start, 0 + uv_start, 3 + n_start}, {5 + v_start, 1 + uv_start, 3 + n_start}, {0 + v_start, 2 + uv_start, 3 + n_start}}, tex_id},
-		{{{0 + v_start, 2 + uv_start, 3 + n_start}, {5 + v_start, 1 + uv_start, 3 + n_start}, {1 + v_start, 3 + uv_start, 3 + n_start}}, tex_id},
-		// bot
-		{{{2 + v_start, 0 + uv_start, 2 + n_start}, {3 + v_start, 1 + uv_start, 2 + n_start}, {6 + v_start, 2 + uv_start, 2 + n_start}}, tex_id},
-		{{{6 + v_start, 2 + uv_start, 2 + n_start}, {3 + v_start, 1 + uv_start, 2 + n_start}, {7 + v_start, 3 + uv_start, 2 + n_start}}, tex_id},
-	    };
-	    
-	    IndexRange range;
-	    range.start = this->faces.size();
-	    range.count = face_count;
+    enum Profile_Stage {
+	STAGE_CLEAR, STAGE_TRANSFORM, STAGE_CULL, STAGE_RASTER, STAGE_RESOLVE, STAGE_PRESENT, STAGE_COUNT,
+    };
 
-	    push_faces(faces, face_count);
-	    
+    constexpr const char* stage_names[STAGE_COUNT] = {
+	"clear", "transform", "cull", "raster", "resolve", "present",
+    };
 
-	    size_t id = push_object(t, range);
+    struct Profile_Zone_Record {
+	Profile_Stage stage;
+	int64_t begin_ns;
+	int64_t end_ns;
+    };
 
-	    return id;
+    struct Frame_Profile {
+	int64_t begin_ns = 0;
+	int64_t end_ns = 0;
+	int64_t stage_ns[STAGE_COUNT] = {0};
+	std::vector<Profile_Zone_Record> zones;
 
+	int64_t total_ns() const {
+	    return end_ns - begin_ns;
 	}
+    };
 
-	size_t push_object(Transform t = {0}, IndexRange range = {0}) {
-	    assert(ranges.size() == objects.size());
-	    assert(transforms.size() == objects.size());
-
-	    size_t id = objects.size();
+    // keeps the stage timings of the last frame_capacity frames in a ring buffer
+    struct Profiler {
+	static constexpr size_t frame_capacity = 256;
 
-	    objects.push_back({id});
-	    transforms.push_back(t);
-	    ranges.push_back(range);
+	bool enabled = true;
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	std::vector<Frame_Profile> frames = std::vector<Frame_Profile>(frame_capacity);
+	// frames recorded in total, frames[(frame_count - 1) % frame_capacity] is the last one
+	size_t frame_count = 0;
+	Frame_Profile current;
 
-	    return id;
-	}	    
-	
-	void push_vertices(const gmath::Vec4* verts, size_t count) {
-	    assert(verts);
-	    for (int i = 0; i < count; ++i) {
-		vertices_world.push_back(verts[i]);
-	    }
-	}
-	
-	void push_uvs(const UV* uvs, size_t count) {
-	    assert(uvs);
-	    for (int i = 0; i < count; ++i) {
-		this->uvs.push_back(uvs[i]);
-	    }
+	int64_t now_ns() const {
+	    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
 	}
 
-	void push_normals(const gmath::Vec3* normals, size_t count) {
-	    assert(normals);
-	    for (int i = 0; i < count; ++i) {
-		this->normals.push_back(normals[i]);
-	    }
+	void begin_frame() {
+	    if (!enabled) return;
+	    current.zones.clear();
+	    std::fill(std::begin(current.stage_ns), std::end(current.stage_ns), 0);
+	    current.begin_ns = now_ns();
 	}
 
-	void push_faces(const Face* faces, size_t count) {
-	    assert(faces);
-	    for (int i = 0; i < count; ++i) {
-		this->faces.push_back(faces[i]);
-	    }
+	void end_frame() {
+	    if (!enabled) return;
+	    current.end_ns = now_ns();
+	    // swap keeps the zone capacity of the overwritten slot around for reuse
+	    std::swap(frames[frame_count % frame_capacity], current);
+	    frame_count++;
 	}
 
-	void obj_set_transform(size_t obj_id, const Transform& t) {
-	    assert(obj_id < objects.size());
-	    assert(obj_id < transforms.size());
-	    assert(objects.size() == transforms.size());
-
-	    transforms[obj_id] = t; 
-
+	void record(Profile_Stage stage, int64_t begin_ns, int64_t end_ns) {
+	    current.stage_ns[stage] += end_ns - begin_ns;
+	    current.zones.push_back({stage, begin_ns, end_ns});
 	}
 
-	void init_texture() {
-	    assert(tex.pixels && tex.width && tex.height);
-
-	    glGenTextures(1, &gl_tex);
-	    glBindTexture(GL_TEXTURE_2D, gl_tex);
-
-	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	    glTexImage2D(GL_TEXTURE_2D, 0,
-			 GL_RGBA8, tex.width, tex.height, 0,
-			 GL_RGBA, GL_UNSIGNED_BYTE,
-			 tex.pixels);
+	size_t recorded_frames() const {
+	    return std::min(frame_count, frame_capacity);
 	}
 
-	void init_gl(HDC hdc) {
-
-	    PIXELFORMATDESCRIPTOR pfd = {};
-	    pfd.nSize = sizeof(pfd);
-	    pfd.nVersion = 1;
-	    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
-	    pfd.iPixelType = PFD_TYPE_RGBA;
-	    pfd.cColorBits = 32;
-
-	    int pf = ChoosePixelFormat(hdc, &pfd);
-	    SetPixelFormat(hdc, pf, &pfd);
-
-	    gl_ctx = wglCreateContext(hdc);
-
-	    wglMakeCurrent(hdc, gl_ctx);
-
-	    if(!gladLoadGL()) {
-		std::println("{}", glGetError());	
-	    }
-
-	    glEnable(GL_TEXTURE_2D);
-
-	    glViewport(0, 0, tex.width, tex.height); 
+	// percent in [0, 100], stage == STAGE_COUNT uses the whole frame
+	int64_t percentile_ns(Profile_Stage stage, float percent) const;
 
-	    program = create_program(vertex_shader, fragment_shader);
-	    glUseProgram(program);
+	void print_report() const;
 
-	    GLint loc = glGetUniformLocation(program, "screenTex");
-	    glUniform1i(loc, 0); // Texture Unit 0
-
-	    glGenVertexArrays(1, &vao);
-	    glBindVertexArray(vao);
+	// chrome://tracing / perfetto json of the recorded frames, oldest first
+	bool write_chrome_trace(const char* filepath) const;
+    };
 
-	    init_texture();
+    // records the time until the end of the scope into the current frame
+    struct Profile_Zone {
+	Profiler& profiler;
+	Profile_Stage stage;
+	int64_t begin_ns;
 
-	    // vsync an;
-	    if (wglSwapIntervalEXT) wglSwapIntervalEXT(1);
-	}
-
-	void init_z() {
-	    assert(tex.pixels);
-	    z_buffer.clear();
-	    z_buffer.reserve(tex.width * tex.height);
-	    z_buffer.resize(tex.width * tex.height);
-	    for (float& p: z_buffer) {
-		p = far_clip * 2.f;
-	    }
+	Profile_Zone(Profiler& profiler, Profile_Stage stage): profiler(profiler), stage(stage) {
+	    begin_ns = profiler.enabled ? profiler.now_ns() : 0;
 	}
-
-	void reset_z() {
-	    for (float& p: z_buffer) {
-		p = far_clip * 2.f;
-	    }
+	~Profile_Zone() {
+	    if (profiler.enabled) profiler.record(stage, begin_ns, profiler.now_ns());
 	}
+    };
 
-	void draw_tex(HDC hdc) {
-	    glClearColor(0,0,0,1);
-	    glClear(GL_COLOR_BUFFER_BIT);
-
-	    glBindTexture(GL_TEXTURE_2D, gl_tex);
-
-	    glTexSubImage2D(GL_TEXTURE_2D, 0, 0,0, tex.width, tex.height,
-			    GL_RGBA, GL_UNSIGNED_BYTE, tex.pixels);
+#ifndef D3_NO_PROFILER
+#define D3_PROFILE_ZONE(profiler, stage) d3::Profile_Zone d3_profile_zone((profiler), (stage))
+#else
+#define D3_PROFILE_ZONE(profiler, stage)
+#endif
 
-	    glDrawArrays(GL_TRIANGLES, 0, 3);
+    // standalone copy of an object's geometry, indices are local to the mesh
+    struct Mesh {
+	std::vector<gmath::Vec4> vertices;
+	std::vector<UV> uvs;
+	std::vector<gmath::Vec3> normals;
+	std::vector<Face> faces;
+    };
 
-	    SwapBuffers(hdc);
-	}
+    // quadric error metric simplification with half edge collapses (Garland & Heckbert),
+    // vertices only move onto existing vertices, so uvs and normals stay exact.
+    // an edge is only collapsed if every uv / normal wedge of the removed vertex continues
+    // on the kept vertex, which keeps uv seams and hard edges intact
+    Mesh simplify_mesh(const Mesh& mesh, size_t target_faces);
 
+    // runs simplify_mesh on its own thread, meant for generating lods at load time
+    std::future<Mesh> simplify_mesh_async(Mesh mesh, size_t target_faces);
 
-	void transform_vertices() {
-	    using namespace gmath;
-	    if (vertices_viewport.capacity() < vertices_world.size()) {
-		std::println("viewport verts reserve, old size = {}, new size = {}", vertices_viewport.size(), vertices_world.size());
-		vertices_viewport.reserve(vertices_world.size());
-	    }
-	    assert(vertices_viewport.capacity() >= vertices_world.size());
+    static inline constexpr bool is_digit(char c) {
+	return (c >= '0' && c <= '9');
+    }
 
-	    if (vertices_viewport.size() < vertices_world.size())   vertices_viewport.resize(vertices_world.size());
-	    assert(vertices_viewport.size() >= vertices_world.size());
 
-	    Transform& camera_transform = transforms[camera.id];
+    // per pixel surface of the closest fragment, tex_id < 0 means nothing to resolve
+    struct G_Buffer {
+	std::vector<float> u;
+	std::vector<float> v;
+	std::vector<int32_t> tex_id;
 
-	    Mat4 view = Mat4::get_model(camera_transform.position * -1.f, camera_transform.angles * -1.f);
+	void resize(size_t pixel_count) {
+	    u.resize(pixel_count);
+	    v.resize(pixel_count);
+	    tex_id.resize(pixel_count);
+	}
+    };
 
-	    // skip cam_id = 0;
-	    size_t obj_id = camera.id + 1;
+    // what an object or instance looked like when it was last drawn, for the incremental mode
+    struct Draw_State {
+	bool drawn = false;
+	size_t mesh_id = 0;
+	Affine model;
+	int tex_id = -1;
+	RectangleI rect = {0, 0, 0, 0};
+    };
 
-	    for (int fi = 0; fi < faces.size(); ++fi) {
-		if (fi >= (ranges[obj_id].start + ranges[obj_id].count) ) {
-		    obj_id++;
-		}
+    constexpr size_t no_draw_item = SIZE_MAX;
+
+    // an object or instance that is drawn this frame, transformed, occlusion tested and
+    // culled once by Renderer::build_draw_list however many passes rasterize it
+    struct Draw_Item {
+	size_t mesh_id = 0;
+	int tex_id = -1;
+	// where it can reach on screen, only used in incremental mode
+	RectangleI rect = {0, 0, INT_MAX, INT_MAX};
+	// its visible faces in Renderer::draw_faces
+	IndexRange faces;
+	// its transformed vertices and normals in the Renderer::saved_ arrays, only copied out
+	// once another item of the same mesh needs the slots
+	bool saved = false;
+	size_t saved_vertices = 0;
+	size_t saved_normals = 0;
+    };
 
-		assert(obj_id < objects.size());
-		assert(obj_id < transforms.size());
-		    
-		const Object& obj = objects[obj_id];
-		const Transform& obj_transform = transforms[obj_id];	
-		Mat4 model = Mat4::get_model(obj_transform.position, obj_transform.angles);
-		Mat4 projection = Mat4::projection((float)tex.width / tex.height, fov, near_clip, far_clip);
-		Mat4 mvp = projection * view * model;
+    // coarse depth of the occluders, one cell per cell_size x cell_size pixels. a cell only
+    // gets a depth if an occluder triangle covers all of it, the farthest depth of that
+    // triangle within the cell, so everything behind it is hidden in the full resolution too
+    struct Occlusion_Buffer {
+	int cell_size = 8;
+	int width = 0;
+	int height = 0;
+	// FLT_MAX for cells no occluder covers completely
+	std::vector<float> z;
+	// no occluder was drawn this frame, nothing gets tested
+	bool empty = true;
+    };
 
-		const Face& face = faces[fi];
+    // presents finished color targets on its own thread, so the next frame rasterizes while
+    // the last one is uploaded and swapped. buffer_count targets rotate between the renderer,
+    // the queue and the present thread, submit only waits if all of them are in use
+    struct Presenter {
+	struct Frame {
+	    uint32_t* pixels;
+	    // regions that changed since the frame before, empty for all of it
+	    std::vector<RectangleI> dirty;
+	};
 
-		vertices_viewport[face.vs[0].v_index] = vertices_world[face.vs[0].v_index];
-		vertices_viewport[face.vs[1].v_index] = vertices_world[face.vs[1].v_index];
-		vertices_viewport[face.vs[2].v_index] = vertices_world[face.vs[2].v_index];
-		Vec4& a = vertices_viewport[face.vs[0].v_index];
-		Vec4& b = vertices_viewport[face.vs[1].v_index];
-		Vec4& c = vertices_viewport[face.vs[2].v_index];
+	// run on the present thread: once at start (e.g. to make a gl context current),
+	// once per submitted frame, oldest first, and once before the thread ends
+	std::function<void()> thread_begin;
+	std::function<void(const Texture& frame, const std::vector<RectangleI>& dirty)> present;
+	std::function<void()> thread_end;
+
+	int width = 0;
+	int height = 0;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+	// oldest presented first, so buffers come back around in a fixed order
+	std::deque<uint32_t*> free_buffers;
+	std::deque<Frame> queued;
+	bool stopping = false;
+	// submits so far and the submit each buffer was last queued with, for buffer ages
+	uint64_t submits = 0;
+	std::map<uint32_t*, uint64_t> last_submit;
+	// false if the buffers came from the caller, target.pixels is then parked in own_pixels
+	bool owns_buffers = true;
+	uint32_t* own_pixels = nullptr;
+
+	~Presenter();
+
+	// target keeps its pixels as the first buffer, buffer_count - 1 more get allocated
+	void start(Texture& target, int buffer_count = 3);
+
+	// rotates buffers (width * height pixels each) instead, e.g. mapped pixel buffer objects,
+	// so frames are rasterized right where the upload reads them. they stay owned by the caller
+	void start(Texture& target, const std::vector<uint32_t*>& buffers);
+
+	// queues target.pixels for presenting and swaps in a free buffer. returns the age of the
+	// new one for Renderer::buffer_age: frames since it was drawn, 0 if it never was
+	int submit(Texture& target, const std::vector<RectangleI>& dirty = {});
+
+	// presents what is queued and joins. target keeps the buffer it has, or gets its own back
+	// if the buffers came from the caller. that one still holds what it had before start, the
+	// caller's buffers can be write only mappings, so the next frame has to be drawn in full
+	void stop(Texture& target);
+
+	bool running() const {
+	    return thread.joinable();
+	}
+
+	void start_thread();
+    };
 
-		a.multiply(mvp);
-		b.multiply(mvp);
-		c.multiply(mvp);
-		
-		a.perspective_divide_and_center(tex.width, tex.height);
-		b.perspective_divide_and_center(tex.width, tex.height);
-		c.perspective_divide_and_center(tex.width, tex.height);
+    // threads that stay around between calls to run, for work that is split up every frame
+    struct Worker_Pool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable cond;
+	const std::function<void(size_t worker, size_t workers)>* job = nullptr;
+	// bumped by run, a thread works once per generation
+	uint64_t generation = 0;
+	// threads still working on the current generation
+	size_t pending = 0;
+	size_t workers = 1;
+	bool stopping = false;
 
-	    }
+	~Worker_Pool() {
+	    stop();
 	}
 
-	void draw_triangles_wireframe(Color wire_col) {
-	    using namespace gmath;
-
-	    // camera always at id = 0, so other objects start at 1
-	    size_t obj_id = 1;
+	// count workers, the thread calling run is one of them
+	void start(size_t count);
 
-	    for (int i = 0; i < faces.size(); i++) {
+	void stop();
 
-		if (i >= (ranges[obj_id].start + ranges[obj_id].count) ) {
-		    obj_id++;
-		}
-
-		assert(obj_id < objects.size());
-		assert(obj_id < transforms.size());
-
-		const Face& face = faces[i];
+	// job(worker, workers) on every worker, worker 0 on the calling thread. returns once all
+	// of them are done
+	void run(const std::function<void(size_t worker, size_t workers)>& job);
+    };
 
-		const Vec4& a = vertices_viewport[face.vs[0].v_index];
-		const Vec4& b = vertices_viewport[face.vs[1].v_index];
-		const Vec4& c = vertices_viewport[face.vs[2].v_index];
+    enum Input_Type {
+	INPUT_KEY_DOWN,
+	INPUT_KEY_UP,
+	// mouse position in client coordinates
+	INPUT_MOUSE_MOVE,
+    };
 
-		// near clip
-		if (a.z <= near_clip || b.z <= near_clip || c.z <= near_clip) {
-		    continue;
-		}
-		// far clip
-		if (a.w >= far_clip || b.w >= far_clip || c.w >= far_clip) {
-		    continue;
-		}
+    struct Input_Event {
+	Input_Type type;
+	// virtual key code (VK_*, 'A'..'Z', '0'..'9') for key events
+	int key = 0;
+	int x = 0;
+	int y = 0;
+	// steady_clock time since its epoch, when the event was sampled
+	int64_t time_ns = 0;
+    };
 
-		draw_line_color(a.x, a.y, b.x, b.y, wire_col);
-		draw_line_color(a.x, a.y, c.x, c.y, wire_col);
-		draw_line_color(c.x, c.y, b.x, b.y, wire_col);
-	    }
+    // single producer single consumer ring buffer without locks: only the producer writes
+    // tail and only the consumer writes head. capacity has to be a power of two
+    template <class T, size_t capacity>
+    struct Spsc_Queue {
+	static_assert((capacity & (capacity - 1)) == 0);
+
+	std::array<T, capacity> items;
+	// own cache lines, so the two threads don't invalidate each other's index
+	alignas(64) std::atomic<size_t> head = 0;
+	alignas(64) std::atomic<size_t> tail = 0;
+
+	// producer, false if the queue is full
+	bool push(const T& item) {
+	    size_t t = tail.load(std::memory_order_relaxed);
+	    if (t - head.load(std::memory_order_acquire) == capacity) return false;
+	    items[t & (capacity - 1)] = item;
+	    tail.store(t + 1, std::memory_order_release);
+	    return true;
 	}
 
-	void draw_triangles() {
-	    using namespace gmath;
-
-	    reset_z();
-
-
-	    // camera always at id = 0, so other objects start at 1
-	    size_t obj_id = 1;
-
-	    for (int i = 0; i < faces.size(); i++) {
-		Color debug_col = PURPLE;
+	// consumer, false if the queue is empty
+	bool pop(T& item) {
+	    size_t h = head.load(std::memory_order_relaxed);
+	    if (h == tail.load(std::memory_order_acquire)) return false;
+	    item = items[h & (capacity - 1)];
+	    head.store(h + 1, std::memory_order_release);
+	    return true;
+	}
 
-		if (i >= (ranges[obj_id].start + ranges[obj_id].count) ) {
-		    obj_id++;
-		}
-		assert(obj_id < objects.size());
-		assert(obj_id < transforms.size());
-		    
-		const Face& face = faces[i];
+	// producer, pushes so far. an item is consumed once consumed() went past its pushed() - 1
+	size_t pushed() const {
+	    return tail.load(std::memory_order_relaxed);
+	}
 
-		int tex_id = face.tex_index;
+	size_t consumed() const {
+	    return head.load(std::memory_order_acquire);
+	}
+    };
 
-		const Vec4 a = vertices_viewport[face.vs[0].v_index];
-		const Vec4 b = vertices_viewport[face.vs[1].v_index];
-		const Vec4 c = vertices_viewport[face.vs[2].v_index];
+    using Input_Queue = Spsc_Queue<Input_Event, 1024>;
 
+    // keys held and the mouse as of the last event applied
+    struct Input_State {
+	std::array<bool, 256> keys = {};
+	// went down since the last poll, so a press and release in between two frames still counts
+	std::array<bool, 256> pressed = {};
+	int mouse_x = 0;
+	int mouse_y = 0;
+	// sample time of the newest event applied
+	int64_t time_ns = 0;
 
-		// backface culling    
-		Vec3 ab = Vec3(a.x, a.y, a.z) - Vec3(b.x, b.y, b.z);
-		Vec3 ac = Vec3(c.x, c.y, c.z) - Vec3(a.x, a.y, a.z);
-		Vec3 normal = gmath::Vec3::cross(ab, ac);
-		normal.normalize();
+	bool down(int key) const {
+	    return key >= 0 && key < 256 && (keys[key] || pressed[key]);
+	}
 
+	void apply(const Input_Event& event);
+    };
 
-		float cam_dot = gmath::dot({0, 0, -1}, normal);
+    // calls sample every period on its own thread, sample pushes events into the queue.
+    // the frame drains it with poll, so input isn't tied to the frame time
+    struct Input_Thread {
+	std::function<void(Input_Thread& input, int64_t now_ns)> sample;
+	std::chrono::microseconds period{1000};
 
-		if (cam_dot < 0.f) {
-		    continue;
-		    tex_id = -1;
-		    debug_col = RED;
-		}
+	Input_Queue queue;
+	std::thread thread;
+	std::atomic<bool> stopping = false;
+	// events sample couldn't push because the queue was full
+	std::atomic<uint64_t> dropped = 0;
 
-		// near clip
-		if (a.z <= near_clip || b.z <= near_clip || c.z <= near_clip) {
-		    continue;
-		}
-		// far clip
-		if (a.z >= far_clip || b.z >= far_clip || c.z >= far_clip) {
-		    continue;
-		}
-		
-		if (tex_id < 0) {
-		    fill_triangle_color({a.x, a.y, a.z}, {b.x, b.y, b.z}, {c.x, c.y, c.z}, debug_col);
-		} 
-		else {
-		    fill_triangle_tex(face);
-		}
-	    }
+	~Input_Thread() {
+	    stop();
 	}
 
-	void clear_pixels(Color c) {
-	    clear_pixels(tex.pixels, tex.width, tex.height, c);
-	}
+	void start();
 
-	void clear_pixels(uint32_t* pixels, int width, int height, Color c) {
-	    assert(pixels && "clear_pixels: pixels = nullptr");
-	    int col = c.to_int();
-	    for(int i = 0; i < width * height; ++i) {
-	        pixels[i] = col;
-	    }
-	}
+	void stop();
 
-	void draw_rec(RectangleI rec, Color col) {
-	    draw_rec(tex.pixels, tex.width, tex.height, rec, col);
-	}
-	void draw_rec(uint32_t* pixels, int width, int height, RectangleI rec, Color col) {
-	    assert(pixels && "draw_rec: pixels = nullptr");
-	    if (rec.x >= width) return;
-	    if (rec.y >= height) return;
-
-	    if (rec.x < 0) {
-		rec.width += rec.x; 
-		rec.x = 0;
-	    }
-	    if (rec.y < 0) {
-		rec.height += rec.y; 
-		rec.y = 0;
-	    }
-	    if (rec.x + rec.width >= width) rec.width = width - 1 - rec.x;
-	    if (rec.y + rec.height >= height) rec.height = height - 1 - rec.y;
-
-	    uint32_t c = col.to_int();
-
-	    for(int y = rec.y; y < rec.y + rec.height; ++y) {
-		for(int x = rec.x; x < rec.x + rec.width; ++x) {
-		    uint64_t index = x + y * width;
-		    if (index >= width * height) {
-			std::println("draw_rec: index = {}, x = {}, y = {} ", index, x, y);
-		    }
-		    assert(index < width * height && "draw rec");
-		    pixels[index] = c;
-		}
-	    }
+	bool running() const {
+	    return thread.joinable();
 	}
 
+	// applies all queued events to state in order, returns how many
+	size_t poll(Input_State& state);
 
-	void line_next_pixel(Line_Data& line, int width, int height) {
-
-	    line.went_down = false;
-
-	    if (line.x1 == line.x2 && line.y1 == line.y2) {
-		line.done = true;
-		return;
-	    }
+	// for sample, false if the frame is too far behind and the queue is full. counted in
+	// dropped, sample should keep the change unseen and push it again on its next call
+	bool push(const Input_Event& event) {
+	    if (queue.push(event)) return true;
+	    dropped++;
+	    return false;
+	}
+    };
 
-	    line.err2 = line.err << 1;
+    // recorded or hand written input, replayed through an Input_Thread e.g. for benchmarks.
+    // one event per line, time in ms from the start of the replay:
+    //   <ms> down|up <key>      key is a letter or digit, or a virtual key code as a number
+    //   <ms> move <x> <y>
+    // lines starting with # are comments
+    struct Input_Script {
+	std::vector<Input_Event> events;
+	size_t next = 0;
 
-	    if (line.err2 > line.dy) {
-		line.err += line.dy;
-		line.x1 += line.sx;
-		//line.xf += line.sx;
-	    }
+	bool load_from_file(const char* filepath);
 
-	    if (line.err2 < line.dx) {
-		line.err += line.dx;
-		line.y1 += line.sy;
-		//line.yf += line.sy;
-		line.went_down = true;
-	    }
+	// pushes the events due at elapsed_ns since the start, stamped with start_ns + their time.
+	// stops at a full queue and goes on from there next time, nothing gets dropped
+	void feed(Input_Queue& queue, int64_t start_ns, int64_t elapsed_ns);
 
-	    //line.pixel_x = line.x1;//line.xf;
-	    //line.pixel_y = line.y1;//line.yf;
+	bool done() const {
+	    return next >= events.size();
 	}
+    };
 
-	void draw_line_color(Line_Data& line, Color color) {
-	    draw_line_color(tex.pixels, tex.width, tex.height, line, color);
-	}
+    inline int64_t steady_now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
 
-	void draw_line_color(int x1, int y1, int x2, int y2, Color color) {
-	    Line_Data line;
-	    line.set_initial(x1, y1, x2, y2);
-	    draw_line_color(tex.pixels, tex.width, tex.height, line, color);
-	}
+    struct Renderer {
 
-	void draw_line_color(uint32_t* pixels, int width, int height, Line_Data& line, Color color) {
-	    assert(pixels);
+#ifndef D3_HEADLESS
+	GLuint gl_tex;
+	GLuint program;
+	HGLRC gl_ctx;
+	// pixel unpack buffers and where they are mapped, see init_pbos
+	std::vector<GLuint> pbos;
+	std::vector<uint32_t*> pbo_pixels;
+#endif
 
-	    //std::println("line : x1 = {}, y1 = {}, x2 = {}, y2 = {}", line.x1, line.y1, line.x2, line.y2);
-	    //std::println("width = {}, height = {}", width, height);
+	std::vector<gmath::Vec4> vertices_world;
+	std::vector<gmath::Vec4> vertices_viewport;
+	std::vector<UV> uvs;
+	std::vector<gmath::Vec3> normals;
+	std::vector<Texture> textures;
+	// write them through obj_set_transform / set_cam_transform, that flags the model
+	std::vector<Transform> transforms;
+	// world space: the parent's model * transforms[i].get_model(). updated by update_models for
+	// the objects with model_dirty and everything below them
+	std::vector<Affine> models;
+	// transforms[i].get_model(), so a moving parent only costs its children a multiplication
+	std::vector<Affine> local_models;
+	std::vector<Object> objects;
+	// object ids with every parent before its children, update_models walks it front to back
+	std::vector<size_t> hierarchy_order;
+	bool hierarchy_changed = true;
+	// per object, set while update_models walks hierarchy_order
+	std::vector<uint8_t> model_updated;
+	std::vector<IndexRange> ranges;
+	std::vector<IndexRange> vertex_ranges;
+	std::vector<IndexRange> normal_ranges;
+	std::vector<Bounds> bounds;
+	// meshlets of each object, indices into meshlets
+	std::vector<IndexRange> meshlet_ranges;
+	std::vector<Meshlet> meshlets;
+	std::vector<Face> faces;
+	// v_index of the 3 corners of every face, filled by push_faces for the cull kernel
+	std::vector<uint32_t> face_corners;
+	std::vector<Instance> instances;
+	std::vector<LodGroup> lod_groups;
+	std::vector<Skin> skins;
+	// skin_vertices splits the skinned vertices and normals into ranges of this size and
+	// spreads them over skin_threads workers of skin_pool, 0 uses every core. a frame with a
+	// single range stays on the calling thread
+	size_t skin_chunk = 8192;
+	int skin_threads = 0;
+	Worker_Pool skin_pool;
 
-	    if (line.dx == 0) {
-		draw_line_vert(line.x1, line.y1, line.y2, color);
-	    }
+	Texture tex;
 
-	    if (line.dy == 0) {
-		draw_line_hor_col(line.x1, line.y1, line.x2, color);
-	    }
+	std::vector<float> z_buffer;
+	// faces of the object currently drawn that survived culling
+	std::vector<uint32_t> visible_faces;
+	// what draw_scene rasterizes, rebuilt every frame by build_draw_list
+	std::vector<Draw_Item> draw_items;
+	std::vector<uint32_t> draw_faces;
+	// per mesh, the draw item whose transform is in vertices_viewport right now
+	std::vector<size_t> mesh_items;
+	// transforms of draw items that had to give up the slots of their mesh
+	std::vector<gmath::Vec4> saved_viewport;
+	std::vector<gmath::Vec4> saved_lit;
+	std::vector<gmath::Vec3> saved_normals_lit;
+
+	Profiler profiler;
+
+	Render_Mode render_mode = RENDER_FORWARD;
+	// messages below this level are not printed
+	Log_Level log_level = LOG_ALL;
+	Render_Stats stats;
+	// fragments per pixel, only filled in RENDER_OVERDRAW
+	std::vector<uint16_t> overdraw;
+	// depth lives in z_buffer, only used in RENDER_DEFERRED
+	G_Buffer g_buffer;
+	Depth_Mode depth_mode = DEPTH_LESS_WRITE;
+
+	// lighting is done for RENDER_FORWARD and RENDER_PREPASS on textured faces with normals
+	Shading shading = SHADING_NONE;
+	std::vector<Light> lights;
+	gmath::Vec3 ambient = {.2f, .2f, .2f};
+	float specular = .3f;
+	int shininess = 32;
+	// lights in kernel form, rebuilt once per frame by transform_vertices
+	std::vector<Light_Data> light_data;
+	Light_Setup light_setup = {};
+	// world space positions and normals of the object transform_object did last,
+	// only written when shading is on
+	std::vector<gmath::Vec4> vertices_lit;
+	std::vector<gmath::Vec3> normals_lit;
 
-	    while (!line.done) {
-		if (line.x1 >= 0 && line.x1 < width && line.y1 >= 0 && line.y1 < height) {
-		    size_t index = line.x1 + line.y1 * width;
-		    pixels[index] = color.to_int();
-		    //std::println("accepted pixel = {} {}", line.pixel_x, line.pixel_y);
-		}
+	float far_clip = 10.f;
+	float near_clip = .4f;
+	float fov = gmath::PI / 2.f;
+	// fraction a lod threshold has to be crossed by before switching, avoids popping
+	float lod_hysteresis = 0.15f;
 
-		line_next_pixel(line, width, height);
-	    }
-	}
+	Object camera = {0};
 
-	void draw_line_vert(int x1, int y1, int y2, Color color) {
-	    draw_line_vert(tex.pixels, tex.width, tex.height, x1, y1, y2, color.to_int());
-	}
-	// horizontal line
-	void draw_line_vert(uint32_t* pixels, int width, int height, 
-		int x1, int y1, int y2, uint32_t col) {
+	// clear, transform and span kernels for the best instruction set, see select_kernels
+	const Kernel_Table* kernels = nullptr;
 
-	    if (x1 < 0 || x1 >= width) return;
-	    assert(pixels);
+	// camera view (only redone when the camera moved) and projection, updated in transform_vertices
+	Affine view;
+	gmath::Mat4 projection;
+	// projection * view column by column
+	float view_projection[16] = {0};
+	// view * model per object, written by transform_object. instances overwrite the
+	// slot of their mesh like they do with the viewport vertices
+	std::vector<Affine> model_views;
+	bool meshlet_culling = true;
+	// objects and instances behind the occluders are skipped before they get transformed
+	bool occlusion_culling = true;
+	Occlusion_Buffer occlusion;
 
-	    int dy = std::abs(y2 - y1);
-	    int sy = (y1 < y2) ? 1 : -1;
+	// only the regions that changed since the color target last held a frame get cleared and
+	// rasterized. changes the renderer doesn't see (2d overlays, lights, textures) need
+	// mark_dirty. RENDER_FORWARD and RENDER_PREPASS only, the other modes redraw everything
+	bool incremental = false;
+	// frames since the color target was drawn: 1 if it's the same buffer every frame,
+	// 0 if it holds nothing usable. set from Presenter::submit when presenting async
+	int buffer_age = 1;
+	// regions that changed this frame and have to be uploaded, all of tex if not incremental
+	std::vector<RectangleI> dirty_rects;
+	// dirty_rects of this frame and the buffer_age - 1 before, cleared and drawn this frame
+	std::vector<RectangleI> draw_rects;
+	// dirty_rects of the last frames, newest first
+	std::deque<std::vector<RectangleI>> dirty_history;
+	std::vector<RectangleI> marked_rects;
+	std::vector<Draw_State> object_states;
+	std::vector<Draw_State> instance_states;
+	float last_view_projection[16] = {0};
+	// spans are clipped to it, the draw rect being drawn in incremental mode
+	RectangleI scissor = {0, 0, INT_MAX, INT_MAX};
 
-	    for (int i = 0; i < dy; ++i) {
+	Renderer ();
 
-		if (y1 < height && y1 >= 0.f)
-		    pixels[x1 + y1 * width] = col;
+	~Renderer();
 
-		y1 += sy;
-	    }
-	}
 
-	void draw_line_vert(int x1, int y1, int x2, float u1, float v1, float u2, float v2, const Texture& tex) {
-	    draw_line_vert(tex.pixels, tex.width, tex.height, x1, y1, x2, u1, v1, u2, v2, tex);
-	}
-	// horizontal line
-	void draw_line_vert(uint32_t* pixels, int width, int height, 
-		int x1, int y1, int y2, float u1, float v1, float u2, float v2,  const Texture& tex) {
-	    if (y1 >= height || y1 < 0.f) return;
-	    assert(pixels);
+	bool loadOBJ(const char* filepath, size_t& obj_id, Transform t = {0}, int tex_id = -1);
 
-	    int dy = std::abs(y2 - y1);
-	    int sy = (y1 < y2) ? 1 : -1;
+	Transform get_cam_transform();
 
-	    float u_step = dy == 0 ? 0 : (u2 - u1) / dy;
-	    float v_step = dy == 0 ? 0 : (v2 - v1) / dy;
+	void set_cam_transform(const Transform& t);
 
-	    for (int i = 0; i < dy; ++i) {
 
-		if (y1 < width && y1 >= 0.f)
-		    pixels[x1 + y1 * width] = tex.get_color(u1, v1);
+	size_t push_cube(float side = 1.f, Transform t = {0}, int tex_id = -1);
 
-		y1 += sy;
+	size_t push_object(Transform t = {0}, IndexRange range = {0});	    
 
-		u1 += u_step;
-		v1 += v_step;
-	    }
-	}
+	Bounds get_bounds(IndexRange v_range);
 
-	void draw_line_hor_tex(int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, int tex_id, bool second = false) {
-	    assert(tex_id < textures.size());
-	    draw_line_hor_tex(tex.pixels, tex.width, tex.height, x1, y1, x2, z1, z2, u1, v1, u2, v2, textures[tex_id], second);
-	}
+	// smallest range of vertices_world covering all vertices used by the faces in range
+	IndexRange get_vertex_range(IndexRange range);
 
-	// horizontal line
-	//
-	void draw_line_hor_tex(uint32_t* pixels, int width, int height, 
-		int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, const Texture& tex, bool second = false) {
+	// same for normals, empty if a face points past the pushed normals
+	IndexRange get_normal_range(IndexRange range);
 
-	    assert(pixels);
-	    if (y1 >= height || y1 < 0.f) return;
+	// clusters the faces in range into meshlets of neighbors with similar normals and reorders
+	// them so every meshlet is a consecutive run, returns their range in meshlets
+	IndexRange build_meshlets(IndexRange range);
 
-	    int dx = std::abs(x2 - x1);
-	    int sx = (x1 < x2) ? 1 : -1;
+	size_t push_instance(size_t mesh_id, Transform t = {0}, int tex_id = -1);
 
-	    float z1_reci = 1.f / z1;
-	    float z2_reci = 1.f / z2;
-	    u1 *= z1_reci;
-	    v1 *= z1_reci;
-	    u2 *= z2_reci;
-	    v2 *= z2_reci;
+	void instance_set_transform(size_t instance_id, const Transform& t);
 
-	    float u_step = dx == 0 ? 0 : (u2 - u1) / dx;
-	    float v_step = dx == 0 ? 0 : (v2 - v1) / dx;
-	    float z_reci_step = dx == 0 ? 0 : (z2_reci - z1_reci) / dx;
+	// mesh_ids most detailed first, min_sizes has count - 1 entries (see LodGroup),
+	// the meshes get hidden since they are only drawn through the group
+	size_t push_lod_group(const size_t* mesh_ids, const float* min_sizes, size_t count, Transform t = {0}, int tex_id = -1);
 
+	// copies the geometry of obj_id with indices rebased to the mesh
+	Mesh get_mesh(size_t obj_id);
 
+	size_t push_mesh(const Mesh& mesh, Transform t = {0});
 
-	    for (int i = 0; i < dx; ++i) {
+	// simplifies obj_id down to each of the face_counts in parallel and groups the results
+	// with obj_id as most detailed level, min_sizes has count entries (see LodGroup)
+	size_t build_lod_group(size_t obj_id, const size_t* face_counts, const float* min_sizes, size_t count, Transform t = {0}, int tex_id = -1);
 
-		float z = 1.f / z1_reci;
-		if (x1 < width && x1 >= 0.f) {
-		    size_t index = x1 + y1 * width;
-		    if (z < z_buffer[index]) {
-			uint32_t col = (second ? RED.to_int() : tex.get_color(u1 * z, v1 * z));
-			pixels[index] = col;
-			z_buffer[index] = z;
-		    }
+	void lod_group_set_transform(size_t group_id, const Transform& t);
 
-		}
-		x1 += sx;
+	// projected diameter in pixels of the bounding sphere of obj_id placed by model
+	float projected_size(size_t obj_id, const Affine& model);
 
-		u1 += u_step;
-		v1 += v_step ;
-		z1_reci += z_reci_step;
+	// puts every group on the level its projected size calls for, several levels at once if the
+	// size jumped. a threshold only counts as crossed once it's passed by more than lod_hysteresis
+	void select_lods();
 
-	    }
-	}
+	// hidden objects are skipped by transform_vertices and draw_triangles, but can still be instanced
+	void obj_set_visible(size_t obj_id, bool visible);
 
-	void draw_line_hor_col_z(int x1, int y1, int x2, float z1, float z2, Color col) {
-	    draw_line_hor_col_z(tex.pixels, tex.width, tex.height, x1, y1, x2, z1, z2, col.to_int());
-	}
+	// occluders should be few large faces, walls and floors rather than detailed meshes
+	void obj_set_occluder(size_t obj_id, bool occluder);
+	
+	void push_vertices(const gmath::Vec4* verts, size_t count);
+	
+	void push_uvs(const UV* uvs, size_t count);
 
-	void draw_line_hor_col_z(uint32_t* pixels, int width, int height, int x1, int y1, int x2, float z1 = 0, float z2 = 0, uint32_t col = PURPLE.to_int()) {
+	void push_normals(const gmath::Vec3* normals, size_t count);
 
-	    if (y1 >= height || y1 < 0.f) return;
-	    assert(pixels);
+	void push_faces(const Face* faces, size_t count);
 
-	    int dx = std::abs(x2 - x1);
-	    int sx = (x1 < x2) ? 1 : -1;
+	void obj_set_transform(size_t obj_id, const Transform& t);
 
+	// obj_id then moves with parent_id, its transform becomes relative to the parent's.
+	// no_parent detaches it. the camera can't be part of the hierarchy
+	void obj_set_parent(size_t obj_id, size_t parent_id);
 
-	    float z_step = dx == 0 ? 0 : (z2 - z1) / dx;
+	// makes obj_id skinned, weights has one entry per vertex of vertex_ranges[obj_id] and
+	// bones below bone_count. the current vertices and normals become the bind pose and every
+	// bone starts out as identity. normal_weights has one entry per normal of
+	// normal_ranges[obj_id], without it a normal follows the first vertex it's used with
+	void obj_set_skin(size_t obj_id, const Bone_Weights* weights, size_t bone_count, const Bone_Weights* normal_weights = nullptr);
 
-	    for (int i = 0; i < dx; ++i) {
+	// the palette for the next frame: per bone, its object space model * the inverse of its
+	// bind pose, without scale since the normals go through it too. count has to be the
+	// bone_count of obj_set_skin
+	void obj_set_bones(size_t obj_id, const Affine* bones, size_t count);
 
-		if (x1 < width && x1 >= 0.f) {
-		    size_t index = x1 + y1 * width;
-		    if (z1 < z_buffer[index]) {
-		        pixels[index] = col;
-		        z_buffer[index] = z1;
-		    }
-		}
+#ifndef D3_HEADLESS
+	void init_texture();
 
-		x1 += sx;
-		z1 += z_step;
-	    }
-	}
+	void init_gl(HDC hdc);
+#endif // D3_HEADLESS
 
-	void draw_line_hor_col(int x1, int y1, int x2, Color col) {
-	    draw_line_hor_col(tex.pixels, tex.width, tex.height, x1, y1, x2, col.to_int());
-	}
+	// color target and z buffer, the window does this on creation
+	void init_framebuffer(int width, int height);
 
-	void draw_line_hor_col(uint32_t* pixels, int width, int height, int x1, int y1, int x2, uint32_t col) {
+	void init_z();
 
-	    if (y1 >= height || y1 < 0.f) return;
-	    assert(pixels);
+	// only the draw_rects in incremental mode
+	void reset_z();
 
-	    int dx = std::abs(x2 - x1);
-	    int sx = (x1 < x2) ? 1 : -1;
+#ifndef D3_HEADLESS
+	void draw_tex(HDC hdc);
 
+	// uploads the dirty regions (all if empty) of pixels (tex.width x tex.height) and swaps, on
+	// whatever thread has gl_ctx current. pixels from pbo_pixels are copied on the gpu and
+	// waited for before returning
+	void draw_tex(HDC hdc, const uint32_t* pixels, const std::vector<RectangleI>& dirty = {});
 
-	    for (int i = 0; i < dx; ++i) {
+	// count persistently mapped pixel buffer objects of tex's size, needs gl_ctx current.
+	// false if glBufferStorage (gl 4.4) is missing, the upload then reads client memory
+	bool init_pbos(int count);
 
-		if (x1 < width && x1 >= 0.f) {
-		    size_t index = x1 + y1 * width;
-		    pixels[index] = col;
-		}
+	// unmaps and deletes the pbos, needs gl_ctx current and nothing rasterizing into pbo_pixels
+	void release_pbos();
+#endif // D3_HEADLESS
 
-		x1 += sx;
-	    }
-	}
+	void transform_vertices();
 
-	void draw_line_blend(int x1, int y1, int x2, int y2, Color start, Color end) {
-	    draw_line_blend(tex.pixels, tex.width, tex.height, x1, y1, x2, y2, start, end);
-	}
+	// skins the vertices and normals of every skin whose palette changed into vertices_world
+	// and normals and refits their bounds, before anything gets projected. called by
+	// transform_vertices
+	void skin_vertices();
 
-	void draw_line_blend(uint32_t* pixels, int width, int height, 
-		int x1, int y1, int x2, int y2, Color start, Color end) {
-
-	    assert(pixels);
-	    
-
-	    int dx = std::abs(x2 - x1);
-	    int sx = (x1 < x2) ? 1 : -1;
-
-	    int dy = -std::abs(y2 - y1);
-	    int sy = (y1 < y2) ? 1 : -1;
-
-	    int err = dx + dy;
-	    int e2;
-	    gmath::Vec3 v = {(float)x2 - x1, (float)y2 - y1, 0};
-	    float length = v.length();
-	    float t = 0.f;
-
-	    while (true) {
-		if ((uint32_t)(x1 + y1 * width) < width * height) {
-		    int color = lerp_color(start, end, t).to_int();
-		    pixels[x1 + y1 * width] = color;
-		}
-		
-		if (x1 == x2 && y1 == y2)
-		    break;
-
-		e2 = err << 1;
-
-		if (e2 > dy) {
-		    err += dy;
-		    x1 += sx;
-		}
-
-		if (e2 < dx) {
-		    err += dx;
-		    y1 += sy;
-		}
-		v.x = x2 - x1;
-		v.y = y2 - y1;
-		t = (length - v.length()) / length;
-		//std::println("p1 : {} {} , p2 : {} {}, index = {}", x1, y1, x2, y2, index);
-	    }
-	}
+	// the view if the camera moved and the models of the objects and instances whose transform
+	// changed, children of a changed object included. called by transform_vertices
+	void update_models();
 
-	void fill_triangle_tex(const Face& face) {
-	    assert(tex.pixels);
+	// sorts the objects by their depth in the hierarchy into hierarchy_order
+	void sort_hierarchy();
 
-	    int indices_sorted[3] = {0, 1, 2};
+	// transforms the visible occluders and rasterizes their faces that pass cull_faces into
+	// occlusion, called by transform_vertices
+	void build_occlusion();
 
-	    const gmath::Vec4& a = vertices_viewport[face.vs[0].v_index];
-	    const gmath::Vec4& b = vertices_viewport[face.vs[1].v_index];
-	    const gmath::Vec4& c = vertices_viewport[face.vs[2].v_index];
+	// true if the bounding box of obj_id placed by model is behind the occlusion buffer everywhere
+	// it could cover, needs the view of this frame but not the vertices of obj_id
+	bool object_occluded(size_t obj_id, const Affine& model) const;
 
-	    sort_y(a, b, c, indices_sorted);
-	    // set start point lowest vertex (cursed)
-	    gmath::Vec4 p1 = vertices_viewport[face.vs[indices_sorted[0]].v_index];
-	    gmath::Vec4 p2 = p1;
+	// screen rect (min x, min y, max x, max y) and closest depth of the bounding box of obj_id
+	// placed by model. false if the box reaches in front of the near plane
+	bool project_bounds(size_t obj_id, const Affine& model, float rect[4], float& closest) const;
 
-	    float p1_u = uvs[face.vs[indices_sorted[0]].uv_index].u;
-	    float p1_v = uvs[face.vs[indices_sorted[0]].uv_index].v;
-	    float target1_u = uvs[face.vs[indices_sorted[1]].uv_index].u;
-	    float target1_v = uvs[face.vs[indices_sorted[1]].uv_index].v;
+	// pixels obj_id placed by model can touch, with a margin for the rasterizer. all of tex if the
+	// box reaches in front of the near plane, width 0 if it's off screen
+	RectangleI screen_rect(size_t obj_id, const Affine& model) const;
 
-	    float p2_u = uvs[face.vs[indices_sorted[0]].uv_index].u;
-	    float p2_v = uvs[face.vs[indices_sorted[0]].uv_index].v;
-	    float target2_u = uvs[face.vs[indices_sorted[2]].uv_index].u;
-	    float target2_v = uvs[face.vs[indices_sorted[2]].uv_index].v;
+	// the region changes this frame, for the next update_dirty
+	void mark_dirty(RectangleI rect);
 
-	    // choose target (end points of lines) based on lowest vertex by sorted index
-	    gmath::Vec4 target1 = vertices_viewport[face.vs[indices_sorted[1]].v_index];
-	    gmath::Vec4 target2 = vertices_viewport[face.vs[indices_sorted[2]].v_index];
+	// compares every object and instance to the last frame and fills dirty_rects and
+	// draw_rects, called by transform_vertices in incremental mode
+	void update_dirty();
 
+	// fills light_data and light_setup from lights and the camera
+	void update_lights();
 
-	    Line_Data line1;
-	    Line_Data line2;
+	// writes the viewport positions of the vertices of obj_id placed by model,
+	// instances of the same mesh reuse these slots one after another
+	void transform_object(size_t obj_id, const Affine& model);
 
-	    line1.set_initial(p1.x, p1.y, target1.x, target1.y);
-	    line2.set_initial(p2.x, p2.y, target2.x, target2.y);
+	void draw_triangles_wireframe(Color wire_col);
 
-	    float dist1 = line1.length();
-	    float dist2 = line2.length();
+	void draw_triangles();
 
-	    // toggle to show the second triangle in a different way for debugging
-	    bool second = false;
+	// occlusion tests, transforms and culls the visible objects and instances once into
+	// draw_items, skipping what can't reach into a draw rect in incremental mode
+	void build_draw_list();
 
-	    // horizontal line from p1 - target1, draw and skip
-	    if (line1.dy == 0) {
+	// rasterizes draw_items, each within every draw rect it reaches in incremental mode.
+	// doesn't clear or select lods
+	void draw_scene();
 
+	// black for untouched pixels, then blue -> green -> yellow -> red at 8+ fragments
+	void draw_overdraw();
 
-	        draw_line_hor_tex(p1.x, p1.y, target1.x, p1.z, target1.z, p1_u, p1_v, target1_u, target1_v, face.tex_index);
+	// samples the texture of every g buffer pixel into the color target, pixels
+	// without a textured fragment keep their color
+	void resolve_g_buffer();
 
-	        p1 = vertices_viewport[face.vs[indices_sorted[1]].v_index];
-	        target1 = vertices_viewport[face.vs[indices_sorted[2]].v_index];
+	// culls obj_id (transformed already) and adds it to draw_items if any face is left
+	void add_draw_item(size_t obj_id, int tex_id, RectangleI rect);
 
-		p1_u = uvs[face.vs[indices_sorted[1]].uv_index].u;
-		p1_v = uvs[face.vs[indices_sorted[1]].uv_index].v;
-		target1_u = uvs[face.vs[indices_sorted[2]].uv_index].u;
-		target1_v = uvs[face.vs[indices_sorted[2]].uv_index].v;
+	// copies the transform of the item in the slots of mesh_id out, if not done yet, before
+	// something else gets written there
+	void free_mesh_slots(size_t mesh_id);
 
-		line1.set_initial(p1.x, p1.y, target1.x, target1.y);
-		dist1 = line1.length();
-	    }
+	// puts the transform of draw_items[item] back into the slots of its mesh
+	void load_draw_item(size_t item);
 
-	    while (!line2.done) {
+	// fills visible_faces with the faces of obj_id that face the camera and are within the clip planes,
+	// one kernels->cull_faces pass over the screen positions of every meshlet that survived
+	void cull_faces(size_t obj_id);
 
-		if (!line1.went_down) {
-		    line_next_pixel(line1, tex.width, tex.height);
+	// view space frustum and normal cone test, conservative: false only if every face
+	// of the meshlet would be culled or rejected by the clip planes anyway
+	bool meshlet_visible(const Meshlet& meshlet, const Affine& model_view) const;
 
-		    if (line1.done) {
-			//std::println("BEFORE:\np1: {}, {}", line1.x1, line1.y1);
-			//std::println("target1: {}", target1.to_str());
-			p1 = vertices_viewport[face.vs[indices_sorted[1]].v_index];
-			target1 = vertices_viewport[face.vs[indices_sorted[2]].v_index];
-			//line1.set_initial(p1.x, p1.y, target1.x, target1.y);
-			line1.set_initial(p1.x, p1.y, target1.x, target1.y);
-			dist1 = line1.length();
-			//std::println("AFTER:\ndist1 = {}, v.length = {}", dist1, v.length());
-			//std::println("p1: {}, {}", line1.x1, line1.y1);
-			//std::println("target1: {}", target1.to_str());
-			second = false;
-		    }
-		}
+	// tex_id < 0 uses the texture of each face
+	void raster_faces(const uint32_t* face_ids, size_t count, int tex_id = -1);
 
-		if (!line2.went_down) {
-		    line_next_pixel(line2, tex.width, tex.height);
-		}
+	// only the draw_rects in incremental mode
+	void clear_pixels(Color c);
 
-		if (line1.went_down && line2.went_down) {
-		    line1.went_down = false;
-		    line2.went_down = false;
+	void clear_pixels(uint32_t* pixels, int width, int height, Color c);
 
+	void draw_rec(RectangleI rec, Color col);
+	void draw_rec(uint32_t* pixels, int width, int height, RectangleI rec, Color col);
 
 
-		    float z1_recip = 1.f / p1.z;
-		    float z2_recip = 1.f / p2.z;
+	void line_next_pixel(Line_Data& line, int width, int height);
 
-		    float zt1_recip = 1.f / target1.z;
-		    float zt2_recip = 1.f / target2.z;
+	void draw_line_color(Line_Data& line, Color color);
 
-		    float t = 1.f - line1.length() / dist1;
-		    float u1 = gmath::lerpf(p1_u * z1_recip, target1_u * zt1_recip, t);
-		    float v1 = gmath::lerpf(p1_v * z1_recip, target1_v * zt1_recip, t);
-		    //float u1 = gmath::lerpf(p1.u, target1.u, t);
-		    //float v1 = gmath::lerpf(p1.v, target1.v, t);
-		    float z1 = gmath::lerpf(p1.z, target1.z, t);
+	void draw_line_color(int x1, int y1, int x2, int y2, Color color);
 
-		    float zi1 = 1.f / gmath::lerpf(z1_recip, zt1_recip, t);
+	void draw_line_color(uint32_t* pixels, int width, int height, Line_Data& line, Color color);
 
+	void draw_line_vert(int x1, int y1, int y2, Color color);
+	// horizontal line
+	void draw_line_vert(uint32_t* pixels, int width, int height, 
+		int x1, int y1, int y2, uint32_t col);
 
-		    t = 1.f - line2.length() / dist2;
-		    float u2 = gmath::lerpf(p2_u * z2_recip, target2_u * zt2_recip, t);
-		    float v2 = gmath::lerpf(p2_v * z2_recip, target2_v * zt2_recip, t);
-		    float z2 = gmath::lerpf(p2.z, target2.z, t);
+	void draw_line_vert(int x1, int y1, int x2, float u1, float v1, float u2, float v2, const Texture& tex);
+	// horizontal line
+	void draw_line_vert(uint32_t* pixels, int width, int height, 
+		int x1, int y1, int y2, float u1, float v1, float u2, float v2,  const Texture& tex);
 
-		    float zi2 = 1.f / gmath::lerpf(z2_recip, zt2_recip, t);
+	void draw_line_hor_tex(int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, int tex_id, bool second = false);
 
-		    draw_line_hor_tex(line1.x1, line1.y1, line2.x1, zi1, zi2, u1 * zi1, v1 * zi1, u2 * zi2, v2 * zi2, face.tex_index, second);
-		}
-	    }
-	}
+	// clips the span to the row and fills span.count, z and uv steps. returns false if nothing is left,
+	// span.pixels and span.z_buffer are set relative to pixels and z_buffer
+	// with light set, the 6 lighting varyings a1 / a2 at both ends get the same treatment as uv
+	bool setup_span_tex(uint32_t* pixels, int width, int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, Span_Tex& span,
+		const float* a1 = nullptr, const float* a2 = nullptr, Span_Light* light = nullptr);
 
-	void fill_triangle_color(gmath::Vec3 a, gmath::Vec3 b, gmath::Vec3 c, Color col) {
-	    using namespace gmath;
-	    assert(tex.pixels);
+	// draw_line_hor_tex with lighting, a1 / a2 are the Span_Light varyings at both ends
+	void draw_line_hor_tex_lit(int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, const float a1[6], const float a2[6], int tex_id);
 
-	    Line_Data line1;
-	    Line_Data line2;
+	// deferred version of draw_line_hor_tex, writes depth, uv and tex_id into the g buffer
+	void draw_line_hor_g_buffer(int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, int tex_id);
 
-	    int indices_sorted[3] = {0, 1, 2};
+	// horizontal line
+	//
+	void draw_line_hor_tex(uint32_t* pixels, int width, int height, 
+		int x1, int y1, int x2, float z1, float z2, float u1, float v1, float u2, float v2, const Texture& tex, bool second = false);
 
-	    sort_y(a, b, c, indices_sorted);
-	    Vec3* vs[3] = {
-			(indices_sorted[0] == 0 ? &a : (indices_sorted[0] == 1 ? &b : &c)),
-			(indices_sorted[1] == 0 ? &a : (indices_sorted[1] == 1 ? &b : &c)),
-			(indices_sorted[2] == 0 ? &a : (indices_sorted[2] == 1 ? &b : &c)),
-	    };
-	    // set start point lowest vertex (cursed)
-	    Vec3 p1 = *vs[0];
-	    Vec3 p2 = p1;
-
-	    // choose target (end points of lines) based on lowest vertex by sorted index
-	    Vec3 target1 = *vs[1];
-	    Vec3 target2 = *vs[2];
-
-	    line1.set_initial(p1.x, p1.y, target1.x, target1.y);
-	    line2.set_initial(p2.x, p2.y, target2.x, target2.y);
-
-	    float dist1 = line1.length();
-	    float dist2 = line2.length();
-
-	    // horizontal line from p1 - target1, draw and skip
-	    if (line1.dy == 0) {
-		draw_line_hor_col_z(p1.x, p1.y, target1.x, p1.z, target1.z, col);
-		p1 = target1;
-		target1 = *vs[2];
-		line1.set_initial(p1.x, p1.y, target1.x, target1.y);
-		dist1 = line1.length();
-	    }
+	void draw_line_hor_col_z(int x1, int y1, int x2, float z1, float z2, Color col);
 
-	    while (!line2.done) {
+	void draw_line_hor_col_z(uint32_t* pixels, int width, int height, int x1, int y1, int x2, float z1 = 0, float z2 = 0, uint32_t col = PURPLE.to_int());
 
-		if (!line1.went_down) {
-		    line_next_pixel(line1, tex.width, tex.height);
+	void draw_line_hor_col(int x1, int y1, int x2, Color col);
 
-		    if (line1.done) {
-			p1 = target1;
-			target1 = *vs[2];
-			line1.set_initial(p1.x, p1.y, target1.x, target1.y);
-			dist1 = line1.length();
-		    }
-		}
+	void draw_line_hor_col(uint32_t* pixels, int width, int height, int x1, int y1, int x2, uint32_t col);
 
-		if (!line2.went_down) {
-		    line_next_pixel(line2, tex.width, tex.height);
-		}
+	void draw_line_blend(int x1, int y1, int x2, int y2, Color start, Color end);
 
-		if (line1.went_down && line2.went_down) {
-		    line1.went_down = false;
-		    line2.went_down = false;
+	void draw_line_blend(uint32_t* pixels, int width, int height, 
+		int x1, int y1, int x2, int y2, Color start, Color end);
 
-		    float t = 1.f - line1.length() / dist1;
-		    float z1 = gmath::lerpf(p1.z, target1.z, t);
+	void fill_triangle_tex(const Face& face);
 
-		    t = 1.f - line2.length() / dist2;
-		    float z2 = gmath::lerpf(p2.z, target2.z, t);
+	void fill_triangle_tex(const Face& face, int tex_id);
 
-		    draw_line_hor_col_z(line1.x1, line1.y1, line2.x1, z1, z2, col);
-		}
-	    }
-	}
+	void fill_triangle_color(gmath::Vec3 a, gmath::Vec3 b, gmath::Vec3 c, Color col);
 
     };
 
+#ifndef D3_HEADLESS
     struct Window {
 	uint32_t width = 0;
 	uint32_t height = 0;
 	const char* name = nullptr;
 
 	Renderer renderer;
+	// owns the gl context while running, renderer.tex is then one of its buffers
+	Presenter presenter;
+	// keyboard and mouse sampled on their own thread, begin_frame polls them into input_state
+	Input_Thread input;
+	Input_State input_state;
 
 	HWND hwnd;
 	HDC hdc;
 	MSG msg;
 
 	bool is_open = false;
-	Timer timer;
-	int frametime = ((uint64_t)(1000.f / 60.f));
-
-
-	Window(uint64_t width, uint64_t height, const char* name):
-	width(width), height(height), name(name){
-
-	    std::println("Renderer objects count in window constructor = {}", renderer.objects.size());
-	    renderer.tex.from_color(width, height, BLACK.to_int());
-
-	    HINSTANCE hInstance = GetModuleHandle(nullptr);
-	    
-	    WNDCLASS window_class = {};
-	    window_class.lpfnWndProc = WindowProc;
-	    window_class.hInstance = hInstance;
-	    window_class.lpszClassName = "Window";
-	    
-	    RegisterClass(&window_class);
-
-	    RECT r = {0, 0, (long)width, (long)height};
-	    AdjustWindowRect(&r, WS_OVERLAPPEDWINDOW, FALSE);
-
-	    hwnd = CreateWindowEx(
-				    0, 
-				    window_class.lpszClassName, 
-				    name, 
-				    WS_OVERLAPPEDWINDOW, 
-				    0, 0, r.right - r.left, r.bottom - r.top, 
-				    nullptr, nullptr, hInstance, nullptr);
-
-	    if (hwnd == nullptr) {
-			std::println("ERROR: could not create Window class : {}, name :  {}", window_class.lpszClassName, name);
-			exit(0);
-	    }
+	Frame_Scheduler scheduler;
+	// vsync, set by set_target_fps. applied by whichever thread has the gl context
+	std::atomic<int> swap_interval = 1;
+	int applied_swap_interval = 1;
 
-	    hdc = GetDC(hwnd);
-	    if (hdc == nullptr) {
-			std::println("ERROR: could not obtain device context");
-			exit(0);
-	    } 
 
-	    renderer.init_gl(hdc);
-	    
+	// async_present uploads and swaps on the presenter thread instead of in end_frame
+	Window(uint64_t width, uint64_t height, const char* name, bool async_present = true);
 
-	    renderer.init_z();
+	~Window();
 
-	    show(SW_SHOW);
+	void show(int nCmdShow);
 
-	    is_open = true;
-	}
+	void begin_frame();
 
-	~Window() {
-	    CloseWindow(hwnd);
-	    PostQuitMessage(0);
-	}
-
-	void show(int nCmdShow) {
-	    ShowWindow(hwnd, nCmdShow);
-	}
-
-	void begin_frame() {
+	void end_frame();
 
-	    timer.start();
-	    //renderer.clear_pixels(WHITE);
+	void draw();
 
-	    while (PeekMessage(&msg, nullptr, 0,0, PM_REMOVE)) {
-		TranslateMessage(&msg);
-		DispatchMessage(&msg);
-	    }
+	// wglSwapIntervalEXT if swap_interval changed, needs the gl context
+	void apply_swap_interval();
 
-	    if (GetAsyncKeyState(VK_ESCAPE) & 0x8000 || msg.message == WM_QUIT) {
-		is_open = false;
-	    }
-	}
-
-	void end_frame() {
-	    draw();
-
-	    int delta_mills = timer.get_delta_mills();
-	    if (delta_mills < frametime) {
-		timer.busy_wait(frametime - delta_mills);
-	    }
-	}
-
-	void draw() {
-	    renderer.draw_tex(hdc);
-	}
-
-
-	void set_target_fps(int fps) {
-	    frametime = ((uint64_t)(1000.f / fps));
-	}
+	// fps <= 0 runs uncapped: no wait in end_frame and no vsync
+	void set_target_fps(int fps);
 
     };
+#endif // D3_HEADLESS
 
 
 } // d3
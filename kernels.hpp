@@ -0,0 +1,150 @@
+#ifndef D3_KERNELS_HPP
+#define D3_KERNELS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// hot loops of the renderer, compiled once per instruction set (kernels_sse2.cpp,
+// kernels_avx2.cpp, kernels_avx512.cpp) and picked at runtime.
+// only plain pointers cross this interface, the kernel files must not include d3.hpp
+// or gmath: inline functions from there would get compiled with avx flags and the
+// linker is free to keep that copy for the whole program
+namespace d3 {
+
+    enum Isa {
+	ISA_SSE2, ISA_AVX2, ISA_AVX512, ISA_COUNT
+    };
+
+    constexpr const char* isa_names[ISA_COUNT] = {"sse2", "avx2", "avx512"};
+
+    struct Texture_View {
+	const uint32_t* pixels;
+	int width;
+	int height;
+    };
+
+    // horizontal span that is already clipped to the color target, left to right.
+    // u and v are divided by z and get multiplied back per pixel
+    struct Span_Tex {
+	uint32_t* pixels;
+	float* z_buffer;
+	int count;
+	// pixels before begin are skipped (scissor). the interpolation still counts from pixel 0,
+	// so a pixel gets the same value no matter where the span is cut
+	int begin = 0;
+	float z_reci;
+	float z_reci_step;
+	float u;
+	float u_step;
+	float v;
+	float v_step;
+	// pixels == nullptr fills the span with color instead
+	Texture_View tex;
+	uint32_t color;
+	// for the pass after a depth prepass: span_tex passes z <= z_buffer and stores z one ulp
+	// closer, so a later fragment at the same depth fails like with the strict test
+	bool depth_equal = false;
+    };
+
+    // deferred span output, each pointer starts at the first pixel of the span
+    struct Span_G_Buffer {
+	float* u;
+	float* v;
+	int32_t* tex_id;
+	int32_t tex_value;
+    };
+
+    struct Light_Data {
+	// directional lights: normalized direction towards the light, point lights: position
+	float vector[3];
+	// color * intensity
+	float color[3];
+	// 0 for directional lights, point lights fade out linearly until range
+	float range;
+    };
+
+    // blinn-phong: texel * (ambient + sum diffuse) + sum specular, diffuse and specular are
+    // attenuated per light and the specular highlight takes the light color
+    struct Light_Setup {
+	const Light_Data* lights;
+	int light_count;
+	float ambient[3];
+	float camera[3];
+	float specular;
+	int shininess;
+    };
+
+    // lit span, the varyings are divided by z like Span_Tex::u / v.
+    // gouraud: diffuse rgb and specular rgb, lit at the corners.
+    // phong: world space normal xyz and position xyz, lit per pixel
+    struct Span_Light {
+	float varyings[6];
+	float steps[6];
+	const Light_Setup* setup;
+    };
+
+    // faces rejected by cull_faces, per test
+    struct Cull_Counts {
+	uint64_t backface;
+	uint64_t near;
+	uint64_t far;
+    };
+
+    struct Kernel_Table {
+	Isa isa;
+
+	void (*fill_u32)(uint32_t* dst, size_t count, uint32_t value);
+
+	void (*fill_f32)(float* dst, size_t count, float value);
+
+	// dst = M * src for count xyzw vectors, cols holds the 4 columns of M
+	void (*transform_vec4)(const float* src, float* dst, size_t count, const float cols[16]);
+
+	// linear blend skinning of count xyzw vectors: dst = (sum w_k * B_k) * src over the 4 bones
+	// and weights of each vector. palette holds the 4 columns of every bone matrix B, bones
+	// index into it (4 per vector) and weights are 4 per vector, unused slots have weight 0
+	void (*skin_vec4)(const float* src, const uint16_t* bones, const float* weights, const float* palette, float* dst, size_t count);
+
+	// backface, near and far test for count faces. corners has the 3 vertex indices of each face
+	// into vertices (screen x, y, depth z, w). appends first + i for every face i that passes
+	// to visible and returns how many, the rejected ones are added to counts
+	size_t (*cull_faces)(const float* vertices, const uint32_t* corners, size_t count, uint32_t first,
+		float near_clip, float far_clip, uint32_t* visible, Cull_Counts& counts);
+
+	// depth test, z write and texture fetch, returns the fragments that passed
+	size_t (*span_tex)(const Span_Tex& span);
+
+	// span_tex with the texel multiplied by the interpolated light, see Span_Light
+	size_t (*span_tex_gouraud)(const Span_Tex& span, const Span_Light& light);
+
+	size_t (*span_tex_phong)(const Span_Tex& span, const Span_Light& light);
+
+	// lights count points, in: normal xyz, position xyz per point. out: diffuse rgb, specular rgb
+	void (*light_points)(const Light_Setup& setup, const float* in, float* out, size_t count);
+
+	// z test and z write only, for the depth prepass. span.pixels and span.tex are not used
+	size_t (*span_depth)(const Span_Tex& span);
+
+	// like span_tex, but stores the perspective correct uv and tex_value instead of sampling.
+	// span.pixels and span.tex are not used
+	size_t (*span_g_buffer)(const Span_Tex& span, const Span_G_Buffer& out);
+
+	// nearest texel for count uv pairs, same rounding as Texture::get_color
+	void (*sample_tex)(Texture_View tex, const float* u, const float* v, uint32_t* out, size_t count);
+    };
+
+    extern const Kernel_Table kernels_sse2;
+    extern const Kernel_Table kernels_avx2;
+    extern const Kernel_Table kernels_avx512;
+
+    // highest level the cpu and the os (saved register state) support
+    Isa detect_isa();
+
+    // detect_isa, lowered by the D3_ISA environment variable (sse2, avx2, avx512) if set
+    const Kernel_Table& select_kernels();
+
+    const Kernel_Table& get_kernels(Isa isa);
+
+} // d3
+
+#endif // D3_KERNELS_HPP
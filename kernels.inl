@@ -0,0 +1,1153 @@
+// included by kernels_sse2.cpp, kernels_avx2.cpp and kernels_avx512.cpp, which set
+// D3_KERNEL_ISA / D3_KERNEL_TABLE. the code path is picked from the compiler flags of the
+// including file, so a file built without its flags still works, just slower
+#include "kernels.hpp"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__) && defined(__AVX512VL__)
+#define D3_KERNEL_AVX512
+#elif defined(__AVX2__) && defined(__FMA__)
+#define D3_KERNEL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define D3_KERNEL_SSE2
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#if defined(D3_KERNEL_AVX512) || defined(D3_KERNEL_AVX2)
+#include <immintrin.h>
+#elif defined(D3_KERNEL_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace d3 {
+
+// internal linkage, every kernel file gets its own copy
+namespace {
+
+    [[maybe_unused]] int count_bits(unsigned mask) {
+	int count = 0;
+	while (mask) {
+	    mask &= mask - 1;
+	    count++;
+	}
+	return count;
+    }
+
+    // next float towards zero for z > 0, see Span_Tex::depth_equal
+    float ulp_closer(float z) {
+	uint32_t bits;
+	memcpy(&bits, &z, sizeof(bits));
+	bits--;
+	memcpy(&z, &bits, sizeof(bits));
+	return z;
+    }
+
+    // like Texture::get_color without the error checks. + 0.5 and truncation instead of
+    // std::round, which only differs when the product is exactly halfway
+    uint32_t sample(const Texture_View& tex, float u, float v) {
+	u = u < 0.f ? 0.f : (u > 1.f ? 1.f : u);
+	v = v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+	int x = (int)(u * (tex.width  - 1 + 0.09f) + 0.5f);
+	int y = (int)(v * (tex.height - 1 + 0.09f) + 0.5f);
+	return tex.pixels[x + y * tex.width];
+    }
+
+    [[maybe_unused]] void fill_u32_scalar(uint32_t* dst, size_t begin, size_t count, uint32_t value) {
+	for (size_t i = begin; i < count; ++i) {
+	    dst[i] = value;
+	}
+    }
+
+    [[maybe_unused]] void fill_f32_scalar(float* dst, size_t begin, size_t count, float value) {
+	for (size_t i = begin; i < count; ++i) {
+	    dst[i] = value;
+	}
+    }
+
+    [[maybe_unused]] void transform_vec4_scalar(const float* src, float* dst, size_t begin, size_t count, const float cols[16]) {
+	for (size_t i = begin; i < count; ++i) {
+	    const float* v = src + i * 4;
+	    float x = v[0], y = v[1], z = v[2], w = v[3];
+	    for (int row = 0; row < 4; ++row) {
+		dst[i * 4 + row] = x * cols[row] + y * cols[4 + row] + z * cols[8 + row] + w * cols[12 + row];
+	    }
+	}
+    }
+
+    [[maybe_unused]] void skin_vec4_scalar(const float* src, const uint16_t* bones, const float* weights, const float* palette, float* dst,
+	    size_t begin, size_t count) {
+	for (size_t i = begin; i < count; ++i) {
+	    const float* w = weights + i * 4;
+	    const uint16_t* b = bones + i * 4;
+	    float cols[16];
+	    for (int c = 0; c < 16; ++c) cols[c] = w[0] * palette[b[0] * 16 + c];
+	    for (int k = 1; k < 4; ++k) {
+		for (int c = 0; c < 16; ++c) cols[c] += w[k] * palette[b[k] * 16 + c];
+	    }
+	    transform_vec4_scalar(src + i * 4, dst + i * 4, 0, 1, cols);
+	}
+    }
+
+    // a face is a backface if its signed screen space area is positive, with
+    // ab = a - b and ac = c - a like the cross product draw_triangles used to take
+    [[maybe_unused]] size_t cull_faces_scalar(const float* vertices, const uint32_t* corners, size_t begin, size_t count, uint32_t first,
+	    float near_clip, float far_clip, uint32_t* visible, Cull_Counts& counts) {
+	size_t passed = 0;
+	for (size_t i = begin; i < count; ++i) {
+	    const float* a = vertices + (size_t)corners[i * 3 + 0] * 4;
+	    const float* b = vertices + (size_t)corners[i * 3 + 1] * 4;
+	    const float* c = vertices + (size_t)corners[i * 3 + 2] * 4;
+	    float area = (a[0] - b[0]) * (c[1] - a[1]) - (a[1] - b[1]) * (c[0] - a[0]);
+	    if (area > 0.f) {
+		counts.backface++;
+		continue;
+	    }
+	    if (a[2] <= near_clip || b[2] <= near_clip || c[2] <= near_clip) {
+		counts.near++;
+		continue;
+	    }
+	    if (a[2] >= far_clip || b[2] >= far_clip || c[2] >= far_clip) {
+		counts.far++;
+		continue;
+	    }
+	    visible[passed++] = first + (uint32_t)i;
+	}
+	return passed;
+    }
+
+    [[maybe_unused]] size_t span_tex_scalar(const Span_Tex& span, int begin) {
+	size_t passed = 0;
+	for (int i = begin; i < span.count; ++i) {
+	    float z = 1.f / (span.z_reci + i * span.z_reci_step);
+	    if (span.depth_equal ? z <= span.z_buffer[i] : z < span.z_buffer[i]) {
+		span.pixels[i] = span.tex.pixels ? sample(span.tex, (span.u + i * span.u_step) * z, (span.v + i * span.v_step) * z) : span.color;
+		span.z_buffer[i] = span.depth_equal ? ulp_closer(z) : z;
+		passed++;
+	    }
+	}
+	return passed;
+    }
+
+    [[maybe_unused]] size_t span_depth_scalar(const Span_Tex& span, int begin) {
+	size_t passed = 0;
+	for (int i = begin; i < span.count; ++i) {
+	    float z = 1.f / (span.z_reci + i * span.z_reci_step);
+	    if (z < span.z_buffer[i]) {
+		span.z_buffer[i] = z;
+		passed++;
+	    }
+	}
+	return passed;
+    }
+
+    [[maybe_unused]] size_t span_g_buffer_scalar(const Span_Tex& span, const Span_G_Buffer& out, int begin) {
+	size_t passed = 0;
+	for (int i = begin; i < span.count; ++i) {
+	    float z = 1.f / (span.z_reci + i * span.z_reci_step);
+	    if (z < span.z_buffer[i]) {
+		span.z_buffer[i] = z;
+		out.u[i] = (span.u + i * span.u_step) * z;
+		out.v[i] = (span.v + i * span.v_step) * z;
+		out.tex_id[i] = out.tex_value;
+		passed++;
+	    }
+	}
+	return passed;
+    }
+
+    [[maybe_unused]] void sample_tex_scalar(Texture_View tex, const float* u, const float* v, uint32_t* out, size_t begin, size_t count) {
+	for (size_t i = begin; i < count; ++i) {
+	    out[i] = sample(tex, u[i], v[i]);
+	}
+    }
+
+    // one lane versions of the operations the lighting templates below use, every isa
+    // has a Wide_Ops with the same members. M is the pass mask of a lane group
+    struct Scalar_Ops {
+	using F = float;
+	using I = uint32_t;
+	using M = bool;
+	static constexpr int lanes = 1;
+
+	static F set(float a) { return a; }
+	static I set_i(uint32_t a) { return a; }
+	static F lane() { return 0.f; }
+	static F add(F a, F b) { return a + b; }
+	static F sub(F a, F b) { return a - b; }
+	static F mul(F a, F b) { return a * b; }
+	static F div(F a, F b) { return a / b; }
+	static F min(F a, F b) { return a < b ? a : b; }
+	static F max(F a, F b) { return a > b ? a : b; }
+	static F rsqrt(F a) { return 1.f / sqrtf(a); }
+	static M lt(F a, F b) { return a < b; }
+	static M le(F a, F b) { return a <= b; }
+	static M gt(F a, F b) { return a > b; }
+	static F select(M m, F a, F b) { return m ? a : b; }
+	static bool any(M m) { return m; }
+	static int count(M m) { return m ? 1 : 0; }
+	static F load(const float* p) { return *p; }
+	static void store(float* p, M m, F a) { if (m) *p = a; }
+	static void store_i(uint32_t* p, M m, I a) { if (m) *p = a; }
+	static I texels(const Texture_View& tex, F u, F v, M m) { return m ? sample(tex, u, v) : 0; }
+	static F closer(F z) { return ulp_closer(z); }
+	static I to_int(F a) { return (I)(int)a; }
+	static F to_float(I a) { return (float)(int)a; }
+	static I and_i(I a, I b) { return a & b; }
+	static I or_i(I a, I b) { return a | b; }
+	template <int n> static I shr(I a) { return a >> n; }
+	template <int n> static I shl(I a) { return a << n; }
+    };
+
+#if defined(D3_KERNEL_AVX512) || defined(D3_KERNEL_AVX2)
+
+    // one vector of skin_vec4 with the same fma order as the wide loops, for the tails:
+    // blend the columns of the 4 bones, then transform like transform_vec4
+    void skin_vec4_one(const float* src, const uint16_t* bones, const float* weights, const float* palette, float* dst) {
+	__m128 w = _mm_loadu_ps(weights);
+	__m128 cols[4];
+	for (int c = 0; c < 4; ++c) {
+	    cols[c] = _mm_mul_ps(_mm_shuffle_ps(w, w, 0x00), _mm_loadu_ps(palette + bones[0] * 16 + c * 4));
+	    cols[c] = _mm_fmadd_ps(_mm_shuffle_ps(w, w, 0x55), _mm_loadu_ps(palette + bones[1] * 16 + c * 4), cols[c]);
+	    cols[c] = _mm_fmadd_ps(_mm_shuffle_ps(w, w, 0xaa), _mm_loadu_ps(palette + bones[2] * 16 + c * 4), cols[c]);
+	    cols[c] = _mm_fmadd_ps(_mm_shuffle_ps(w, w, 0xff), _mm_loadu_ps(palette + bones[3] * 16 + c * 4), cols[c]);
+	}
+	__m128 v = _mm_loadu_ps(src);
+	__m128 r = _mm_mul_ps(_mm_shuffle_ps(v, v, 0x00), cols[0]);
+	r = _mm_fmadd_ps(_mm_shuffle_ps(v, v, 0x55), cols[1], r);
+	r = _mm_fmadd_ps(_mm_shuffle_ps(v, v, 0xaa), cols[2], r);
+	r = _mm_fmadd_ps(_mm_shuffle_ps(v, v, 0xff), cols[3], r);
+	_mm_storeu_ps(dst, r);
+    }
+
+#endif
+
+#if defined(D3_KERNEL_AVX512)
+
+    // 16 lanes, masked loads / stores handle the tails
+    __mmask16 tail_mask(size_t remaining) {
+	return remaining >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << remaining) - 1);
+    }
+
+    __m512i texel_index(const Texture_View& tex, __m512 u, __m512 v) {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 one = _mm512_set1_ps(1.f);
+	const __m512 half = _mm512_set1_ps(.5f);
+	u = _mm512_max_ps(_mm512_min_ps(u, one), zero);
+	v = _mm512_max_ps(_mm512_min_ps(v, one), zero);
+	__m512i x = _mm512_cvttps_epi32(_mm512_fmadd_ps(u, _mm512_set1_ps(tex.width  - 1 + 0.09f), half));
+	__m512i y = _mm512_cvttps_epi32(_mm512_fmadd_ps(v, _mm512_set1_ps(tex.height - 1 + 0.09f), half));
+	return _mm512_add_epi32(x, _mm512_mullo_epi32(y, _mm512_set1_epi32(tex.width)));
+    }
+
+    void fill_u32(uint32_t* dst, size_t count, uint32_t value) {
+	__m512i v = _mm512_set1_epi32((int)value);
+	for (size_t i = 0; i < count; i += 16) {
+	    _mm512_mask_storeu_epi32(dst + i, tail_mask(count - i), v);
+	}
+    }
+
+    void fill_f32(float* dst, size_t count, float value) {
+	__m512 v = _mm512_set1_ps(value);
+	for (size_t i = 0; i < count; i += 16) {
+	    _mm512_mask_storeu_ps(dst + i, tail_mask(count - i), v);
+	}
+    }
+
+    // 4 vertices per register, the columns are repeated in every 128 bit lane
+    void transform_vec4(const float* src, float* dst, size_t count, const float cols[16]) {
+	__m512 c0 = _mm512_broadcast_f32x4(_mm_loadu_ps(cols));
+	__m512 c1 = _mm512_broadcast_f32x4(_mm_loadu_ps(cols + 4));
+	__m512 c2 = _mm512_broadcast_f32x4(_mm_loadu_ps(cols + 8));
+	__m512 c3 = _mm512_broadcast_f32x4(_mm_loadu_ps(cols + 12));
+	for (size_t i = 0; i < count; i += 4) {
+	    size_t remaining = count - i < 4 ? count - i : 4;
+	    __mmask16 mask = tail_mask(remaining * 4);
+	    __m512 v = _mm512_maskz_loadu_ps(mask, src + i * 4);
+	    __m512 r = _mm512_mul_ps(_mm512_permute_ps(v, 0x00), c0);
+	    r = _mm512_fmadd_ps(_mm512_permute_ps(v, 0x55), c1, r);
+	    r = _mm512_fmadd_ps(_mm512_permute_ps(v, 0xaa), c2, r);
+	    r = _mm512_fmadd_ps(_mm512_permute_ps(v, 0xff), c3, r);
+	    _mm512_mask_storeu_ps(dst + i * 4, mask, r);
+	}
+    }
+
+    // column c of bone k of 4 vectors, one vector per 128 bit lane
+    __m512 bone_column(const float* palette, const uint16_t* bones, int k, int c) {
+	__m512 r = _mm512_castps128_ps512(_mm_loadu_ps(palette + bones[k] * 16 + c * 4));
+	r = _mm512_insertf32x4(r, _mm_loadu_ps(palette + bones[4 + k] * 16 + c * 4), 1);
+	r = _mm512_insertf32x4(r, _mm_loadu_ps(palette + bones[8 + k] * 16 + c * 4), 2);
+	return _mm512_insertf32x4(r, _mm_loadu_ps(palette + bones[12 + k] * 16 + c * 4), 3);
+    }
+
+    // 4 vectors per register like transform_vec4, each lane blends the columns of its own bones
+    void skin_vec4(const float* src, const uint16_t* bones, const float* weights, const float* palette, float* dst, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+	    const uint16_t* b = bones + i * 4;
+	    __m512 w = _mm512_loadu_ps(weights + i * 4);
+	    __m512 w0 = _mm512_permute_ps(w, 0x00);
+	    __m512 w1 = _mm512_permute_ps(w, 0x55);
+	    __m512 w2 = _mm512_permute_ps(w, 0xaa);
+	    __m512 w3 = _mm512_permute_ps(w, 0xff);
+	    __m512 cols[4];
+	    for (int c = 0; c < 4; ++c) {
+		cols[c] = _mm512_mul_ps(w0, bone_column(palette, b, 0, c));
+		cols[c] = _mm512_fmadd_ps(w1, bone_column(palette, b, 1, c), cols[c]);
+		cols[c] = _mm512_fmadd_ps(w2, bone_column(palette, b, 2, c), cols[c]);
+		cols[c] = _mm512_fmadd_ps(w3, bone_column(palette, b, 3, c), cols[c]);
+	    }
+	    __m512 v = _mm512_loadu_ps(src + i * 4);
+	    __m512 r = _mm512_mul_ps(_mm512_permute_ps(v, 0x00), cols[0]);
+	    r = _mm512_fmadd_ps(_mm512_permute_ps(v, 0x55), cols[1], r);
+	    r = _mm512_fmadd_ps(_mm512_permute_ps(v, 0xaa), cols[2], r);
+	    r = _mm512_fmadd_ps(_mm512_permute_ps(v, 0xff), cols[3], r);
+	    _mm512_storeu_ps(dst + i * 4, r);
+	}
+	for (; i < count; ++i) {
+	    skin_vec4_one(src + i * 4, bones + i * 4, weights + i * 4, palette, dst + i * 4);
+	}
+    }
+
+    // 16 faces per iteration, corners and positions come in through gathers and the
+    // passing face ids get compressed into visible
+    size_t cull_faces(const float* vertices, const uint32_t* corners, size_t count, uint32_t first,
+	    float near_clip, float far_clip, uint32_t* visible, Cull_Counts& counts) {
+	const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512i corner_offsets = _mm512_mullo_epi32(lane, _mm512_set1_epi32(3));
+	const __m512 near_v = _mm512_set1_ps(near_clip);
+	const __m512 far_v = _mm512_set1_ps(far_clip);
+	size_t passed = 0;
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+	    const int* face_corners = (const int*)(corners + i * 3);
+	    __m512 x[3], y[3], z[3];
+	    for (int k = 0; k < 3; ++k) {
+		__m512i index = _mm512_slli_epi32(_mm512_i32gather_epi32(corner_offsets, face_corners + k, 4), 2);
+		x[k] = _mm512_i32gather_ps(index, vertices + 0, 4);
+		y[k] = _mm512_i32gather_ps(index, vertices + 1, 4);
+		z[k] = _mm512_i32gather_ps(index, vertices + 2, 4);
+	    }
+	    __m512 area = _mm512_sub_ps(_mm512_mul_ps(_mm512_sub_ps(x[0], x[1]), _mm512_sub_ps(y[2], y[0])),
+					_mm512_mul_ps(_mm512_sub_ps(y[0], y[1]), _mm512_sub_ps(x[2], x[0])));
+	    __mmask16 back = _mm512_cmp_ps_mask(area, _mm512_setzero_ps(), _CMP_GT_OQ);
+	    __mmask16 near = 0;
+	    __mmask16 far = 0;
+	    for (int k = 0; k < 3; ++k) {
+		near |= _mm512_cmp_ps_mask(z[k], near_v, _CMP_LE_OQ);
+		far |= _mm512_cmp_ps_mask(z[k], far_v, _CMP_GE_OQ);
+	    }
+	    near &= ~back;
+	    far &= ~(back | near);
+	    __mmask16 pass = ~(back | near | far);
+	    counts.backface += count_bits(back);
+	    counts.near += count_bits(near);
+	    counts.far += count_bits(far);
+
+	    __m512i ids = _mm512_add_epi32(_mm512_set1_epi32((int)(first + i)), lane);
+	    _mm512_mask_compressstoreu_epi32(visible + passed, pass, ids);
+	    passed += count_bits(pass);
+	}
+	return passed + cull_faces_scalar(vertices, corners, i, count, first, near_clip, far_clip, visible + passed, counts);
+    }
+
+    size_t span_tex(const Span_Tex& span) {
+	const __m512 lane = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512 z_reci = _mm512_set1_ps(span.z_reci);
+	const __m512 z_reci_step = _mm512_set1_ps(span.z_reci_step);
+	const __m512i color = _mm512_set1_epi32((int)span.color);
+	size_t passed = 0;
+
+	for (int i = span.begin; i < span.count; i += 16) {
+	    __mmask16 mask = tail_mask(span.count - i);
+	    __m512 fi = _mm512_add_ps(_mm512_set1_ps((float)i), lane);
+	    __m512 z = _mm512_div_ps(_mm512_set1_ps(1.f), _mm512_add_ps(z_reci, _mm512_mul_ps(fi, z_reci_step)));
+	    __m512 z_old = _mm512_maskz_loadu_ps(mask, span.z_buffer + i);
+	    __mmask16 pass = span.depth_equal ? _mm512_mask_cmp_ps_mask(mask, z, z_old, _CMP_LE_OQ) : _mm512_mask_cmp_ps_mask(mask, z, z_old, _CMP_LT_OQ);
+	    if (!pass) continue;
+
+	    __m512i col = color;
+	    if (span.tex.pixels) {
+		__m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps(span.u), _mm512_mul_ps(fi, _mm512_set1_ps(span.u_step))), z);
+		__m512 v = _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps(span.v), _mm512_mul_ps(fi, _mm512_set1_ps(span.v_step))), z);
+		col = _mm512_mask_i32gather_epi32(color, pass, texel_index(span.tex, u, v), span.tex.pixels, 4);
+	    }
+	    _mm512_mask_storeu_epi32(span.pixels + i, pass, col);
+	    if (span.depth_equal) z = _mm512_castsi512_ps(_mm512_sub_epi32(_mm512_castps_si512(z), _mm512_set1_epi32(1)));
+	    _mm512_mask_storeu_ps(span.z_buffer + i, pass, z);
+	    passed += count_bits(pass);
+	}
+	return passed;
+    }
+
+    size_t span_depth(const Span_Tex& span) {
+	const __m512 lane = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512 z_reci = _mm512_set1_ps(span.z_reci);
+	const __m512 z_reci_step = _mm512_set1_ps(span.z_reci_step);
+	size_t passed = 0;
+
+	for (int i = span.begin; i < span.count; i += 16) {
+	    __mmask16 mask = tail_mask(span.count - i);
+	    __m512 fi = _mm512_add_ps(_mm512_set1_ps((float)i), lane);
+	    __m512 z = _mm512_div_ps(_mm512_set1_ps(1.f), _mm512_add_ps(z_reci, _mm512_mul_ps(fi, z_reci_step)));
+	    __mmask16 pass = _mm512_mask_cmp_ps_mask(mask, z, _mm512_maskz_loadu_ps(mask, span.z_buffer + i), _CMP_LT_OQ);
+	    _mm512_mask_storeu_ps(span.z_buffer + i, pass, z);
+	    passed += count_bits(pass);
+	}
+	return passed;
+    }
+
+    size_t span_g_buffer(const Span_Tex& span, const Span_G_Buffer& out) {
+	const __m512 lane = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512 z_reci = _mm512_set1_ps(span.z_reci);
+	const __m512 z_reci_step = _mm512_set1_ps(span.z_reci_step);
+	const __m512i tex_value = _mm512_set1_epi32(out.tex_value);
+	size_t passed = 0;
+
+	for (int i = span.begin; i < span.count; i += 16) {
+	    __mmask16 mask = tail_mask(span.count - i);
+	    __m512 fi = _mm512_add_ps(_mm512_set1_ps((float)i), lane);
+	    __m512 z = _mm512_div_ps(_mm512_set1_ps(1.f), _mm512_add_ps(z_reci, _mm512_mul_ps(fi, z_reci_step)));
+	    __m512 z_old = _mm512_maskz_loadu_ps(mask, span.z_buffer + i);
+	    __mmask16 pass = _mm512_mask_cmp_ps_mask(mask, z, z_old, _CMP_LT_OQ);
+	    if (!pass) continue;
+
+	    __m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps(span.u), _mm512_mul_ps(fi, _mm512_set1_ps(span.u_step))), z);
+	    __m512 v = _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps(span.v), _mm512_mul_ps(fi, _mm512_set1_ps(span.v_step))), z);
+	    _mm512_mask_storeu_ps(span.z_buffer + i, pass, z);
+	    _mm512_mask_storeu_ps(out.u + i, pass, u);
+	    _mm512_mask_storeu_ps(out.v + i, pass, v);
+	    _mm512_mask_storeu_epi32(out.tex_id + i, pass, tex_value);
+	    passed += count_bits(pass);
+	}
+	return passed;
+    }
+
+    void sample_tex(Texture_View tex, const float* u, const float* v, uint32_t* out, size_t count) {
+	for (size_t i = 0; i < count; i += 16) {
+	    __mmask16 mask = tail_mask(count - i);
+	    __m512i index = texel_index(tex, _mm512_maskz_loadu_ps(mask, u + i), _mm512_maskz_loadu_ps(mask, v + i));
+	    __m512i col = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, index, tex.pixels, 4);
+	    _mm512_mask_storeu_epi32(out + i, mask, col);
+	}
+    }
+
+    // one newton step on the hardware estimate, close to 1 / sqrt but much cheaper
+    __m512 newton_rsqrt(__m512 a, __m512 r) {
+	__m512 rr_a = _mm512_mul_ps(_mm512_mul_ps(r, r), a);
+	return _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(.5f), r), _mm512_sub_ps(_mm512_set1_ps(3.f), rr_a));
+    }
+
+    struct Wide_Ops {
+	using F = __m512;
+	using I = __m512i;
+	using M = __mmask16;
+	static constexpr int lanes = 16;
+
+	static F set(float a) { return _mm512_set1_ps(a); }
+	static I set_i(uint32_t a) { return _mm512_set1_epi32((int)a); }
+	static F lane() { return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+	static F add(F a, F b) { return _mm512_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm512_div_ps(a, b); }
+	static F min(F a, F b) { return _mm512_min_ps(a, b); }
+	static F max(F a, F b) { return _mm512_max_ps(a, b); }
+	static F rsqrt(F a) { return newton_rsqrt(a, _mm512_rsqrt14_ps(a)); }
+	static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+	static bool any(M m) { return m != 0; }
+	static int count(M m) { return count_bits(m); }
+	static F load(const float* p) { return _mm512_loadu_ps(p); }
+	static void store(float* p, M m, F a) { _mm512_mask_storeu_ps(p, m, a); }
+	static void store_i(uint32_t* p, M m, I a) { _mm512_mask_storeu_epi32(p, m, a); }
+	static I texels(const Texture_View& tex, F u, F v, M m) { return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, texel_index(tex, u, v), tex.pixels, 4); }
+	static F closer(F z) { return _mm512_castsi512_ps(_mm512_sub_epi32(_mm512_castps_si512(z), _mm512_set1_epi32(1))); }
+	static I to_int(F a) { return _mm512_cvttps_epi32(a); }
+	static F to_float(I a) { return _mm512_cvtepi32_ps(a); }
+	static I and_i(I a, I b) { return _mm512_and_si512(a, b); }
+	static I or_i(I a, I b) { return _mm512_or_si512(a, b); }
+	template <int n> static I shr(I a) { return _mm512_srli_epi32(a, n); }
+	template <int n> static I shl(I a) { return _mm512_slli_epi32(a, n); }
+    };
+
+#elif defined(D3_KERNEL_AVX2)
+
+    // 8 lanes, the tails are done by the scalar loops
+    __m256i texel_index(const Texture_View& tex, __m256 u, __m256 v) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 half = _mm256_set1_ps(.5f);
+	u = _mm256_max_ps(_mm256_min_ps(u, one), zero);
+	v = _mm256_max_ps(_mm256_min_ps(v, one), zero);
+	__m256i x = _mm256_cvttps_epi32(_mm256_fmadd_ps(u, _mm256_set1_ps(tex.width  - 1 + 0.09f), half));
+	__m256i y = _mm256_cvttps_epi32(_mm256_fmadd_ps(v, _mm256_set1_ps(tex.height - 1 + 0.09f), half));
+	return _mm256_add_epi32(x, _mm256_mullo_epi32(y, _mm256_set1_epi32(tex.width)));
+    }
+
+    void fill_u32(uint32_t* dst, size_t count, uint32_t value) {
+	__m256i v = _mm256_set1_epi32((int)value);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+	    _mm256_storeu_si256((__m256i*)(dst + i), v);
+	}
+	fill_u32_scalar(dst, i, count, value);
+    }
+
+    void fill_f32(float* dst, size_t count, float value) {
+	__m256 v = _mm256_set1_ps(value);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+	    _mm256_storeu_ps(dst + i, v);
+	}
+	fill_f32_scalar(dst, i, count, value);
+    }
+
+    // 2 vertices per register, the columns are repeated in both 128 bit lanes
+    void transform_vec4(const float* src, float* dst, size_t count, const float cols[16]) {
+	__m256 c0 = _mm256_broadcast_ps((const __m128*)cols);
+	__m256 c1 = _mm256_broadcast_ps((const __m128*)(cols + 4));
+	__m256 c2 = _mm256_broadcast_ps((const __m128*)(cols + 8));
+	__m256 c3 = _mm256_broadcast_ps((const __m128*)(cols + 12));
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+	    __m256 v = _mm256_loadu_ps(src + i * 4);
+	    __m256 r = _mm256_mul_ps(_mm256_permute_ps(v, 0x00), c0);
+	    r = _mm256_fmadd_ps(_mm256_permute_ps(v, 0x55), c1, r);
+	    r = _mm256_fmadd_ps(_mm256_permute_ps(v, 0xaa), c2, r);
+	    r = _mm256_fmadd_ps(_mm256_permute_ps(v, 0xff), c3, r);
+	    _mm256_storeu_ps(dst + i * 4, r);
+	}
+	transform_vec4_scalar(src, dst, i, count, cols);
+    }
+
+    // column c of bone k of 2 vectors, one vector per 128 bit lane
+    __m256 bone_column(const float* palette, const uint16_t* bones, int k, int c) {
+	__m256 r = _mm256_castps128_ps256(_mm_loadu_ps(palette + bones[k] * 16 + c * 4));
+	return _mm256_insertf128_ps(r, _mm_loadu_ps(palette + bones[4 + k] * 16 + c * 4), 1);
+    }
+
+    // 2 vectors per register like transform_vec4, each lane blends the columns of its own bones
+    void skin_vec4(const float* src, const uint16_t* bones, const float* weights, const float* palette, float* dst, size_t count) {
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+	    const uint16_t* b = bones + i * 4;
+	    __m256 w = _mm256_loadu_ps(weights + i * 4);
+	    __m256 w0 = _mm256_permute_ps(w, 0x00);
+	    __m256 w1 = _mm256_permute_ps(w, 0x55);
+	    __m256 w2 = _mm256_permute_ps(w, 0xaa);
+	    __m256 w3 = _mm256_permute_ps(w, 0xff);
+	    __m256 cols[4];
+	    for (int c = 0; c < 4; ++c) {
+		cols[c] = _mm256_mul_ps(w0, bone_column(palette, b, 0, c));
+		cols[c] = _mm256_fmadd_ps(w1, bone_column(palette, b, 1, c), cols[c]);
+		cols[c] = _mm256_fmadd_ps(w2, bone_column(palette, b, 2, c), cols[c]);
+		cols[c] = _mm256_fmadd_ps(w3, bone_column(palette, b, 3, c), cols[c]);
+	    }
+	    __m256 v = _mm256_loadu_ps(src + i * 4);
+	    __m256 r = _mm256_mul_ps(_mm256_permute_ps(v, 0x00), cols[0]);
+	    r = _mm256_fmadd_ps(_mm256_permute_ps(v, 0x55), cols[1], r);
+	    r = _mm256_fmadd_ps(_mm256_permute_ps(v, 0xaa), cols[2], r);
+	    r = _mm256_fmadd_ps(_mm256_permute_ps(v, 0xff), cols[3], r);
+	    _mm256_storeu_ps(dst + i * 4, r);
+	}
+	for (; i < count; ++i) {
+	    skin_vec4_one(src + i * 4, bones + i * 4, weights + i * 4, palette, dst + i * 4);
+	}
+    }
+
+    // 8 faces per iteration through gathers, avx2 has no compress store so the
+    // passing faces are written out lane by lane
+    size_t cull_faces(const float* vertices, const uint32_t* corners, size_t count, uint32_t first,
+	    float near_clip, float far_clip, uint32_t* visible, Cull_Counts& counts) {
+	const __m256i corner_offsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	const __m256 near_v = _mm256_set1_ps(near_clip);
+	const __m256 far_v = _mm256_set1_ps(far_clip);
+	size_t passed = 0;
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+	    const int* face_corners = (const int*)(corners + i * 3);
+	    __m256 x[3], y[3], z[3];
+	    for (int k = 0; k < 3; ++k) {
+		__m256i index = _mm256_slli_epi32(_mm256_i32gather_epi32(face_corners + k, corner_offsets, 4), 2);
+		x[k] = _mm256_i32gather_ps(vertices + 0, index, 4);
+		y[k] = _mm256_i32gather_ps(vertices + 1, index, 4);
+		z[k] = _mm256_i32gather_ps(vertices + 2, index, 4);
+	    }
+	    __m256 area = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(x[0], x[1]), _mm256_sub_ps(y[2], y[0])),
+					_mm256_mul_ps(_mm256_sub_ps(y[0], y[1]), _mm256_sub_ps(x[2], x[0])));
+	    int back = _mm256_movemask_ps(_mm256_cmp_ps(area, _mm256_setzero_ps(), _CMP_GT_OQ));
+	    int near = 0;
+	    int far = 0;
+	    for (int k = 0; k < 3; ++k) {
+		near |= _mm256_movemask_ps(_mm256_cmp_ps(z[k], near_v, _CMP_LE_OQ));
+		far |= _mm256_movemask_ps(_mm256_cmp_ps(z[k], far_v, _CMP_GE_OQ));
+	    }
+	    near &= ~back;
+	    far &= ~(back | near);
+	    unsigned pass = ~(back | near | far) & 0xff;
+	    counts.backface += count_bits(back);
+	    counts.near += count_bits(near);
+	    counts.far += count_bits(far);
+
+	    // every lane writes, only passing ones advance. passed <= i + lane_id stays inside visible
+	    for (int lane_id = 0; lane_id < 8; ++lane_id) {
+		visible[passed] = first + (uint32_t)(i + lane_id);
+		passed += (pass >> lane_id) & 1;
+	    }
+	}
+	return passed + cull_faces_scalar(vertices, corners, i, count, first, near_clip, far_clip, visible + passed, counts);
+    }
+
+    size_t span_tex(const Span_Tex& span) {
+	const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 z_reci = _mm256_set1_ps(span.z_reci);
+	const __m256 z_reci_step = _mm256_set1_ps(span.z_reci_step);
+	const __m256i color = _mm256_set1_epi32((int)span.color);
+	size_t passed = 0;
+
+	int i = span.begin;
+	for (; i + 8 <= span.count; i += 8) {
+	    __m256 fi = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+	    __m256 z = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_add_ps(z_reci, _mm256_mul_ps(fi, z_reci_step)));
+	    __m256 z_old = _mm256_loadu_ps(span.z_buffer + i);
+	    __m256 pass = span.depth_equal ? _mm256_cmp_ps(z, z_old, _CMP_LE_OQ) : _mm256_cmp_ps(z, z_old, _CMP_LT_OQ);
+	    int mask = _mm256_movemask_ps(pass);
+	    if (!mask) continue;
+
+	    __m256i pass_i = _mm256_castps_si256(pass);
+	    __m256i col = color;
+	    if (span.tex.pixels) {
+		__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(span.u), _mm256_mul_ps(fi, _mm256_set1_ps(span.u_step))), z);
+		__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(span.v), _mm256_mul_ps(fi, _mm256_set1_ps(span.v_step))), z);
+		col = _mm256_mask_i32gather_epi32(color, (const int*)span.tex.pixels, texel_index(span.tex, u, v), pass_i, 4);
+	    }
+	    _mm256_maskstore_epi32((int*)(span.pixels + i), pass_i, col);
+	    if (span.depth_equal) z = _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_castps_si256(z), _mm256_set1_epi32(1)));
+	    _mm256_maskstore_ps(span.z_buffer + i, pass_i, z);
+	    passed += count_bits(mask);
+	}
+	return passed + span_tex_scalar(span, i);
+    }
+
+    size_t span_depth(const Span_Tex& span) {
+	const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 z_reci = _mm256_set1_ps(span.z_reci);
+	const __m256 z_reci_step = _mm256_set1_ps(span.z_reci_step);
+	size_t passed = 0;
+
+	int i = span.begin;
+	for (; i + 8 <= span.count; i += 8) {
+	    __m256 fi = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+	    __m256 z = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_add_ps(z_reci, _mm256_mul_ps(fi, z_reci_step)));
+	    __m256 z_old = _mm256_loadu_ps(span.z_buffer + i);
+	    __m256 pass = _mm256_cmp_ps(z, z_old, _CMP_LT_OQ);
+	    _mm256_storeu_ps(span.z_buffer + i, _mm256_blendv_ps(z_old, z, pass));
+	    passed += count_bits(_mm256_movemask_ps(pass));
+	}
+	return passed + span_depth_scalar(span, i);
+    }
+
+    size_t span_g_buffer(const Span_Tex& span, const Span_G_Buffer& out) {
+	const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 z_reci = _mm256_set1_ps(span.z_reci);
+	const __m256 z_reci_step = _mm256_set1_ps(span.z_reci_step);
+	const __m256i tex_value = _mm256_set1_epi32(out.tex_value);
+	size_t passed = 0;
+
+	int i = span.begin;
+	for (; i + 8 <= span.count; i += 8) {
+	    __m256 fi = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+	    __m256 z = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_add_ps(z_reci, _mm256_mul_ps(fi, z_reci_step)));
+	    __m256 pass = _mm256_cmp_ps(z, _mm256_loadu_ps(span.z_buffer + i), _CMP_LT_OQ);
+	    int mask = _mm256_movemask_ps(pass);
+	    if (!mask) continue;
+
+	    __m256i pass_i = _mm256_castps_si256(pass);
+	    __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(span.u), _mm256_mul_ps(fi, _mm256_set1_ps(span.u_step))), z);
+	    __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(span.v), _mm256_mul_ps(fi, _mm256_set1_ps(span.v_step))), z);
+	    _mm256_maskstore_ps(span.z_buffer + i, pass_i, z);
+	    _mm256_maskstore_ps(out.u + i, pass_i, u);
+	    _mm256_maskstore_ps(out.v + i, pass_i, v);
+	    _mm256_maskstore_epi32((int*)(out.tex_id + i), pass_i, tex_value);
+	    passed += count_bits(mask);
+	}
+	return passed + span_g_buffer_scalar(span, out, i);
+    }
+
+    void sample_tex(Texture_View tex, const float* u, const float* v, uint32_t* out, size_t count) {
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+	    __m256i index = texel_index(tex, _mm256_loadu_ps(u + i), _mm256_loadu_ps(v + i));
+	    _mm256_storeu_si256((__m256i*)(out + i), _mm256_i32gather_epi32((const int*)tex.pixels, index, 4));
+	}
+	sample_tex_scalar(tex, u, v, out, i, count);
+    }
+
+    __m256 newton_rsqrt(__m256 a, __m256 r) {
+	__m256 rr_a = _mm256_mul_ps(_mm256_mul_ps(r, r), a);
+	return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(.5f), r), _mm256_sub_ps(_mm256_set1_ps(3.f), rr_a));
+    }
+
+    struct Wide_Ops {
+	using F = __m256;
+	using I = __m256i;
+	using M = __m256;
+	static constexpr int lanes = 8;
+
+	static F set(float a) { return _mm256_set1_ps(a); }
+	static I set_i(uint32_t a) { return _mm256_set1_epi32((int)a); }
+	static F lane() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+	static F add(F a, F b) { return _mm256_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm256_div_ps(a, b); }
+	static F min(F a, F b) { return _mm256_min_ps(a, b); }
+	static F max(F a, F b) { return _mm256_max_ps(a, b); }
+	static F rsqrt(F a) { return newton_rsqrt(a, _mm256_rsqrt_ps(a)); }
+	static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+	static bool any(M m) { return _mm256_movemask_ps(m) != 0; }
+	static int count(M m) { return count_bits(_mm256_movemask_ps(m)); }
+	static F load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, M m, F a) { _mm256_maskstore_ps(p, _mm256_castps_si256(m), a); }
+	static void store_i(uint32_t* p, M m, I a) { _mm256_maskstore_epi32((int*)p, _mm256_castps_si256(m), a); }
+	static I texels(const Texture_View& tex, F u, F v, M m) { return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)tex.pixels, texel_index(tex, u, v), _mm256_castps_si256(m), 4); }
+	static F closer(F z) { return _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_castps_si256(z), _mm256_set1_epi32(1))); }
+	static I to_int(F a) { return _mm256_cvttps_epi32(a); }
+	static F to_float(I a) { return _mm256_cvtepi32_ps(a); }
+	static I and_i(I a, I b) { return _mm256_and_si256(a, b); }
+	static I or_i(I a, I b) { return _mm256_or_si256(a, b); }
+	template <int n> static I shr(I a) { return _mm256_srli_epi32(a, n); }
+	template <int n> static I shl(I a) { return _mm256_slli_epi32(a, n); }
+    };
+
+#elif defined(D3_KERNEL_SSE2)
+
+    // 4 lanes, sse2 has no gather and no 32 bit multiply, so texel fetches go through memory
+    void fill_u32(uint32_t* dst, size_t count, uint32_t value) {
+	__m128i v = _mm_set1_epi32((int)value);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+	    _mm_storeu_si128((__m128i*)(dst + i), v);
+	}
+	fill_u32_scalar(dst, i, count, value);
+    }
+
+    void fill_f32(float* dst, size_t count, float value) {
+	__m128 v = _mm_set1_ps(value);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+	    _mm_storeu_ps(dst + i, v);
+	}
+	fill_f32_scalar(dst, i, count, value);
+    }
+
+    void transform_vec4(const float* src, float* dst, size_t count, const float cols[16]) {
+	__m128 c0 = _mm_loadu_ps(cols);
+	__m128 c1 = _mm_loadu_ps(cols + 4);
+	__m128 c2 = _mm_loadu_ps(cols + 8);
+	__m128 c3 = _mm_loadu_ps(cols + 12);
+	for (size_t i = 0; i < count; ++i) {
+	    __m128 v = _mm_loadu_ps(src + i * 4);
+	    __m128 r = _mm_mul_ps(_mm_shuffle_ps(v, v, 0x00), c0);
+	    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0x55), c1));
+	    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xaa), c2));
+	    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xff), c3));
+	    _mm_storeu_ps(dst + i * 4, r);
+	}
+    }
+
+    void skin_vec4(const float* src, const uint16_t* bones, const float* weights, const float* palette, float* dst, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+	    const uint16_t* b = bones + i * 4;
+	    __m128 w = _mm_loadu_ps(weights + i * 4);
+	    __m128 w0 = _mm_shuffle_ps(w, w, 0x00);
+	    __m128 w1 = _mm_shuffle_ps(w, w, 0x55);
+	    __m128 w2 = _mm_shuffle_ps(w, w, 0xaa);
+	    __m128 w3 = _mm_shuffle_ps(w, w, 0xff);
+	    __m128 cols[4];
+	    for (int c = 0; c < 4; ++c) {
+		cols[c] = _mm_mul_ps(w0, _mm_loadu_ps(palette + b[0] * 16 + c * 4));
+		cols[c] = _mm_add_ps(cols[c], _mm_mul_ps(w1, _mm_loadu_ps(palette + b[1] * 16 + c * 4)));
+		cols[c] = _mm_add_ps(cols[c], _mm_mul_ps(w2, _mm_loadu_ps(palette + b[2] * 16 + c * 4)));
+		cols[c] = _mm_add_ps(cols[c], _mm_mul_ps(w3, _mm_loadu_ps(palette + b[3] * 16 + c * 4)));
+	    }
+	    __m128 v = _mm_loadu_ps(src + i * 4);
+	    __m128 r = _mm_mul_ps(_mm_shuffle_ps(v, v, 0x00), cols[0]);
+	    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0x55), cols[1]));
+	    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xaa), cols[2]));
+	    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, 0xff), cols[3]));
+	    _mm_storeu_ps(dst + i * 4, r);
+	}
+    }
+
+    // without gathers the positions would go through memory lane by lane anyway
+    size_t cull_faces(const float* vertices, const uint32_t* corners, size_t count, uint32_t first,
+	    float near_clip, float far_clip, uint32_t* visible, Cull_Counts& counts) {
+	return cull_faces_scalar(vertices, corners, 0, count, first, near_clip, far_clip, visible, counts);
+    }
+
+    size_t span_tex(const Span_Tex& span) {
+	const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+	const __m128 z_reci = _mm_set1_ps(span.z_reci);
+	const __m128 z_reci_step = _mm_set1_ps(span.z_reci_step);
+	size_t passed = 0;
+
+	int i = span.begin;
+	for (; i + 4 <= span.count; i += 4) {
+	    __m128 fi = _mm_add_ps(_mm_set1_ps((float)i), lane);
+	    __m128 z = _mm_div_ps(_mm_set1_ps(1.f), _mm_add_ps(z_reci, _mm_mul_ps(fi, z_reci_step)));
+	    __m128 z_old = _mm_loadu_ps(span.z_buffer + i);
+	    int mask = _mm_movemask_ps(span.depth_equal ? _mm_cmple_ps(z, z_old) : _mm_cmplt_ps(z, z_old));
+	    if (!mask) continue;
+
+	    alignas(16) float zs[4];
+	    alignas(16) float us[4];
+	    alignas(16) float vs[4];
+	    _mm_store_ps(zs, z);
+	    if (span.tex.pixels) {
+		_mm_store_ps(us, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(span.u), _mm_mul_ps(fi, _mm_set1_ps(span.u_step))), z));
+		_mm_store_ps(vs, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(span.v), _mm_mul_ps(fi, _mm_set1_ps(span.v_step))), z));
+	    }
+	    for (int lane_id = 0; lane_id < 4; ++lane_id) {
+		if (!(mask & (1 << lane_id))) continue;
+		span.pixels[i + lane_id] = span.tex.pixels ? sample(span.tex, us[lane_id], vs[lane_id]) : span.color;
+		span.z_buffer[i + lane_id] = span.depth_equal ? ulp_closer(zs[lane_id]) : zs[lane_id];
+	    }
+	    passed += count_bits(mask);
+	}
+	return passed + span_tex_scalar(span, i);
+    }
+
+    // no masked stores either, failing lanes write back what was loaded
+    __m128 select(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    size_t span_g_buffer(const Span_Tex& span, const Span_G_Buffer& out) {
+	const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+	const __m128 z_reci = _mm_set1_ps(span.z_reci);
+	const __m128 z_reci_step = _mm_set1_ps(span.z_reci_step);
+	const __m128 tex_value = _mm_castsi128_ps(_mm_set1_epi32(out.tex_value));
+	size_t passed = 0;
+
+	int i = span.begin;
+	for (; i + 4 <= span.count; i += 4) {
+	    __m128 fi = _mm_add_ps(_mm_set1_ps((float)i), lane);
+	    __m128 z = _mm_div_ps(_mm_set1_ps(1.f), _mm_add_ps(z_reci, _mm_mul_ps(fi, z_reci_step)));
+	    __m128 z_old = _mm_loadu_ps(span.z_buffer + i);
+	    __m128 pass = _mm_cmplt_ps(z, z_old);
+	    int mask = _mm_movemask_ps(pass);
+	    if (!mask) continue;
+
+	    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(span.u), _mm_mul_ps(fi, _mm_set1_ps(span.u_step))), z);
+	    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(span.v), _mm_mul_ps(fi, _mm_set1_ps(span.v_step))), z);
+	    __m128 tex_old = _mm_loadu_ps((const float*)(out.tex_id + i));
+	    _mm_storeu_ps(span.z_buffer + i, select(pass, z, z_old));
+	    _mm_storeu_ps(out.u + i, select(pass, u, _mm_loadu_ps(out.u + i)));
+	    _mm_storeu_ps(out.v + i, select(pass, v, _mm_loadu_ps(out.v + i)));
+	    _mm_storeu_ps((float*)(out.tex_id + i), select(pass, tex_value, tex_old));
+	    passed += count_bits(mask);
+	}
+	return passed + span_g_buffer_scalar(span, out, i);
+    }
+
+    size_t span_depth(const Span_Tex& span) {
+	const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+	const __m128 z_reci = _mm_set1_ps(span.z_reci);
+	const __m128 z_reci_step = _mm_set1_ps(span.z_reci_step);
+	size_t passed = 0;
+
+	int i = span.begin;
+	for (; i + 4 <= span.count; i += 4) {
+	    __m128 fi = _mm_add_ps(_mm_set1_ps((float)i), lane);
+	    __m128 z = _mm_div_ps(_mm_set1_ps(1.f), _mm_add_ps(z_reci, _mm_mul_ps(fi, z_reci_step)));
+	    __m128 z_old = _mm_loadu_ps(span.z_buffer + i);
+	    __m128 pass = _mm_cmplt_ps(z, z_old);
+	    _mm_storeu_ps(span.z_buffer + i, select(pass, z, z_old));
+	    passed += count_bits(_mm_movemask_ps(pass));
+	}
+	return passed + span_depth_scalar(span, i);
+    }
+
+    void sample_tex(Texture_View tex, const float* u, const float* v, uint32_t* out, size_t count) {
+	sample_tex_scalar(tex, u, v, out, 0, count);
+    }
+
+    __m128 newton_rsqrt(__m128 a, __m128 r) {
+	__m128 rr_a = _mm_mul_ps(_mm_mul_ps(r, r), a);
+	return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(.5f), r), _mm_sub_ps(_mm_set1_ps(3.f), rr_a));
+    }
+
+    struct Wide_Ops {
+	using F = __m128;
+	using I = __m128i;
+	using M = __m128;
+	static constexpr int lanes = 4;
+
+	static F set(float a) { return _mm_set1_ps(a); }
+	static I set_i(uint32_t a) { return _mm_set1_epi32((int)a); }
+	static F lane() { return _mm_setr_ps(0, 1, 2, 3); }
+	static F add(F a, F b) { return _mm_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm_div_ps(a, b); }
+	static F min(F a, F b) { return _mm_min_ps(a, b); }
+	static F max(F a, F b) { return _mm_max_ps(a, b); }
+	static F rsqrt(F a) { return newton_rsqrt(a, _mm_rsqrt_ps(a)); }
+	static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+	static M le(F a, F b) { return _mm_cmple_ps(a, b); }
+	static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+	static F select(M m, F a, F b) { return d3::select(m, a, b); }
+	static bool any(M m) { return _mm_movemask_ps(m) != 0; }
+	static int count(M m) { return count_bits(_mm_movemask_ps(m)); }
+	static F load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, M m, F a) { _mm_storeu_ps(p, d3::select(m, a, _mm_loadu_ps(p))); }
+	static void store_i(uint32_t* p, M m, I a) { _mm_storeu_si128((__m128i*)p, _mm_castps_si128(d3::select(m, _mm_castsi128_ps(a), _mm_loadu_ps((const float*)p)))); }
+	static I texels(const Texture_View& tex, F u, F v, M m) {
+	    alignas(16) float us[4];
+	    alignas(16) float vs[4];
+	    alignas(16) uint32_t out[4];
+	    _mm_store_ps(us, u);
+	    _mm_store_ps(vs, v);
+	    int mask = _mm_movemask_ps(m);
+	    for (int lane_id = 0; lane_id < 4; ++lane_id) {
+		out[lane_id] = mask & (1 << lane_id) ? sample(tex, us[lane_id], vs[lane_id]) : 0;
+	    }
+	    return _mm_load_si128((const __m128i*)out);
+	}
+	static F closer(F z) { return _mm_castsi128_ps(_mm_sub_epi32(_mm_castps_si128(z), _mm_set1_epi32(1))); }
+	static I to_int(F a) { return _mm_cvttps_epi32(a); }
+	static F to_float(I a) { return _mm_cvtepi32_ps(a); }
+	static I and_i(I a, I b) { return _mm_and_si128(a, b); }
+	static I or_i(I a, I b) { return _mm_or_si128(a, b); }
+	template <int n> static I shr(I a) { return _mm_srli_epi32(a, n); }
+	template <int n> static I shl(I a) { return _mm_slli_epi32(a, n); }
+    };
+
+#else
+
+    // no simd for this target
+    void fill_u32(uint32_t* dst, size_t count, uint32_t value) {
+	fill_u32_scalar(dst, 0, count, value);
+    }
+
+    void fill_f32(float* dst, size_t count, float value) {
+	fill_f32_scalar(dst, 0, count, value);
+    }
+
+    void transform_vec4(const float* src, float* dst, size_t count, const float cols[16]) {
+	transform_vec4_scalar(src, dst, 0, count, cols);
+    }
+
+    void skin_vec4(const float* src, const uint16_t* bones, const float* weights, const float* palette, float* dst, size_t count) {
+	skin_vec4_scalar(src, bones, weights, palette, dst, 0, count);
+    }
+
+    size_t cull_faces(const float* vertices, const uint32_t* corners, size_t count, uint32_t first,
+	    float near_clip, float far_clip, uint32_t* visible, Cull_Counts& counts) {
+	return cull_faces_scalar(vertices, corners, 0, count, first, near_clip, far_clip, visible, counts);
+    }
+
+    size_t span_tex(const Span_Tex& span) {
+	return span_tex_scalar(span, span.begin);
+    }
+
+    size_t span_depth(const Span_Tex& span) {
+	return span_depth_scalar(span, span.begin);
+    }
+
+    size_t span_g_buffer(const Span_Tex& span, const Span_G_Buffer& out) {
+	return span_g_buffer_scalar(span, out, span.begin);
+    }
+
+    void sample_tex(Texture_View tex, const float* u, const float* v, uint32_t* out, size_t count) {
+	sample_tex_scalar(tex, u, v, out, 0, count);
+    }
+
+    using Wide_Ops = Scalar_Ops;
+
+#endif
+
+    // lighting math shared by every isa, written once against the Ops members
+
+    template <class Ops>
+    typename Ops::F dot3(const typename Ops::F a[3], const typename Ops::F b[3]) {
+	return Ops::add(Ops::add(Ops::mul(a[0], b[0]), Ops::mul(a[1], b[1])), Ops::mul(a[2], b[2]));
+    }
+
+    // returns the length before normalizing
+    template <class Ops>
+    typename Ops::F normalize3(typename Ops::F a[3]) {
+	typename Ops::F length_squared = Ops::max(dot3<Ops>(a, a), Ops::set(1e-20f));
+	typename Ops::F length_reci = Ops::rsqrt(length_squared);
+	for (int k = 0; k < 3; ++k) a[k] = Ops::mul(a[k], length_reci);
+	return Ops::mul(length_squared, length_reci);
+    }
+
+    // a^n by squaring, n >= 0
+    template <class Ops>
+    typename Ops::F pow_int(typename Ops::F a, int n) {
+	typename Ops::F result = Ops::set(1.f);
+	while (n > 0) {
+	    if (n & 1) result = Ops::mul(result, a);
+	    a = Ops::mul(a, a);
+	    n >>= 1;
+	}
+	return result;
+    }
+
+    // blinn-phong for a group of points, normal has to be normalized
+    template <class Ops>
+    void shade(const Light_Setup& setup, const typename Ops::F normal[3], const typename Ops::F position[3], typename Ops::F diffuse[3], typename Ops::F specular[3]) {
+	using F = typename Ops::F;
+	const F zero = Ops::set(0.f);
+	const F one = Ops::set(1.f);
+
+	F view[3];
+	for (int k = 0; k < 3; ++k) {
+	    view[k] = Ops::sub(Ops::set(setup.camera[k]), position[k]);
+	    diffuse[k] = Ops::set(setup.ambient[k]);
+	    specular[k] = zero;
+	}
+	normalize3<Ops>(view);
+
+	for (int l = 0; l < setup.light_count; ++l) {
+	    const Light_Data& light = setup.lights[l];
+	    F dir[3];
+	    F attenuation = one;
+	    if (light.range > 0.f) {
+		for (int k = 0; k < 3; ++k) dir[k] = Ops::sub(Ops::set(light.vector[k]), position[k]);
+		F dist = normalize3<Ops>(dir);
+		attenuation = Ops::max(zero, Ops::sub(one, Ops::mul(dist, Ops::set(1.f / light.range))));
+	    }
+	    else {
+		for (int k = 0; k < 3; ++k) dir[k] = Ops::set(light.vector[k]);
+	    }
+
+	    F n_dot_l = dot3<Ops>(normal, dir);
+	    F half[3];
+	    for (int k = 0; k < 3; ++k) half[k] = Ops::add(dir[k], view[k]);
+	    normalize3<Ops>(half);
+	    F highlight = pow_int<Ops>(Ops::max(zero, dot3<Ops>(normal, half)), setup.shininess);
+	    highlight = Ops::mul(highlight, Ops::mul(Ops::set(setup.specular), attenuation));
+	    // no highlight on the side facing away from the light
+	    highlight = Ops::select(Ops::gt(n_dot_l, zero), highlight, zero);
+	    F lambert = Ops::mul(Ops::max(n_dot_l, zero), attenuation);
+
+	    for (int k = 0; k < 3; ++k) {
+		F color = Ops::set(light.color[k]);
+		diffuse[k] = Ops::add(diffuse[k], Ops::mul(lambert, color));
+		specular[k] = Ops::add(specular[k], Ops::mul(highlight, color));
+	    }
+	}
+    }
+
+    // one 8 bit channel of texel * diffuse + specular, saturated
+    template <class Ops, int shift>
+    typename Ops::I light_channel(typename Ops::I texel, typename Ops::F diffuse, typename Ops::F specular) {
+	using F = typename Ops::F;
+	F c = Ops::to_float(Ops::and_i(Ops::template shr<shift>(texel), Ops::set_i(0xff)));
+	c = Ops::add(Ops::mul(c, diffuse), Ops::mul(specular, Ops::set(255.f)));
+	return Ops::template shl<shift>(Ops::to_int(Ops::min(c, Ops::set(255.f))));
+    }
+
+    // span_tex with lighting, does the lane groups that fit from i on and advances i.
+    // z and the depth test are computed exactly like span_tex / span_depth
+    template <class Ops, bool per_pixel>
+    size_t span_lit(const Span_Tex& span, const Span_Light& light, int& i) {
+	using F = typename Ops::F;
+	using I = typename Ops::I;
+	using M = typename Ops::M;
+	const F lane = Ops::lane();
+	size_t passed = 0;
+
+	for (; i + Ops::lanes <= span.count; i += Ops::lanes) {
+	    F fi = Ops::add(Ops::set((float)i), lane);
+	    F z = Ops::div(Ops::set(1.f), Ops::add(Ops::set(span.z_reci), Ops::mul(fi, Ops::set(span.z_reci_step))));
+	    F z_old = Ops::load(span.z_buffer + i);
+	    M pass = span.depth_equal ? Ops::le(z, z_old) : Ops::lt(z, z_old);
+	    if (!Ops::any(pass)) continue;
+
+	    I texel = Ops::set_i(span.color);
+	    if (span.tex.pixels) {
+		F u = Ops::mul(Ops::add(Ops::set(span.u), Ops::mul(fi, Ops::set(span.u_step))), z);
+		F v = Ops::mul(Ops::add(Ops::set(span.v), Ops::mul(fi, Ops::set(span.v_step))), z);
+		texel = Ops::texels(span.tex, u, v, pass);
+	    }
+
+	    F varyings[6];
+	    for (int k = 0; k < 6; ++k) {
+		varyings[k] = Ops::mul(Ops::add(Ops::set(light.varyings[k]), Ops::mul(fi, Ops::set(light.steps[k]))), z);
+	    }
+	    F diffuse[3];
+	    F specular[3];
+	    if constexpr (per_pixel) {
+		normalize3<Ops>(varyings);
+		shade<Ops>(*light.setup, varyings, varyings + 3, diffuse, specular);
+	    }
+	    else {
+		for (int k = 0; k < 3; ++k) {
+		    diffuse[k] = varyings[k];
+		    specular[k] = varyings[3 + k];
+		}
+	    }
+
+	    I col = Ops::and_i(texel, Ops::set_i(0xff000000u));
+	    col = Ops::or_i(col, light_channel<Ops, 0>(texel, diffuse[0], specular[0]));
+	    col = Ops::or_i(col, light_channel<Ops, 8>(texel, diffuse[1], specular[1]));
+	    col = Ops::or_i(col, light_channel<Ops, 16>(texel, diffuse[2], specular[2]));
+	    Ops::store_i(span.pixels + i, pass, col);
+	    Ops::store(span.z_buffer + i, pass, span.depth_equal ? Ops::closer(z) : z);
+	    passed += Ops::count(pass);
+	}
+	return passed;
+    }
+
+    size_t span_tex_gouraud(const Span_Tex& span, const Span_Light& light) {
+	int i = span.begin;
+	size_t passed = span_lit<Wide_Ops, false>(span, light, i);
+	return passed + span_lit<Scalar_Ops, false>(span, light, i);
+    }
+
+    size_t span_tex_phong(const Span_Tex& span, const Span_Light& light) {
+	int i = span.begin;
+	size_t passed = span_lit<Wide_Ops, true>(span, light, i);
+	return passed + span_lit<Scalar_Ops, true>(span, light, i);
+    }
+
+    // only called for triangle corners, so it stays scalar
+    void light_points(const Light_Setup& setup, const float* in, float* out, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+	    float normal[3] = {in[i * 6 + 0], in[i * 6 + 1], in[i * 6 + 2]};
+	    normalize3<Scalar_Ops>(normal);
+	    shade<Scalar_Ops>(setup, normal, in + i * 6 + 3, out + i * 6, out + i * 6 + 3);
+	}
+    }
+
+} // namespace
+
+    extern const Kernel_Table D3_KERNEL_TABLE = {
+	D3_KERNEL_ISA,
+	fill_u32,
+	fill_f32,
+	transform_vec4,
+	skin_vec4,
+	cull_faces,
+	span_tex,
+	span_tex_gouraud,
+	span_tex_phong,
+	light_points,
+	span_depth,
+	span_g_buffer,
+	sample_tex,
+    };
+
+} // d3
@@ -0,0 +1,4 @@
+// built with -mavx2 -mfma or /arch:AVX2, see CMakeLists.txt
+#define D3_KERNEL_ISA ISA_AVX2
+#define D3_KERNEL_TABLE kernels_avx2
+#include "kernels.inl"
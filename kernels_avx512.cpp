@@ -0,0 +1,4 @@
+// built with -mavx512f -mavx512bw -mavx512dq -mavx512vl or /arch:AVX512, see CMakeLists.txt
+#define D3_KERNEL_ISA ISA_AVX512
+#define D3_KERNEL_TABLE kernels_avx512
+#include "kernels.inl"
@@ -0,0 +1,4 @@
+// built with no extra flags, sse2 is part of x86-64, see CMakeLists.txt
+#define D3_KERNEL_ISA ISA_SSE2
+#define D3_KERNEL_TABLE kernels_sse2
+#include "kernels.inl"
@@ -14,12 +14,34 @@ constexpr uint64_t window_width = 1200;
 constexpr uint64_t window_height = 900;
 
 
-d3::Transform cube_transform = {{0, 0, 0}, {0}};
-d3::Transform camera_transform = {{0, 0, -20}, {0}};
-d3::Transform surf_transform = {{0, 0, 0}, {0}};
-
-float camera_speed = 0.1f;
-gmath::Vec3 camera_dir = {0, 0, 0};
+// everything the fixed step advances, frames are drawn in between the last two states
+struct Sim_State {
+    d3::Transform cube = {{0, 0, 0}, {0}};
+    d3::Transform camera = {{0, 0, -20}, {0}};
+    d3::Transform surf = {{0, 0, 0}, {0}};
+};
+
+Sim_State sim;
+Sim_State sim_prev;
+
+// per second, the per frame steps these replace were tuned at 60 fps
+float move_speed = 3.f;
+float camera_speed = 6.f;
+// radians per pixel the mouse moved with the right button held
+float look_speed = 0.0125f;
+
+// keys held during the last sample, the fixed steps apply them
+struct Input {
+    float cube_x = 0;
+    float surf_x = 0;
+    gmath::Vec3 camera_dir = {0, 0, 0};
+    float camera_y = 0;
+    // mouse movement not applied by a step yet
+    float look_x = 0;
+    float look_y = 0;
+};
+
+Input input;
 
 d3::RectangleI rec = {window_width - 200, 150, 10, 10};
 
@@ -58,59 +80,52 @@ bool index_test(float u, float v, int width, int height) {
     return succ;
 }
 
+// reads what the input thread sampled until begin_frame, simulate applies it
 void controls(d3::Window& window) {
 
-	float step = 0.05f;
-	camera_dir = {0, 0, 0};
+	input.cube_x = 0;
+	input.surf_x = 0;
+	input.camera_dir = {0, 0, 0};
+	input.camera_y = 0;
 
 
-	if (GetAsyncKeyState(VK_LEFT) & 0x8000) {
-	    cube_transform.position.x -= step;
-	    surf_transform.angles.z += step;
+	if (window.input_state.down(VK_LEFT)) {
+	    input.cube_x = -1.f;
 	}
-	if (GetAsyncKeyState(VK_RIGHT) & 0x8000) {
-	    cube_transform.position.x += step;
-	    surf_transform.angles.z -= step;
+	if (window.input_state.down(VK_RIGHT)) {
+	    input.cube_x = 1.f;
 	}
 
-	if (GetAsyncKeyState(VK_UP) & 0x8000) {
-	    //camera_transform.position.y += step;
-	    //camera_dir.y = 
-	    surf_transform.angles.x += step;
+	if (window.input_state.down(VK_UP)) {
+	    input.surf_x = 1.f;
 	}
-	if (GetAsyncKeyState(VK_DOWN) & 0x8000) {
-	    //camera_transform.position.y -= step;
-	    surf_transform.angles.x -= step;
+	if (window.input_state.down(VK_DOWN)) {
+	    input.surf_x = -1.f;
 	}
 
-	if (GetAsyncKeyState('W') & 0x8000) {
-	    //camera_transform.position.z += step;
-	    camera_dir.z = 1.f;
+	if (window.input_state.down('W')) {
+	    input.camera_dir.z = 1.f;
 	}
-	if (GetAsyncKeyState('S') & 0x8000) {
-	    //camera_transform.position.z -= step;
-	    camera_dir.z = -1.f;
+	if (window.input_state.down('S')) {
+	    input.camera_dir.z = -1.f;
 	}
-	if (GetAsyncKeyState('A') & 0x8000) {
-	    //camera_transform.position.x -= step;
-	    camera_dir.x = -1.f;
+	if (window.input_state.down('A')) {
+	    input.camera_dir.x = -1.f;
 	}
-	if (GetAsyncKeyState('D') & 0x8000) {
-	    //camera_transform.position.x += step;
-	    camera_dir.x = 1.f;
+	if (window.input_state.down('D')) {
+	    input.camera_dir.x = 1.f;
 	}
 
-	if (GetAsyncKeyState(VK_SPACE) & 0x8000) {
-	    camera_transform.position.y += step;
+	if (window.input_state.down(VK_SPACE)) {
+	    input.camera_y = 1.f;
 	}
-	if (GetAsyncKeyState(VK_SHIFT) & 0x8000) {
-	    camera_transform.position.y -= step;
+	if (window.input_state.down(VK_SHIFT)) {
+	    input.camera_y = -1.f;
 	}
 
 
-	POINT mouse;
-	GetCursorPos(&mouse);
-	ScreenToClient(window.hwnd, &mouse);
+	// latest position the input thread saw
+	POINT mouse = {window.input_state.mouse_x, window.input_state.mouse_y};
 
 	if ((unsigned)mouse.x < window.width &&
 	    (unsigned)mouse.y < window.height)
@@ -119,17 +134,31 @@ void controls(d3::Window& window) {
 	    rec.y = mouse.y - rec.height / 2.f;
 	}
 
-	if (GetAsyncKeyState(VK_RBUTTON) & 0x8000) {
-	    int dif_x = mouse_prev.x - mouse.x;
-	    int dif_y = mouse_prev.y - mouse.y;
-	    camera_transform.angles.y -= dif_x * step / 4.f;
-	    camera_transform.angles.x -= dif_y * step / 4.f;
+	if (window.input_state.down(VK_RBUTTON)) {
+	    input.look_x += mouse_prev.x - mouse.x;
+	    input.look_y += mouse_prev.y - mouse.y;
 	}
 	mouse_prev = mouse;
 
 	//reduce_angles_all();
 }
 
+// one fixed step of dt seconds
+void simulate(Sim_State& state, float dt) {
+    state.cube.position.x += input.cube_x * move_speed * dt;
+    state.surf.angles.z -= input.cube_x * move_speed * dt;
+    state.surf.angles.x += input.surf_x * move_speed * dt;
+    state.camera.position.y += input.camera_y * move_speed * dt;
+
+    // mouse movement is a distance, not a rate: the first step takes all of it
+    state.camera.angles.y -= input.look_x * look_speed;
+    state.camera.angles.x -= input.look_y * look_speed;
+    input.look_x = 0;
+    input.look_y = 0;
+
+    state.camera.move_dir(input.camera_dir, camera_speed * dt);
+}
+
 size_t load_teapot(d3::Renderer& renderer, const d3::Transform& t = {0}, size_t tex_id = -1) {
 
     size_t teapot_id;
@@ -218,7 +247,7 @@ int main() {
 
     size_t teapot_id = load_teapot(renderer, {0, 0, -1}, 1);
     renderer.push_cube(.5f, {{0, 0, -1}}, 0);
-    size_t cube_id = renderer.push_cube(1, cube_transform, 1);
+    size_t cube_id = renderer.push_cube(1, sim.cube, 1);
 
 
     float surf_size = 3.f;
@@ -232,23 +261,36 @@ int main() {
 
 
 
+    renderer.incremental = true;
+    sim_prev = sim;
+    d3::Fixed_Step fixed_step;
+
     while(window.is_open) {
 
 	//timer.start();
-	controls(window);
-
+	d3::RectangleI rec_prev = rec;
 
 	window.begin_frame();
+	controls(window);
+
+	for (int steps = fixed_step.advance(); steps > 0; --steps) {
+	    sim_prev = sim;
+	    simulate(sim, (float)fixed_step.step_seconds);
+	}
+	float alpha = fixed_step.alpha();
+
+	renderer.obj_set_transform(cube_id, d3::lerp_transform(sim_prev.cube, sim.cube, alpha));
+	//renderer.obj_set_transform(surf_id, d3::lerp_transform(sim_prev.surf, sim.surf, alpha));
+	renderer.set_cam_transform(d3::lerp_transform(sim_prev.camera, sim.camera, alpha));
+	// the cursor rect is 2d, the renderer doesn't track it
+	renderer.mark_dirty(rec_prev);
+	renderer.mark_dirty(rec);
+	renderer.transform_vertices();
 
 	renderer.clear_pixels(d3::GRAY);
 
 	renderer.draw_rec(rec, {0xFF, 0x00, 0x22, 0xFF} );
 
-	renderer.obj_set_transform(cube_id, cube_transform);
-	//renderer.obj_set_transform(surf_id, surf_transform);
-	camera_transform.move_dir(camera_dir, camera_speed);
-	renderer.set_cam_transform(camera_transform);
-	renderer.transform_vertices();
 	//renderer.draw_triangles_wireframe(d3::WHITE);
 	renderer.draw_triangles();
 
@@ -259,5 +301,9 @@ int main() {
 
     }
 
+    renderer.profiler.print_report();
+    window.scheduler.print_report();
+    renderer.profiler.write_chrome_trace("trace.json");
+
     return 0;
 }
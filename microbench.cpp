@@ -0,0 +1,244 @@
+#include <cstdio>
+#include <print>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "d3.hpp"
+#include <gmath/gmath.hpp>
+
+// micro benchmarks of the rasterizer kernels in isolation, reports the best of
+// several runs as ns per pixel / vertex / sample, e.g.
+// d3_microbench --filter fill_triangle --format csv
+// the kernel variant comes from select_kernels, D3_ISA=sse2 d3_microbench forces one
+
+struct Micro_Options {
+    std::string filter;
+    std::string format = "json";
+    int repeats = 7;
+    double min_seconds = 0.05;
+};
+
+Micro_Options options;
+volatile uint32_t sink;
+const char* isa = "";
+
+void report(const char* kernel, const std::string& variant, const char* unit, double ns_per_unit, uint64_t units) {
+    if (options.format == "csv") {
+	std::println("{},{},{},{},{:.4f},{}", kernel, variant, isa, unit, ns_per_unit, units);
+	return;
+    }
+    std::println("{{\"kernel\":\"{}\",\"variant\":\"{}\",\"isa\":\"{}\",\"unit\":\"{}\",\"ns_per_unit\":{:.4f},\"units_per_call\":{}}}",
+		 kernel, variant, isa, unit, ns_per_unit, units);
+}
+
+// fn does units worth of work per call, repeated until min_seconds passed,
+// the fastest of options.repeats runs is reported
+template <typename Fn>
+void measure(const char* kernel, const std::string& variant, const char* unit, uint64_t units, Fn fn) {
+    if (!options.filter.empty() && std::string(kernel).find(options.filter) == std::string::npos) return;
+    if (units == 0) return;
+
+    fn();
+    double best = DBL_MAX;
+    for (int r = 0; r < options.repeats; ++r) {
+	uint64_t calls = 0;
+	auto begin = std::chrono::steady_clock::now();
+	std::chrono::duration<double> elapsed;
+	do {
+	    fn();
+	    calls++;
+	    elapsed = std::chrono::steady_clock::now() - begin;
+	} while (elapsed.count() < options.min_seconds);
+	best = std::min(best, elapsed.count() * 1e9 / (calls * units));
+    }
+    report(kernel, variant, unit, best, units);
+}
+
+// like Renderer::reset_z, but only for the pixels a kernel touches, so the reset doesn't dominate
+void reset_z_rect(d3::Renderer& renderer, int x, int y, int w, int h) {
+    for (int row = std::max(0, y); row < std::min(renderer.tex.height, y + h); ++row) {
+	float* z = renderer.z_buffer.data() + row * renderer.tex.width;
+	std::fill(z + std::max(0, x), z + std::min(renderer.tex.width, x + w), renderer.far_clip * 2.f);
+    }
+}
+
+// n * n vertices in a grid facing the camera, 2 * (n - 1)^2 faces
+size_t push_grid(d3::Renderer& renderer, int n, d3::Transform t) {
+    d3::Mesh mesh;
+    for (int y = 0; y < n; ++y) {
+	for (int x = 0; x < n; ++x) {
+	    float u = (float)x / (n - 1);
+	    float v = (float)y / (n - 1);
+	    mesh.vertices.push_back({u * 4.f - 2.f, 2.f - v * 4.f, 0.f, 1.f});
+	    mesh.uvs.push_back({u, v});
+	}
+    }
+    mesh.normals = {{0, 0, -1}};
+    for (int y = 0; y + 1 < n; ++y) {
+	for (int x = 0; x + 1 < n; ++x) {
+	    size_t i = x + y * n;
+	    mesh.faces.push_back({{{i, i, 0}, {i + 1, i + 1, 0}, {i + n, i + n, 0}}, 0});
+	    mesh.faces.push_back({{{i + n, i + n, 0}, {i + 1, i + 1, 0}, {i + n + 1, i + n + 1, 0}}, 0});
+	}
+    }
+    return renderer.push_mesh(mesh, t);
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+	std::string arg = argv[i];
+	bool has_value = i + 1 < argc;
+	if (arg == "--filter" && has_value) options.filter = argv[++i];
+	else if (arg == "--format" && has_value) options.format = argv[++i];
+	else if (arg == "--repeats" && has_value) options.repeats = std::atoi(argv[++i]);
+	else if (arg == "--min-seconds" && has_value) options.min_seconds = std::atof(argv[++i]);
+	else {
+	    std::println(stderr, "usage: {} [--filter kernel] [--format json|csv] [--repeats n] [--min-seconds s]", argv[0]);
+	    return 1;
+	}
+    }
+
+    constexpr int width = 1200;
+    constexpr int height = 900;
+    constexpr uint64_t pixel_count = (uint64_t)width * height;
+
+    d3::Renderer renderer;
+    renderer.log_level = d3::LOG_ERROR;
+    renderer.init_framebuffer(width, height);
+    isa = d3::isa_names[renderer.kernels->isa];
+
+    // procedural texture, so nothing has to be loaded from disk
+    d3::Texture checker;
+    checker.from_color(512, 512, 0);
+    for (int i = 0; i < 512 * 512; ++i) {
+	checker.pixels[i] = ((i / 512 / 32 + i % 512 / 32) % 2) ? d3::WHITE.to_int() : d3::BLUE.to_int();
+    }
+    renderer.textures.push_back(checker);
+
+    if (options.format == "csv") {
+	std::println("kernel,variant,isa,unit,ns_per_unit,units_per_call");
+    }
+
+    measure("clear_pixels", std::to_string(width) + "x" + std::to_string(height), "pixel", pixel_count, [&]() {
+	renderer.clear_pixels(d3::GRAY);
+    });
+
+    measure("reset_z", std::to_string(width) + "x" + std::to_string(height), "pixel", pixel_count, [&]() {
+	renderer.reset_z();
+    });
+
+    for (int length : {16, 256, 1024}) {
+	measure("draw_line_color", "diagonal_" + std::to_string(length), "pixel", length, [&]() {
+	    renderer.draw_line_color(10, 10, 10 + length, 10 + length / 2, d3::RED);
+	});
+    }
+
+    for (int length : {16, 256, 1024}) {
+	// far in front of the z buffer reset value so every fragment passes
+	measure("draw_line_hor_tex", "span_" + std::to_string(length), "pixel", length, [&]() {
+	    reset_z_rect(renderer, 10, 100, length + 1, 1);
+	    renderer.draw_line_hor_tex(10, 100, 10 + length, 1.f, 2.f, 0.f, 0.f, 1.f, 1.f, 0);
+	});
+    }
+
+    // same spans through the depth only kernel of the prepass
+    renderer.depth_mode = d3::DEPTH_ONLY;
+    for (int length : {16, 256, 1024}) {
+	measure("draw_line_hor_depth", "span_" + std::to_string(length), "pixel", length, [&]() {
+	    reset_z_rect(renderer, 10, 100, length + 1, 1);
+	    renderer.draw_line_hor_tex(10, 100, 10 + length, 1.f, 2.f, 0.f, 0.f, 1.f, 1.f, 0);
+	});
+    }
+    renderer.depth_mode = d3::DEPTH_LESS_WRITE;
+
+    // lit spans with one light of each type, normal and position at both ends of the span
+    renderer.lights.push_back({d3::LIGHT_DIRECTIONAL, {-.4f, -1.f, .6f}});
+    renderer.lights.push_back({d3::LIGHT_POINT, {0.f, 2.f, 2.f}});
+    for (d3::Shading shading : {d3::SHADING_GOURAUD, d3::SHADING_PHONG}) {
+	renderer.shading = shading;
+	renderer.update_lights();
+	const float left[6] = {0.f, 0.f, -1.f, -1.f, 0.f, 1.f};
+	const float right[6] = {.3f, 0.f, -1.f, 1.f, 0.f, 2.f};
+	float a1[6];
+	float a2[6];
+	const float* in[2] = {left, right};
+	float* out[2] = {a1, a2};
+	for (int end = 0; end < 2; ++end) {
+	    if (shading == d3::SHADING_GOURAUD) renderer.kernels->light_points(renderer.light_setup, in[end], out[end], 1);
+	    else std::copy(in[end], in[end] + 6, out[end]);
+	}
+	const char* name = shading == d3::SHADING_GOURAUD ? "draw_line_hor_gouraud" : "draw_line_hor_phong";
+	for (int length : {16, 256, 1024}) {
+	    measure(name, "span_" + std::to_string(length), "pixel", length, [&]() {
+		reset_z_rect(renderer, 10, 100, length + 1, 1);
+		renderer.draw_line_hor_tex_lit(10, 100, 10 + length, 1.f, 2.f, 0.f, 0.f, 1.f, 1.f, a1, a2, 0);
+	    });
+	}
+    }
+    renderer.shading = d3::SHADING_NONE;
+
+    {
+	constexpr uint64_t samples = 4096;
+	measure("texture_get_color", "512x512", "sample", samples, [&]() {
+	    uint32_t acc = 0;
+	    for (uint64_t i = 0; i < samples; ++i) {
+		float u = (float)(i * 37 % samples) / samples;
+		float v = (float)(i * 91 % samples) / samples;
+		acc ^= renderer.textures[0].get_color(u, v);
+	    }
+	    sink = acc;
+	});
+
+	// same lookups through the batched kernel
+	std::vector<float> us(samples);
+	std::vector<float> vs(samples);
+	std::vector<uint32_t> out(samples);
+	for (uint64_t i = 0; i < samples; ++i) {
+	    us[i] = (float)(i * 37 % samples) / samples;
+	    vs[i] = (float)(i * 91 % samples) / samples;
+	}
+	const d3::Texture& checker_tex = renderer.textures[0];
+	d3::Texture_View view = {checker_tex.pixels, checker_tex.width, checker_tex.height};
+	measure("sample_tex", "512x512", "sample", samples, [&]() {
+	    renderer.kernels->sample_tex(view, us.data(), vs.data(), out.data(), samples);
+	    sink = out[samples - 1];
+	});
+    }
+
+    struct Triangle_Case {
+	const char* name;
+	float size;
+    };
+    for (Triangle_Case tri : {Triangle_Case{"tiny", 4.f}, Triangle_Case{"medium", 64.f}, Triangle_Case{"huge", 800.f}}) {
+	gmath::Vec3 a = {50.f, 50.f, 1.f};
+	gmath::Vec3 b = {50.f + tri.size, 50.f + tri.size / 2.f, 1.f};
+	gmath::Vec3 c = {50.f + tri.size / 3.f, 50.f + tri.size, 1.f};
+
+	// the span kernels count what they touched
+	renderer.reset_z();
+	renderer.stats = {};
+	renderer.fill_triangle_color(a, b, c, d3::RED);
+	uint64_t fragments = renderer.stats.fragments_tested;
+	if (fragments == 0) fragments = (uint64_t)(tri.size * tri.size / 2.f);
+
+	measure("fill_triangle_color", tri.name, "pixel", fragments, [&]() {
+	    reset_z_rect(renderer, 49, 49, tri.size + 3, tri.size + 3);
+	    renderer.fill_triangle_color(a, b, c, d3::RED);
+	});
+    }
+
+    for (int n : {16, 64, 256}) {
+	d3::Renderer grid_renderer;
+	grid_renderer.log_level = d3::LOG_ERROR;
+	grid_renderer.init_framebuffer(width, height);
+	push_grid(grid_renderer, n, {{0, 0, 4}, {0}});
+	d3::Transform camera = {{0, 0, -1}, {0}};
+	grid_renderer.set_cam_transform(camera);
+
+	measure("transform_vertices", std::to_string(n * n) + "_vertices", "vertex", (uint64_t)n * n, [&]() {
+	    grid_renderer.transform_vertices();
+	});
+    }
+
+    return 0;
+}